@@ -50,9 +50,33 @@
 #include "batt_sys.h"
 #include "plugin.h" /* all other APIs including panel configuration */
 
-/* The last MAX_SAMPLES samples are averaged when charge rates are evaluated.
-   This helps prevent spikes in the "time left" values the user sees. */
-#define MAX_SAMPLES 10
+/* The remaining time is estimated from the rate at which the charge level
+   changed over the last RATE_WINDOW seconds, which is much steadier than the
+   rate the battery reports. Until there is enough history, an exponentially
+   weighted average of the reported rate is used instead. */
+#define HISTORY_SIZE         64  /* charge level samples kept */
+#define HISTORY_MIN_INTERVAL 30  /* seconds between samples */
+#define RATE_WINDOW          900 /* seconds of history for the rate */
+#define RATE_MIN_SPAN        120 /* shortest history to derive the rate from */
+#define RATE_EWMA_WEIGHT     0.3 /* weight of a new reported rate */
+
+#define TOOLTIP_GRAPH_WIDTH  160
+#define TOOLTIP_GRAPH_HEIGHT 40
+
+typedef struct {
+    gint64 time;                    /* monotonic time, microseconds */
+    int level;                      /* energy in mWh, or charge in mAh */
+    int percentage;
+} charge_sample;
+
+/* Seconds between updates. Batteries and AC adapters report changes of
+   state with uevents, the slow poll catches the charge level which not
+   all drivers report. */
+#define UPDATE_INTERVAL          9
+#define UPDATE_INTERVAL_UEVENTS 60
+/* Updates between looks for new batteries in aggregate mode when there are
+   no uevents to tell about them. */
+#define RESCAN_UPDATES          10
 
 typedef struct {
     char *alarmCommand,
@@ -82,12 +106,10 @@ typedef struct {
         border,
         height,
         length,
-        numSamples,
         requestedBorder,
-        *rateSamples,
-        rateSamplesSum,
         thickness,
         timer,
+        uevent_watch,
         state_elapsed_time,
         info_elapsed_time,
         wasCharging,
@@ -96,6 +118,20 @@ typedef struct {
     int battery_number;
     sem_t alarmProcessLock;
     battery* b;
+    gboolean aggregate;
+    GList *batteries;           /* in aggregate mode, b is their total */
+    guint generation;
+    guint rescan_updates;       /* updates since last rescan, without uevents */
+    /* charge level history, oldest sample at history_head - history_len + 1 */
+    charge_sample history[HISTORY_SIZE];
+    guint history_len,
+        history_head;
+    int direction;              /* 1 charging, -1 discharging, 0 otherwise */
+    gint64 direction_time;      /* when direction last changed */
+    double rate_avg;
+    GtkWidget *tooltip_box,
+        *tooltip_label,
+        *tooltip_graph;
     gboolean has_ac_adapter;
     gboolean show_extended_information;
     LXPanel *panel;
@@ -160,30 +196,49 @@ static gchar* make_tooltip(lx_battery* lx_b, gboolean isCharging)
             int hours = lx_b->b->seconds / 3600;
             int left_seconds = lx_b->b->seconds - 3600 * hours;
             int minutes = left_seconds / 60;
-            tooltip = g_strdup_printf(
-                    _("Battery %d: %d%% charged, %d:%02d until full"),
-                    lx_b->battery_number, lx_b->b->percentage,
-                    hours,
-                    minutes );
+            if (lx_b->aggregate)
+                tooltip = g_strdup_printf(
+                        _("Batteries: %d%% charged, %d:%02d until full"),
+                        lx_b->b->percentage,
+                        hours,
+                        minutes );
+            else
+                tooltip = g_strdup_printf(
+                        _("Battery %d: %d%% charged, %d:%02d until full"),
+                        lx_b->battery_number, lx_b->b->percentage,
+                        hours,
+                        minutes );
         }
         else
             goto _charged;
     } else {
         /* if we have enough rate information for battery */
-        if (lx_b->b->percentage != 100) {
+        if (lx_b->b->percentage != 100 && lx_b->b->seconds > 0) {
             int hours = lx_b->b->seconds / 3600;
             int left_seconds = lx_b->b->seconds - 3600 * hours;
             int minutes = left_seconds / 60;
-            tooltip = g_strdup_printf(
-                    _("Battery %d: %d%% charged, %d:%02d left"),
-                    lx_b->battery_number, lx_b->b->percentage,
-                    hours,
-                    minutes );
+            if (lx_b->aggregate)
+                tooltip = g_strdup_printf(
+                        _("Batteries: %d%% charged, %d:%02d left"),
+                        lx_b->b->percentage,
+                        hours,
+                        minutes );
+            else
+                tooltip = g_strdup_printf(
+                        _("Battery %d: %d%% charged, %d:%02d left"),
+                        lx_b->battery_number, lx_b->b->percentage,
+                        hours,
+                        minutes );
         } else {
 _charged:
-            tooltip = g_strdup_printf(
-                    _("Battery %d: %d%% charged"),
-                    lx_b->battery_number, lx_b->b->percentage);
+            if (lx_b->aggregate)
+                tooltip = g_strdup_printf(
+                        _("Batteries: %d%% charged"),
+                        lx_b->b->percentage);
+            else
+                tooltip = g_strdup_printf(
+                        _("Battery %d: %d%% charged"),
+                        lx_b->battery_number, lx_b->b->percentage);
         }
     }
 
@@ -215,6 +270,200 @@ _charged:
     return tooltip;
 }
 
+/* Slope of the charge level over the samples taken since start, in level
+   units per hour, by least squares. Returns FALSE if the samples span less
+   than RATE_MIN_SPAN. */
+static gboolean history_get_rate(lx_battery *lx_b, gint64 start, double *rate)
+{
+    const charge_sample *newest = &lx_b->history[lx_b->history_head];
+    const charge_sample *sample;
+    double x, sx = 0, sy = 0, sxx = 0, sxy = 0, d;
+    gint64 oldest = newest->time;
+    guint i, n = 0;
+
+    for (i = 0; i < lx_b->history_len; i++) {
+        sample = &lx_b->history[(lx_b->history_head + HISTORY_SIZE - i) % HISTORY_SIZE];
+        if (sample->time < start)
+            break;
+        x = (double)(sample->time - newest->time) / (3600.0 * G_USEC_PER_SEC);
+        sx += x;
+        sy += sample->level;
+        sxx += x * x;
+        sxy += x * sample->level;
+        oldest = sample->time;
+        n++;
+    }
+
+    if (n < 3 || newest->time - oldest < RATE_MIN_SPAN * G_USEC_PER_SEC)
+        return FALSE;
+    d = n * sxx - sx * sx;
+    if (d <= 0)
+        return FALSE;
+    *rate = (n * sxy - sx * sy) / d;
+    return TRUE;
+}
+
+/* Records the charge level and sets b->seconds from the smoothed rate. */
+static void update_estimate(lx_battery *lx_b)
+{
+    battery *b = lx_b->b;
+    charge_sample *sample;
+    gint64 now = g_get_monotonic_time();
+    int level, full, rate, direction;
+    double slope, estimate = -1;
+
+    if (!strcasecmp(b->state, "charging"))
+        direction = 1;
+    else if (!strcasecmp(b->state, "discharging"))
+        direction = -1;
+    else
+        direction = 0;
+
+    /* prefer energy, which can be summed over batteries of any voltage */
+    if (b->energy_now != -1 && b->energy_full > 0) {
+        level = b->energy_now;
+        full = b->energy_full;
+        rate = b->power_now;
+        if (rate == -1 && b->current_now != -1 && b->voltage_now != -1)
+            rate = b->current_now * b->voltage_now / 1000;
+    } else if (b->charge_now != -1 && b->charge_full > 0) {
+        level = b->charge_now;
+        full = b->charge_full;
+        rate = b->current_now;
+    } else {
+        b->seconds = -1;
+        return;
+    }
+
+    /* the old rate says nothing about the new direction */
+    if (direction != lx_b->direction) {
+        lx_b->direction = direction;
+        lx_b->direction_time = now;
+        lx_b->rate_avg = -1;
+    }
+
+    /* keep samples apart, a burst of uevents only refreshes the newest one */
+    sample = &lx_b->history[lx_b->history_head];
+    if (lx_b->history_len == 0 ||
+        now - sample->time >= HISTORY_MIN_INTERVAL * G_USEC_PER_SEC) {
+        if (lx_b->history_len > 0)
+            lx_b->history_head = (lx_b->history_head + 1) % HISTORY_SIZE;
+        if (lx_b->history_len < HISTORY_SIZE)
+            lx_b->history_len++;
+        sample = &lx_b->history[lx_b->history_head];
+        sample->time = now;
+    }
+    sample->level = level;
+    sample->percentage = b->percentage;
+
+    if (rate > MIN_PRESENT_RATE)
+        lx_b->rate_avg = lx_b->rate_avg < 0 ? rate
+                       : lx_b->rate_avg + RATE_EWMA_WEIGHT * (rate - lx_b->rate_avg);
+
+    if (history_get_rate(lx_b, MAX(lx_b->direction_time, now - RATE_WINDOW * G_USEC_PER_SEC),
+                         &slope) && slope * direction > 0)
+        estimate = slope * direction;
+    else if (lx_b->rate_avg > 0)
+        estimate = lx_b->rate_avg;
+
+    if (direction == 0 || estimate <= MIN_PRESENT_RATE)
+        b->seconds = -1;
+    else if (direction > 0)
+        b->seconds = 3600 * MAX(full - level, 0) / estimate;
+    else
+        b->seconds = 3600 * level / estimate;
+}
+
+/* Draws the charge percentage history, the newest sample at the right. */
+#if GTK_CHECK_VERSION(3, 0, 0)
+static gboolean tooltip_graph_draw(GtkWidget *widget, cairo_t *cr, lx_battery *lx_b)
+{
+#else
+static gboolean tooltip_graph_expose(GtkWidget *widget, GdkEventExpose *event, lx_battery *lx_b)
+{
+    cairo_t *cr = gdk_cairo_create(gtk_widget_get_window(widget));
+#endif
+    const charge_sample *sample;
+    GtkAllocation allocation;
+    gint64 newest, span;
+    double x = 0;
+    guint i;
+
+    gtk_widget_get_allocation(widget, &allocation);
+
+#if GTK_CHECK_VERSION(3, 0, 0)
+    gdk_cairo_set_source_rgba(cr, &lx_b->background);
+#else
+    gdk_cairo_set_source_color(cr, &lx_b->background);
+#endif
+    cairo_paint(cr);
+
+    if (lx_b->history_len > 1) {
+        newest = lx_b->history[lx_b->history_head].time;
+        span = newest - lx_b->history[(lx_b->history_head + HISTORY_SIZE
+                                       - lx_b->history_len + 1) % HISTORY_SIZE].time;
+        cairo_move_to(cr, allocation.width, allocation.height);
+        for (i = 0; i < lx_b->history_len; i++) {
+            sample = &lx_b->history[(lx_b->history_head + HISTORY_SIZE - i) % HISTORY_SIZE];
+            x = allocation.width - (double)(newest - sample->time) * allocation.width / MAX(span, 1);
+            cairo_line_to(cr, x, allocation.height
+                              - sample->percentage * allocation.height / 100.0);
+        }
+        cairo_line_to(cr, x, allocation.height);
+        cairo_close_path(cr);
+#if GTK_CHECK_VERSION(3, 0, 0)
+        gdk_cairo_set_source_rgba(cr, lx_b->direction < 0 ? &lx_b->discharging1 : &lx_b->charging1);
+#else
+        gdk_cairo_set_source_color(cr, lx_b->direction < 0 ? &lx_b->discharging1 : &lx_b->charging1);
+#endif
+        cairo_fill(cr);
+    }
+
+    check_cairo_status(cr);
+#if !GTK_CHECK_VERSION(3, 0, 0)
+    cairo_destroy(cr);
+#endif
+    return FALSE;
+}
+
+static gboolean queryTooltip(GtkWidget *widget, gint x, gint y, gboolean keyboard_mode,
+                             GtkTooltip *tooltip, lx_battery *lx_b)
+{
+    gchar *text;
+
+    /* show the plain text until there is some history */
+    if (lx_b->b == NULL || lx_b->history_len < 2)
+        return FALSE;
+
+    if (lx_b->tooltip_box == NULL) {
+        lx_b->tooltip_box = gtk_vbox_new(FALSE, 4);
+        g_object_ref_sink(lx_b->tooltip_box);
+        lx_b->tooltip_label = gtk_label_new(NULL);
+        gtk_misc_set_alignment(GTK_MISC(lx_b->tooltip_label), 0, 0.5);
+        gtk_box_pack_start(GTK_BOX(lx_b->tooltip_box), lx_b->tooltip_label, FALSE, FALSE, 0);
+        lx_b->tooltip_graph = gtk_drawing_area_new();
+        gtk_widget_set_size_request(lx_b->tooltip_graph, TOOLTIP_GRAPH_WIDTH,
+                                    TOOLTIP_GRAPH_HEIGHT);
+#if GTK_CHECK_VERSION(3, 0, 0)
+        g_signal_connect(lx_b->tooltip_graph, "draw",
+                         G_CALLBACK(tooltip_graph_draw), lx_b);
+#else
+        g_signal_connect(lx_b->tooltip_graph, "expose-event",
+                         G_CALLBACK(tooltip_graph_expose), lx_b);
+#endif
+        gtk_box_pack_start(GTK_BOX(lx_b->tooltip_box), lx_b->tooltip_graph, FALSE, FALSE, 0);
+        gtk_widget_show_all(lx_b->tooltip_box);
+    }
+
+    text = make_tooltip(lx_b, battery_is_charging(lx_b->b));
+    gtk_label_set_text(GTK_LABEL(lx_b->tooltip_label), text);
+    g_free(text);
+    gtk_widget_queue_draw(lx_b->tooltip_graph);
+    gtk_tooltip_set_custom(tooltip, lx_b->tooltip_box);
+
+    return TRUE;
+}
+
 static void set_tooltip_text(lx_battery* lx_b)
 {
     if (lx_b->b == NULL)
@@ -359,7 +608,89 @@ update_done:
     cairo_destroy(cr);
 }
 
-/* This callback is called every 3 seconds */
+/* Forgets the charge history, it is meaningless for another battery. */
+static void history_reset(lx_battery *lx_b)
+{
+    lx_b->history_len = lx_b->history_head = 0;
+    lx_b->direction = 0;
+    lx_b->direction_time = 0;
+    lx_b->rate_avg = -1;
+}
+
+/* Finds the batteries to monitor and starts a new history. */
+static void get_batteries(lx_battery *lx_b)
+{
+    battery_free(lx_b->b);
+    lx_b->b = NULL;
+    g_list_free_full(lx_b->batteries, (GDestroyNotify)battery_free);
+    lx_b->batteries = NULL;
+    history_reset(lx_b);
+
+    if (lx_b->aggregate) {
+        lx_b->generation = battery_get_generation();
+        lx_b->batteries = battery_get_all();
+        if (lx_b->batteries) {
+            lx_b->b = battery_new();
+            battery_aggregate(lx_b->b, lx_b->batteries);
+        }
+    } else
+        lx_b->b = battery_get(lx_b->battery_number);
+
+    if (lx_b->b)
+        update_estimate(lx_b);
+}
+
+/* Returns TRUE if both lists hold the same batteries. */
+static gboolean batteries_equal(GList *a, GList *b)
+{
+    for (; a && b; a = a->next, b = b->next)
+        if (g_strcmp0(((battery *)a->data)->path, ((battery *)b->data)->path) != 0)
+            return FALSE;
+    return a == b;
+}
+
+/* Updates all batteries and their total. The list is rebuilt when a
+   battery goes away or a power supply was added, and the history is
+   started anew if that changed the set of batteries. Rescanning opens
+   all files of all batteries again so it is done only when needed. */
+static void update_batteries(lx_battery *lx_b)
+{
+    GList *l, *batteries;
+    gboolean rescan;
+
+    rescan = lx_b->generation != battery_get_generation();
+    if (lx_b->uevent_watch == 0) {
+        /* nothing tells about inserted batteries, look for them sometimes */
+        if (++lx_b->rescan_updates >= RESCAN_UPDATES)
+            rescan = TRUE;
+    } else if (lx_b->batteries == NULL)
+        rescan = TRUE;
+    for (l = lx_b->batteries; l && !rescan; l = l->next) {
+        if (battery_update(l->data) == NULL)
+            rescan = TRUE;
+    }
+
+    if (rescan) {
+        lx_b->rescan_updates = 0;
+        lx_b->generation = battery_get_generation();
+        batteries = battery_get_all();
+        if (!batteries_equal(batteries, lx_b->batteries))
+            history_reset(lx_b);
+        g_list_free_full(lx_b->batteries, (GDestroyNotify)battery_free);
+        lx_b->batteries = batteries;
+    }
+
+    if (lx_b->batteries) {
+        if (lx_b->b == NULL)
+            lx_b->b = battery_new();
+        battery_aggregate(lx_b->b, lx_b->batteries);
+    } else {
+        battery_free(lx_b->b);
+        lx_b->b = NULL;
+    }
+}
+
+/* This callback is called periodically and on power supply uevents */
 static int update_timout(lx_battery *lx_b) {
     battery *bat;
     if (g_source_is_destroyed(g_main_current_source()))
@@ -370,14 +701,21 @@ static int update_timout(lx_battery *lx_b) {
     lx_b->state_elapsed_time++;
     lx_b->info_elapsed_time++;
 
-    bat = battery_update( lx_b->b );
-    if (bat == NULL)
-    {
-        battery_free(lx_b->b);
+    if (lx_b->aggregate)
+        update_batteries(lx_b);
+    else {
+        bat = battery_update( lx_b->b );
+        if (bat == NULL)
+        {
+            battery_free(lx_b->b);
 
-        /* maybe in the mean time a battery has been inserted. */
-        lx_b->b = battery_get(lx_b->battery_number);
+            /* maybe in the mean time a battery has been inserted. */
+            lx_b->b = battery_get(lx_b->battery_number);
+            history_reset(lx_b);
+        }
     }
+    if (lx_b->b != NULL)
+        update_estimate(lx_b);
 
     update_display( lx_b, TRUE );
 
@@ -497,7 +835,9 @@ static GtkWidget * constructor(LXPanel *panel, config_setting_t *settings)
     /* get requested battery */
     if (config_setting_lookup_int(settings, "BatteryNumber", &tmp_int))
         lx_b->battery_number = MAX(0, tmp_int);
-    lx_b->b = battery_get(lx_b->battery_number);
+    if (config_setting_lookup_int(settings, "Aggregate", &tmp_int))
+        lx_b->aggregate = (tmp_int != 0);
+    get_batteries(lx_b);
 
     p = gtk_event_box_new();
     lxpanel_plugin_set_data(p, lx_b, destructor);
@@ -569,6 +909,8 @@ static GtkWidget * constructor(LXPanel *panel, config_setting_t *settings)
 
     g_signal_connect (G_OBJECT (lx_b->drawingArea),"configure-event",
           G_CALLBACK (configureEvent), (gpointer) lx_b);
+    g_signal_connect (G_OBJECT (lx_b->drawingArea), "query-tooltip",
+          G_CALLBACK (queryTooltip), (gpointer) lx_b);
 #if GTK_CHECK_VERSION(3, 0, 0)
     g_signal_connect (G_OBJECT (lx_b->drawingArea), "draw",
           G_CALLBACK(draw), (gpointer) lx_b);
@@ -606,7 +948,9 @@ static GtkWidget * constructor(LXPanel *panel, config_setting_t *settings)
 #endif
 
     /* Start the update loop */
-    lx_b->timer = g_timeout_add_seconds( 9, (GSourceFunc) update_timout, (gpointer) lx_b);
+    lx_b->uevent_watch = battery_watch_add((GSourceFunc) update_timout, lx_b);
+    lx_b->timer = g_timeout_add_seconds(lx_b->uevent_watch ? UPDATE_INTERVAL_UEVENTS : UPDATE_INTERVAL,
+                                        (GSourceFunc) update_timout, (gpointer) lx_b);
 
     RET(p);
 }
@@ -621,6 +965,11 @@ destructor(gpointer data)
 
     if (b->b != NULL)
         battery_free(b->b);
+    g_list_free_full(b->batteries, (GDestroyNotify)battery_free);
+    if (b->tooltip_box) {
+        gtk_widget_destroy(b->tooltip_box);
+        g_object_unref(b->tooltip_box);
+    }
 
     if (b->pixmap)
         cairo_surface_destroy(b->pixmap);
@@ -632,10 +981,11 @@ destructor(gpointer data)
     g_free(b->dischargingColor1);
     g_free(b->dischargingColor2);
 
-    g_free(b->rateSamples);
     sem_destroy(&(b->alarmProcessLock));
     if (b->timer)
         g_source_remove(b->timer);
+    if (b->uevent_watch)
+        g_source_remove(b->uevent_watch);
     g_free(b);
 
     RET();
@@ -675,8 +1025,7 @@ static gboolean applyConfig(gpointer user_data)
     lx_battery *b = lxpanel_plugin_get_data(user_data);
 
     /* Update the battery we monitor */
-    battery_free(b->b);
-    b->b = battery_get(b->battery_number);
+    get_batteries(b);
 
     /* Update colors */
     if (b->backgroundColor &&
@@ -754,6 +1103,7 @@ static gboolean applyConfig(gpointer user_data)
     config_group_set_int(b->settings, "ShowExtendedInformation",
                          b->show_extended_information);
     config_group_set_int(b->settings, "BatteryNumber", b->battery_number);
+    config_group_set_int(b->settings, "Aggregate", b->aggregate);
 
     update_display(b, TRUE);
 
@@ -779,6 +1129,7 @@ static GtkWidget *config(LXPanel *panel, GtkWidget *p) {
                                             1, 50), CONF_TYPE_EXTERNAL,
             _("Show Extended Information"), &b->show_extended_information, CONF_TYPE_BOOL,
             _("Number of battery to monitor"), &b->battery_number, CONF_TYPE_INT,
+            _("Combine all batteries"), &b->aggregate, CONF_TYPE_BOOL,
             NULL);
 }
 
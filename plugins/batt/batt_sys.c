@@ -38,10 +38,40 @@
 /* shrug: get rid of this */
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#endif
 
-battery* battery_new() {
+#define UEVENT_BUF_SIZE 4096
+
+static const char * const battery_files[BATTERY_N_FILES] = {
+    [BATTERY_CHARGE_NOW]         = "charge_now",
+    [BATTERY_ENERGY_NOW]         = "energy_now",
+    [BATTERY_CURRENT_NOW]        = "current_now",
+    [BATTERY_POWER_NOW]          = "power_now",
+    [BATTERY_VOLTAGE_NOW]        = "voltage_now",
+    [BATTERY_CHARGE_FULL_DESIGN] = "charge_full_design",
+    [BATTERY_ENERGY_FULL_DESIGN] = "energy_full_design",
+    [BATTERY_CHARGE_FULL]        = "charge_full",
+    [BATTERY_ENERGY_FULL]        = "energy_full",
+    [BATTERY_TYPE]               = "type",
+    [BATTERY_STATUS]             = "status",
+    [BATTERY_STATE]              = "state",
+    [BATTERY_CAPACITY]           = "capacity"
+};
+
+battery* battery_new(void) {
     static int battery_num = 1;
     battery * b = g_new0 ( battery, 1 );
+    int i;
+
+    b->dir_fd = -1;
+    for (i = 0; i < BATTERY_N_FILES; i++)
+        b->fds[i] = -1;
     b->type_battery = TRUE;
     //b->capacity_unit = "mAh";
     b->energy_full = -1;
@@ -63,41 +93,78 @@ battery* battery_new() {
 }
 
 
-static gchar* parse_info_file(battery *b, char *sys_file)
+/* Opens the battery dir and all its files once, they are re-read with
+ * pread() on each update instead of building paths and reopening them. */
+static void battery_open(battery *b)
 {
-    char *buf = NULL;
-    GString *filename = g_string_new(ACPI_PATH_SYS_POWER_SUPPLY);
+    gchar *dirname;
+    int i;
+
+    dirname = g_build_filename(ACPI_PATH_SYS_POWER_SUPPLY, b->path, NULL);
+    b->dir_fd = open(dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    g_free(dirname);
+    if (b->dir_fd < 0)
+        return;
 
-    g_string_append_printf (filename, "/%s/%s", b->path, sys_file);
+    for (i = 0; i < BATTERY_N_FILES; i++)
+        b->fds[i] = openat(b->dir_fd, battery_files[i], O_RDONLY | O_CLOEXEC);
+}
+
+static void battery_close(battery *b)
+{
+    int i;
 
-    if (g_file_get_contents(filename->str, &buf, NULL, NULL) == TRUE) {
-        g_strstrip( buf );
+    for (i = 0; i < BATTERY_N_FILES; i++)
+    {
+        if (b->fds[i] >= 0)
+            close(b->fds[i]);
+        b->fds[i] = -1;
     }
+    if (b->dir_fd >= 0)
+        close(b->dir_fd);
+    b->dir_fd = -1;
+}
 
-    g_string_free(filename, TRUE);
+static gboolean parse_info_file(battery *b, battery_file sys_file, char *buf, gsize size)
+{
+    ssize_t len;
+
+    if (b->fds[sys_file] < 0)
+        return FALSE;
 
-    return buf;
+    /* sysfs attributes are regenerated when read from offset 0 */
+    while ((len = pread(b->fds[sys_file], buf, size - 1, 0)) < 0 && errno == EINTR)
+        continue;
+    if (len <= 0)
+        return FALSE;
+
+    buf[len] = '\0';
+    g_strstrip(buf);
+    return TRUE;
 }
 
 /* get_gint_from_infofile():
  *         If the sys_file exists, then its value is converted to an int,
  *         divided by 1000, and returned.
  *         Failure is indicated by returning -1. */
-static gint get_gint_from_infofile(battery *b, gchar *sys_file)
+static gint get_gint_from_infofile(battery *b, battery_file sys_file)
 {
-    gchar *file_content = parse_info_file(b, sys_file);
-    gint value = -1;
+    char buf[BUF_SIZE];
 
-    if (file_content != NULL)
-        value = atoi(file_content) / 1000;
-    g_free(file_content);
+    if (!parse_info_file(b, sys_file, buf, sizeof(buf)))
+        return -1;
 
-    return value;
+    return atoi(buf) / 1000;
 }
 
-static gchar* get_gchar_from_infofile(battery *b, gchar *sys_file)
+static gchar* get_gchar_from_infofile(battery *b, battery_file sys_file)
 {
-    return parse_info_file(b, sys_file);
+    char buf[BUF_SIZE];
+
+    if (!parse_info_file(b, sys_file, buf, sizeof(buf)))
+        return NULL;
+
+    return g_strdup(buf);
 }
 
 #if 0 /* never used */
@@ -147,41 +214,34 @@ void battery_print(battery *b, int show_capacity)
 }
 #endif
 
-static gboolean battery_inserted(gchar* path)
+/* Every device dir in sysfs has an uevent file, it disappears together with
+ * the dir when the battery is removed. */
+static gboolean battery_inserted(battery *b)
 {
-    if (path == NULL)
+    if (b->dir_fd < 0)
         return FALSE;
 
-    GString *dirname = g_string_new(ACPI_PATH_SYS_POWER_SUPPLY);
-    GDir *dir;
-
-    g_string_append_printf (dirname, "/%s/", path);
-    dir = g_dir_open(dirname->str, 0, NULL);
-    if (dir)
-        g_dir_close(dir);
-    g_string_free(dirname, TRUE);
-
-    return dir ? TRUE : FALSE;
+    return faccessat(b->dir_fd, "uevent", F_OK, 0) == 0;
 }
 
 
 battery* battery_update(battery *b)
 {
-    gchar *gctmp;
+    char buf[BUF_SIZE];
     int promille;
 
     if (b == NULL)
         return NULL;
 
-    if (!battery_inserted(b->path))
+    if (!battery_inserted(b))
         return NULL;
 
     /* read from sysfs */
-    b->charge_now = get_gint_from_infofile(b, "charge_now");
-    b->energy_now = get_gint_from_infofile(b, "energy_now");
+    b->charge_now = get_gint_from_infofile(b, BATTERY_CHARGE_NOW);
+    b->energy_now = get_gint_from_infofile(b, BATTERY_ENERGY_NOW);
 
-    b->current_now = get_gint_from_infofile(b, "current_now");
-    b->power_now   = get_gint_from_infofile(b, "power_now");
+    b->current_now = get_gint_from_infofile(b, BATTERY_CURRENT_NOW);
+    b->power_now   = get_gint_from_infofile(b, BATTERY_POWER_NOW);
     /* FIXME: Some battery drivers report -1000 when the discharge rate is
      * unavailable. Others use negative values when discharging. Best we can do
      * is to treat -1 as an error, and take the absolute value otherwise.
@@ -190,28 +250,31 @@ battery* battery_update(battery *b)
     if (b->current_now < -1)
             b->current_now = - b->current_now;
 
-    b->charge_full = get_gint_from_infofile(b, "charge_full");
-    b->energy_full = get_gint_from_infofile(b, "energy_full");
+    b->charge_full = get_gint_from_infofile(b, BATTERY_CHARGE_FULL);
+    b->energy_full = get_gint_from_infofile(b, BATTERY_ENERGY_FULL);
 
-    b->charge_full_design = get_gint_from_infofile(b, "charge_full_design");
-    b->energy_full_design = get_gint_from_infofile(b, "energy_full_design");
+    b->charge_full_design = get_gint_from_infofile(b, BATTERY_CHARGE_FULL_DESIGN);
+    b->energy_full_design = get_gint_from_infofile(b, BATTERY_ENERGY_FULL_DESIGN);
 
-    b->voltage_now = get_gint_from_infofile(b, "voltage_now");
+    b->voltage_now = get_gint_from_infofile(b, BATTERY_VOLTAGE_NOW);
 
-    gctmp = get_gchar_from_infofile(b, "type");
-    b->type_battery = gctmp ? (strcasecmp(gctmp, "battery") == 0) : TRUE;
-    g_free(gctmp);
+    if (parse_info_file(b, BATTERY_TYPE, buf, sizeof(buf)))
+        b->type_battery = (strcasecmp(buf, "battery") == 0);
+    else
+        b->type_battery = TRUE;
 
-    g_free(b->state);
-    b->state = get_gchar_from_infofile(b, "status");
-    if (!b->state)
-        b->state = get_gchar_from_infofile(b, "state");
-    if (!b->state) {
+    if (!parse_info_file(b, BATTERY_STATUS, buf, sizeof(buf)) &&
+        !parse_info_file(b, BATTERY_STATE, buf, sizeof(buf))) {
         if (b->charge_now != -1 || b->energy_now != -1
                 || b->charge_full != -1 || b->energy_full != -1)
-            b->state = g_strdup("available");
+            strcpy(buf, "available");
         else
-            b->state = g_strdup("unavailable");
+            strcpy(buf, "unavailable");
+    }
+    /* the state rarely changes, keep the string then */
+    if (g_strcmp0(b->state, buf) != 0) {
+        g_free(b->state);
+        b->state = g_strdup(buf);
     }
 
 #if 0 /* those conversions might be good for text prints but are pretty wrong for tooltip and calculations */
@@ -262,12 +325,10 @@ battery* battery_update(battery *b)
         promille = (b->energy_now * 1000) / b->energy_full;
     else {
         /* Pinebook has percentage in capacity, and no total energy. */
-        gchar *file_content = parse_info_file(b, "capacity");
         gint value = -1;
 
-        if (file_content != NULL)
-            value = atoi(file_content);
-        g_free(file_content);
+        if (parse_info_file(b, BATTERY_CAPACITY, buf, sizeof(buf)))
+            value = atoi(buf);
         if (value != -1 && value <= 100 && value >= 0) {
             promille = value * 10;
             b->charge_full = 10000;  /* mAh from pinebook spec */
@@ -329,6 +390,7 @@ battery *battery_get(int battery_number) {
     if (g_file_test(batt_path, G_FILE_TEST_IS_DIR) == TRUE) {
         b = battery_new();
         b->path = g_strdup( batt_name);
+        battery_open ( b );
         battery_update ( b );
 
         if (!b->type_battery) {
@@ -360,6 +422,7 @@ battery *battery_get(int battery_number) {
     {
         b = battery_new();
         b->path = g_strdup( entry );
+        battery_open ( b );
         battery_update ( b );
 
         /* We're looking for a battery with the selected ID */
@@ -380,9 +443,109 @@ battery *battery_get(int battery_number) {
     return b;
 }
 
+/* Returns all batteries, skipping AC adapters and other power supplies. */
+GList *battery_get_all(void)
+{
+    GList *batteries = NULL;
+    const gchar *entry;
+    battery *b;
+    GDir *dir;
+
+    dir = g_dir_open( ACPI_PATH_SYS_POWER_SUPPLY, 0, NULL );
+    if ( dir == NULL )
+        return NULL;
+
+    while ( ( entry = g_dir_read_name (dir) ) != NULL )
+    {
+        b = battery_new();
+        b->path = g_strdup( entry );
+        battery_open ( b );
+        if (battery_update(b) != NULL && b->type_battery)
+            batteries = g_list_prepend(batteries, b);
+        else
+            battery_free(b);
+    }
+    g_dir_close( dir );
+
+    return g_list_reverse(batteries);
+}
+
+static void add_value(int *sum, int value)
+{
+    if (value == -1)
+        return;
+    *sum = (*sum == -1) ? value : *sum + value;
+}
+
+/* Fills total with the sums of all batteries so they can be shown as one.
+ * The remaining time is left unknown. */
+void battery_aggregate(battery *total, GList *batteries)
+{
+    gboolean charging = FALSE, discharging = FALSE, full = TRUE;
+    const char *state = NULL;
+    int percentage = 0, n = 0;
+    battery *b;
+    GList *l;
+
+    total->charge_now = total->energy_now = -1;
+    total->current_now = total->power_now = total->voltage_now = -1;
+    total->charge_full = total->energy_full = -1;
+    total->charge_full_design = total->energy_full_design = -1;
+    total->type_battery = TRUE;
+    total->seconds = -1;
+
+    for (l = batteries; l; l = l->next) {
+        b = l->data;
+        add_value(&total->charge_now, b->charge_now);
+        add_value(&total->energy_now, b->energy_now);
+        add_value(&total->current_now, b->current_now);
+        add_value(&total->power_now, b->power_now);
+        add_value(&total->charge_full, b->charge_full);
+        add_value(&total->energy_full, b->energy_full);
+        add_value(&total->charge_full_design, b->charge_full_design);
+        add_value(&total->energy_full_design, b->energy_full_design);
+        total->voltage_now = MAX(total->voltage_now, b->voltage_now);
+
+        if (!strcasecmp(b->state, "charging"))
+            charging = TRUE;
+        else if (!strcasecmp(b->state, "discharging"))
+            discharging = TRUE;
+        if (strcasecmp(b->state, "full"))
+            full = FALSE;
+        if (state == NULL)
+            state = b->state;
+        percentage += b->percentage;
+        n++;
+    }
+
+    /* running from batteries if any of them discharges */
+    if (discharging)
+        state = "Discharging";
+    else if (charging)
+        state = "Charging";
+    else if (full)
+        state = "Full";
+    else if (state == NULL)
+        state = "Unknown";
+    if (g_strcmp0(total->state, state) != 0) {
+        g_free(total->state);
+        total->state = g_strdup(state);
+    }
+
+    if (total->energy_now != -1 && total->energy_full > 0)
+        total->percentage = (total->energy_now * 100 + total->energy_full / 2) / total->energy_full;
+    else if (total->charge_now != -1 && total->charge_full > 0)
+        total->percentage = (total->charge_now * 100 + total->charge_full / 2) / total->charge_full;
+    else
+        total->percentage = n ? percentage / n : 0;
+    if (total->percentage > 100)
+        total->percentage = 100;
+}
+
 void battery_free(battery* bat)
 {
     if (bat) {
+        battery_close(bat);
         g_free(bat->path);
         g_free(bat->state);
         g_free(bat);
@@ -404,5 +567,127 @@ gint battery_get_remaining( battery *b )
     return b->seconds;
 }
 
+/* incremented when a power supply is added or removed */
+static guint battery_generation = 0;
+
+#ifdef __linux__
+typedef struct {
+    GSourceFunc func;
+    gpointer user_data;
+} BatteryWatch;
+
+/* Returns TRUE if the kernel uevent is about a power supply. The message
+ * is "action@devpath" followed by KEY=value strings, all NUL terminated. */
+static gboolean uevent_is_power_supply(const char *buf, gssize len)
+{
+    const char *p = buf, *end = buf + len;
+
+    while (p < end) {
+        if (strcmp(p, "SUBSYSTEM=power_supply") == 0)
+            return TRUE;
+        p += strlen(p) + 1;
+    }
+    return FALSE;
+}
+
+static gboolean battery_uevent(GIOChannel *source, GIOCondition cond, gpointer data)
+{
+    BatteryWatch *watch = data;
+    int fd = g_io_channel_unix_get_fd(source);
+    char buf[UEVENT_BUF_SIZE];
+    struct sockaddr_nl sa;
+    socklen_t sa_len;
+    gboolean changed = FALSE;
+    gssize len;
+
+    if (cond & (G_IO_ERR | G_IO_HUP)) {
+        g_warning("batt: uevent socket failed");
+        return FALSE;
+    }
+
+    /* drain the socket so a burst of events causes one update */
+    for (;;) {
+        sa_len = sizeof(sa);
+        len = recvfrom(fd, buf, sizeof(buf) - 1, MSG_DONTWAIT,
+                       (struct sockaddr *)&sa, &sa_len);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            /* ENOBUFS means events were lost, assume something changed */
+            if (errno == ENOBUFS)
+                changed = TRUE;
+            break;
+        }
+        if (len == 0)
+            break;
+        /* accept only messages from the kernel */
+        if (sa.nl_pid != 0)
+            continue;
+        buf[len] = '\0';
+        if (uevent_is_power_supply(buf, len)) {
+            changed = TRUE;
+            if (g_str_has_prefix(buf, "add@") || g_str_has_prefix(buf, "remove@"))
+                battery_generation++;
+        }
+    }
+
+    if (changed)
+        return watch->func(watch->user_data);
+    return TRUE;
+}
+
+static void battery_watch_free(gpointer data)
+{
+    g_slice_free(BatteryWatch, data);
+}
+#endif
+
+/* Calls func each time the kernel reports a change of any power supply,
+ * which includes batteries changing state and AC adapters being plugged in
+ * or out. The watch is removed when func returns FALSE.
+ * Returns: source id to pass to g_source_remove(), or 0 if uevents are not
+ * available, the caller should poll the battery then. */
+guint battery_watch_add(GSourceFunc func, gpointer user_data)
+{
+#ifdef __linux__
+    struct sockaddr_nl sa;
+    BatteryWatch *watch;
+    GIOChannel *channel;
+    guint id;
+    int fd;
+
+    fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0)
+        return 0;
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = 1; /* kernel uevents */
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        g_warning("batt: cannot listen to uevents: %s", g_strerror(errno));
+        close(fd);
+        return 0;
+    }
+
+    watch = g_slice_new(BatteryWatch);
+    watch->func = func;
+    watch->user_data = user_data;
+    channel = g_io_channel_unix_new(fd);
+    g_io_channel_set_close_on_unref(channel, TRUE);
+    id = g_io_add_watch_full(channel, G_PRIORITY_DEFAULT, G_IO_IN | G_IO_ERR | G_IO_HUP,
+                             battery_uevent, watch, battery_watch_free);
+    g_io_channel_unref(channel);
+    return id;
+#else
+    return 0;
+#endif
+}
+
+/* Returns a counter which changes when a power supply is added or removed
+ * while a watch from battery_watch_add() is active. */
+guint battery_get_generation(void)
+{
+    return battery_generation;
+}
+
 
 /* vim: set sw=4 et sts=4 : */
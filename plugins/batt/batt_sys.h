@@ -34,10 +34,32 @@
 
 #include <glib.h>
 
+/* sysfs files read on each update */
+typedef enum {
+    BATTERY_CHARGE_NOW,
+    BATTERY_ENERGY_NOW,
+    BATTERY_CURRENT_NOW,
+    BATTERY_POWER_NOW,
+    BATTERY_VOLTAGE_NOW,
+    BATTERY_CHARGE_FULL_DESIGN,
+    BATTERY_ENERGY_FULL_DESIGN,
+    BATTERY_CHARGE_FULL,
+    BATTERY_ENERGY_FULL,
+    BATTERY_TYPE,
+    BATTERY_STATUS,
+    BATTERY_STATE,
+    BATTERY_CAPACITY,
+    BATTERY_N_FILES
+} battery_file;
+
 typedef struct battery {
     int battery_num;
     /* path to battery dir */
     gchar *path;
+    /* battery dir and its files, kept open and read with pread(), -1 if
+       the file does not exist */
+    int dir_fd;
+    int fds[BATTERY_N_FILES];
     /* sysfs file contents */
     int charge_now;
     int energy_now;
@@ -57,11 +79,16 @@ typedef struct battery {
     int type_battery;
 } battery;
 
+battery *battery_new(void);
 battery *battery_get(int);
+GList *battery_get_all(void);
 battery *battery_update( battery *b );
+void battery_aggregate(battery *total, GList *batteries);
 //void battery_print(battery *b, int show_capacity);
 gboolean battery_is_charging( battery *b );
 gint battery_get_remaining( battery *b );
 void battery_free(battery* bat);
+guint battery_watch_add(GSourceFunc func, gpointer user_data);
+guint battery_get_generation(void);
 
 #endif
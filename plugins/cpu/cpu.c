@@ -40,18 +40,34 @@
 #include <glib/gi18n.h>
 
 #include "plugin.h"
+#include "sampler.h"
 
 #define BORDER_SIZE 2
+#define COLUMN_PERIOD 1500			/* Milliseconds of history per graph column */
+#define MIN_INTERVAL 250			/* Default sampling interval while usage changes */
+#define MAX_INTERVAL 4000			/* Default sampling interval while usage is flat */
 
 /* #include "../../dbg.h" */
 
-typedef unsigned long long CPUTick;		/* Value from /proc/stat */
 typedef float CPUSample;			/* Saved CPU utilization value as 0.0..1.0 */
 
-struct cpu_stat {
-    CPUTick u, n, s, i;				/* User, nice, system, idle */
+enum {
+    CPU_GRAPH_TOTAL,				/* One graph of all CPUs */
+    CPU_GRAPH_BANDS,				/* Stacked user/system/iowait bands per core */
+    CPU_GRAPH_HEATMAP				/* Heatmap strip per core */
 };
 
+/* Per-core history as structure of arrays: each plane holds n_cores rows of
+ * width samples scaled to 0..255, all planes are in one allocation. */
+typedef struct {
+    guint n_cores;
+    guint width;
+    guint8 * user;				/* User + nice */
+    guint8 * system;				/* System + irq + softirq */
+    guint8 * iowait;				/* Iowait */
+    LXPanelCpuTimes * previous;			/* Times of each core at start of the current column */
+} CPUCoreStats;
+
 /* Private context for CPU plugin. */
 typedef struct {
 #if GTK_CHECK_VERSION(3, 0, 0)
@@ -64,18 +80,25 @@ typedef struct {
     GtkWidget * da;				/* Drawing area */
     cairo_surface_t * pixmap;				/* Pixmap to be drawn on drawing area */
 
-    guint timer;				/* Timer for periodic update */
+    guint timer;				/* Sampler subscription, 0 while not on screen */
+    LXPanelSampleRate rate;			/* Adaptive sampling interval */
+    gint64 last_time;				/* Time of the last sample */
+    gint64 column_time;				/* Microseconds sampled into the current column */
     CPUSample * stats_cpu;			/* Ring buffer of CPU utilization values */
-    unsigned int ring_cursor;			/* Cursor for ring buffer */
+    unsigned int ring_cursor;			/* Cursor for ring buffer; current column */
     guint pixmap_width;				/* Width of drawing area pixmap; also size of ring buffer; does not include border size */
     guint pixmap_height;			/* Height of drawing area pixmap; does not include border size */
-    struct cpu_stat previous_cpu_stat;		/* Previous value of cpu_stat */
+    LXPanelCpuTimes previous_cpu_stat;		/* Value of /proc/stat times at start of the current column */
+    LXPanelCpuTimes last_cpu_stat;		/* Value of /proc/stat times at the last sample */
+    CPUSample last_usage;			/* Usage between the last two samples */
     gboolean show_percentage;				/* Display usage as a percentage */
+    int graph_mode;				/* CPU_GRAPH_* */
+    CPUCoreStats cores;				/* Per-core ring buffers */
     config_setting_t *settings;
 } CPUPlugin;
 
 static void redraw_pixmap(CPUPlugin * c);
-static gboolean cpu_update(CPUPlugin * c);
+static void cpu_update(const LXPanelSample * sample, gpointer user_data);
 static gboolean configure_event(GtkWidget * widget, GdkEventConfigure * event, CPUPlugin * c);
 #if !GTK_CHECK_VERSION(3, 0, 0)
 static gboolean expose_event(GtkWidget * widget, GdkEventExpose * event, CPUPlugin * c);
@@ -85,130 +108,319 @@ static gboolean draw(GtkWidget * widget, cairo_t * cr, CPUPlugin * c);
 
 static void cpu_destructor(gpointer user_data);
 
-/* Redraw after timer callback or resize. */
-static void redraw_pixmap(CPUPlugin * c)
+static void cpu_get_rgb(CPUPlugin * c, gboolean foreground, guint8 * rgb)
 {
-#if !GTK_CHECK_VERSION(3, 0, 0)
-    GdkColor col;
-#endif
-    cairo_t * cr = cairo_create(c->pixmap);
-#if !GTK_CHECK_VERSION(3, 0, 0)
-    GtkStyle * style = gtk_widget_get_style(c->da);
-#endif
-    cairo_set_line_width (cr, 1.0);
-    /* Erase pixmap. */
-    cairo_rectangle(cr, 0, 0, c->pixmap_width, c->pixmap_height);
 #if GTK_CHECK_VERSION(3, 0, 0)
-    cairo_set_source_rgba(cr, c->background_color.blue,  c->background_color.green, c->background_color.red, c->background_color.alpha);
+    GdkRGBA * col = foreground ? &c->foreground_color : &c->background_color;
+    rgb[0] = col->red * 255;
+    rgb[1] = col->green * 255;
+    rgb[2] = col->blue * 255;
 #else
-    col.red = c->background_color.blue;
-    col.green = c->background_color.green;
-    col.blue = c->background_color.red;
-    gdk_cairo_set_source_color(cr, &col);
+    GdkColor * col = foreground ? &c->foreground_color : &c->background_color;
+    rgb[0] = col->red >> 8;
+    rgb[1] = col->green >> 8;
+    rgb[2] = col->blue >> 8;
 #endif
-    cairo_fill(cr);
+}
 
-    /* Recompute pixmap. */
-    unsigned int i;
-    unsigned int drawing_cursor = c->ring_cursor;
-#if GTK_CHECK_VERSION(3, 0, 0)
-    cairo_set_source_rgba(cr, c->foreground_color.blue,  c->foreground_color.green, c->foreground_color.red, c->foreground_color.alpha);
-#else
-    col.red = c->foreground_color.blue;
-    col.green = c->foreground_color.green;
-    col.blue = c->foreground_color.red;
-    gdk_cairo_set_source_color(cr, &col);
-#endif
-    for (i = 0; i < c->pixmap_width; i++)
+/* Pixel in cairo's native RGB24 format. */
+static inline guint32 rgb_pixel(guint r, guint g, guint b)
+{
+    return 0xff000000 | (r << 16) | (g << 8) | b;
+}
+
+#define PIXEL(data, stride, x, y) (((guint32 *)((data) + (y) * (stride)))[x])
+
+/* Draw the sample at ring buffer position pos straight into pixmap data.
+ * The pixmap keeps each sample at the column of its ring buffer position and
+ * is rotated when painted, so a new sample only touches its own column. */
+static void draw_column(CPUPlugin * c, guchar * data, int stride, guint pos)
+{
+    CPUCoreStats * cs = &c->cores;
+    guint h = c->pixmap_height;
+    guint y;
+    guint8 fg[3], bg[3];
+    guint32 fg_pixel, bg_pixel;
+
+    cpu_get_rgb(c, TRUE, fg);
+    cpu_get_rgb(c, FALSE, bg);
+    fg_pixel = rgb_pixel(fg[0], fg[1], fg[2]);
+    bg_pixel = rgb_pixel(bg[0], bg[1], bg[2]);
+
+    if (c->graph_mode == CPU_GRAPH_TOTAL || cs->n_cores == 0 || cs->width != c->pixmap_width)
     {
-        /* Draw one bar of the CPU usage graph. */
-        if (c->stats_cpu[drawing_cursor] != 0.0)
-        {
-            cairo_move_to(cr, i + 0.5, c->pixmap_height);
-            cairo_line_to(cr, i + 0.5, c->pixmap_height - c->stats_cpu[drawing_cursor] * c->pixmap_height);
-            cairo_stroke(cr);
-        }
+        guint bar = (c->graph_mode == CPU_GRAPH_TOTAL) ? c->stats_cpu[pos] * h + 0.5 : 0;
 
-        /* Increment and wrap drawing cursor. */
-        drawing_cursor += 1;
-        if (drawing_cursor >= c->pixmap_width)
-            drawing_cursor = 0;
+        for (y = 0; y < h; y++)
+            PIXEL(data, stride, pos, y) = (y + bar >= h) ? fg_pixel : bg_pixel;
+        return;
     }
 
-    /* draw a border in black */
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_set_line_width(cr, 1);
-    cairo_move_to(cr, 0, 0);
-    cairo_line_to(cr, 0, c->pixmap_height);
-    cairo_line_to(cr, c->pixmap_width, c->pixmap_height);
-    cairo_line_to(cr, c->pixmap_width, 0);
-    cairo_line_to(cr, 0, 0);
-    cairo_stroke(cr);
-
-    if (c->show_percentage)
+    /* Cores are grouped so no more rows than pixels are drawn and each row
+     * shows its busiest core, so the cost is bounded by the pixmap height
+     * however many cores there are. */
+    guint rows = MIN(cs->n_cores, h);
+    guint r;
+    guint32 sys_pixel = rgb_pixel(fg[0] * 5 / 8, fg[1] * 5 / 8, fg[2] * 5 / 8);
+    guint32 io_pixel = rgb_pixel(fg[0] * 5 / 16, fg[1] * 5 / 16, fg[2] * 5 / 16);
+
+    for (r = 0; r < rows; r++)
     {
-        int fontsize = 12;
-        if (c->pixmap_width > 50) fontsize = c->pixmap_height / 3;
-        char buffer[10];
-        int val = 100 * c->stats_cpu[c->ring_cursor ? c->ring_cursor - 1 : c->pixmap_width - 1];
-        sprintf (buffer, "%3d %%", val);
-        cairo_select_font_face (cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
-        cairo_set_font_size (cr, fontsize);
-        cairo_set_source_rgb (cr, 0, 0, 0);
-        cairo_move_to (cr, (c->pixmap_width >> 1) - ((fontsize * 5) / 3), ((c->pixmap_height + fontsize) >> 1) - 1);
-        cairo_show_text (cr, buffer);
+        guint first = r * cs->n_cores / rows, last = (r + 1) * cs->n_cores / rows;
+        guint y0 = r * h / rows, y1 = (r + 1) * h / rows;
+        guint core, best = first, busy = 0;
+
+        for (core = first; core < last; core++)
+        {
+            guint i = core * cs->width + pos;
+            guint b = cs->user[i] + cs->system[i] + cs->iowait[i];
+            if (b > busy)
+            {
+                busy = b;
+                best = core;
+            }
+        }
+        if (busy > 255)
+            busy = 255;
+
+        if (c->graph_mode == CPU_GRAPH_HEATMAP)
+        {
+            guint32 pixel = rgb_pixel(bg[0] + ((int)fg[0] - (int)bg[0]) * (int)busy / 255,
+                                      bg[1] + ((int)fg[1] - (int)bg[1]) * (int)busy / 255,
+                                      bg[2] + ((int)fg[2] - (int)bg[2]) * (int)busy / 255);
+            for (y = y0; y < y1; y++)
+                PIXEL(data, stride, pos, y) = pixel;
+        }
+        else
+        {
+            /* Stack user, system and iowait from the bottom of the row. */
+            guint i = best * cs->width + pos;
+            guint rh = y1 - y0;
+            guint hu = cs->user[i] * rh / 255;
+            guint hs = hu + cs->system[i] * rh / 255;
+            guint hi = hs + cs->iowait[i] * rh / 255;
+
+            for (y = 0; y < rh; y++)
+                PIXEL(data, stride, pos, y1 - 1 - y) =
+                    y < hu ? fg_pixel : y < hs ? sys_pixel : y < hi ? io_pixel : bg_pixel;
+        }
     }
+}
+
+/* Redraw all columns after resize or configuration change. */
+static void redraw_pixmap(CPUPlugin * c)
+{
+    guchar * data;
+    int stride;
+    guint pos;
+
+    cairo_surface_flush(c->pixmap);
+    data = cairo_image_surface_get_data(c->pixmap);
+    stride = cairo_image_surface_get_stride(c->pixmap);
+    for (pos = 0; pos < c->pixmap_width; pos++)
+        draw_column(c, data, stride, pos);
+    cairo_surface_mark_dirty(c->pixmap);
+    gtk_widget_queue_draw(c->da);
+}
+
+static void cpu_cores_free(CPUCoreStats * cs)
+{
+    g_free(cs->user);
+    g_free(cs->previous);
+    memset(cs, 0, sizeof(CPUCoreStats));
+}
 
-    /* check_cairo_status(cr); */
-    cairo_destroy(cr);
+/* (Re)allocate per-core buffers. History is dropped when the number of
+ * cores or the graph width changes. */
+static void cpu_cores_alloc(CPUCoreStats * cs, const LXPanelSample * sample, guint width)
+{
+    gsize plane = (gsize)sample->n_cpus * width;
+
+    cpu_cores_free(cs);
+    cs->n_cores = sample->n_cpus;
+    cs->width = width;
+    cs->user = g_malloc0(plane * 3);
+    cs->system = cs->user + plane;
+    cs->iowait = cs->system + plane;
+    cs->previous = g_new(LXPanelCpuTimes, sample->n_cpus);
+    memcpy(cs->previous, sample->cpus, sample->n_cpus * sizeof(LXPanelCpuTimes));
+}
 
-    /* Redraw pixmap. */
-    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data (cairo_image_surface_get_data (c->pixmap), GDK_COLORSPACE_RGB, TRUE, 8, c->pixmap_width, c->pixmap_height, c->pixmap_width *4, NULL, NULL);
-    gtk_image_set_from_pixbuf (GTK_IMAGE (c->da), pixbuf);
-    g_object_unref (pixbuf);
+static inline guint64 tick_delta(guint64 now, guint64 prev)
+{
+    /* Some counters, notably iowait, may go backwards. */
+    return now > prev ? now - prev : 0;
 }
 
-/* Periodic timer callback. */
-static gboolean cpu_update(CPUPlugin * c)
+/* Introduce usage of each core since the start of the current column into
+ * the per-core ring buffers. */
+static void cpu_update_cores(CPUPlugin * c, const LXPanelSample * sample)
 {
-    if (g_source_is_destroyed(g_main_current_source()))
-        return FALSE;
-    if ((c->stats_cpu != NULL) && (c->pixmap != NULL))
+    CPUCoreStats * cs = &c->cores;
+    guint core;
+
+    if (sample->n_cpus != cs->n_cores || c->pixmap_width != cs->width)
+    {
+        cpu_cores_alloc(cs, sample, c->pixmap_width);
+        return;
+    }
+
+    for (core = 0; core < cs->n_cores; core++)
     {
-        /* Open statistics file and scan out CPU usage. */
-        struct cpu_stat cpu;
-        char buffer[256];
-        FILE *stat = fopen ("/proc/stat", "r");
-        if (stat == NULL) return TRUE;
-        fgets (buffer, 256, stat);
-        fclose (stat);
-        if (!buffer || !strlen (buffer)) return TRUE;
-        int fscanf_result = sscanf(buffer, "cpu %llu %llu %llu %llu", &cpu.u, &cpu.n, &cpu.s, &cpu.i);
-        if (fscanf_result == 4)
+        const LXPanelCpuTimes * now = &sample->cpus[core];
+        LXPanelCpuTimes * prev = &cs->previous[core];
+        guint64 user = tick_delta(now->user, prev->user) + tick_delta(now->nice, prev->nice);
+        guint64 system = tick_delta(now->system, prev->system) + tick_delta(now->irq, prev->irq)
+                       + tick_delta(now->softirq, prev->softirq);
+        guint64 iowait = tick_delta(now->iowait, prev->iowait);
+        guint64 total = user + system + iowait + tick_delta(now->idle, prev->idle)
+                      + tick_delta(now->steal, prev->steal);
+        guint i = core * cs->width + c->ring_cursor;
+
+        if (total > 0)
         {
-            /* Compute delta from previous statistics. */
-            struct cpu_stat cpu_delta;
-            cpu_delta.u = cpu.u - c->previous_cpu_stat.u;
-            cpu_delta.n = cpu.n - c->previous_cpu_stat.n;
-            cpu_delta.s = cpu.s - c->previous_cpu_stat.s;
-            cpu_delta.i = cpu.i - c->previous_cpu_stat.i;
-
-            /* Copy current to previous. */
-            memcpy(&c->previous_cpu_stat, &cpu, sizeof(struct cpu_stat));
-
-            /* Compute user+nice+system as a fraction of total.
-             * Introduce this sample to ring buffer, increment and wrap ring buffer cursor. */
-            float cpu_uns = cpu_delta.u + cpu_delta.n + cpu_delta.s;
-            c->stats_cpu[c->ring_cursor] = cpu_uns / (cpu_uns + cpu_delta.i);
-            c->ring_cursor += 1;
-            if (c->ring_cursor >= c->pixmap_width)
-                c->ring_cursor = 0;
-
-            /* Redraw with the new sample. */
-            redraw_pixmap(c);
+            cs->user[i] = user * 255 / total;
+            cs->system[i] = system * 255 / total;
+            cs->iowait[i] = iowait * 255 / total;
         }
+        else
+            cs->user[i] = cs->system[i] = cs->iowait[i] = 0;
+    }
+}
+
+/* Copy per-core usage at ring buffer position from to position to. */
+static void cpu_cores_copy(CPUCoreStats * cs, guint from, guint to)
+{
+    guint i;
+
+    for (i = 0; i < cs->n_cores * cs->width; i += cs->width)
+    {
+        cs->user[i + to] = cs->user[i + from];
+        cs->system[i + to] = cs->system[i + from];
+        cs->iowait[i + to] = cs->iowait[i + from];
+    }
+}
+
+/* Busy fraction of total time between two /proc/stat times. */
+static CPUSample cpu_usage(const LXPanelCpuTimes * now, const LXPanelCpuTimes * prev)
+{
+    float cpu_uns = tick_delta(now->user, prev->user) + tick_delta(now->nice, prev->nice)
+                  + tick_delta(now->system, prev->system);
+    float cpu_idle = tick_delta(now->idle, prev->idle);
+
+    return (cpu_uns + cpu_idle > 0) ? cpu_uns / (cpu_uns + cpu_idle) : 0;
+}
+
+/* Draw count columns starting at ring buffer position pos. */
+static void cpu_draw_columns(CPUPlugin * c, guint pos, guint count)
+{
+    guchar * data;
+    int stride;
+
+    if (count >= c->pixmap_width)
+    {
+        redraw_pixmap(c);
+        return;
+    }
+    cairo_surface_flush(c->pixmap);
+    data = cairo_image_surface_get_data(c->pixmap);
+    stride = cairo_image_surface_get_stride(c->pixmap);
+    while (count-- > 0)
+    {
+        draw_column(c, data, stride, pos);
+        cairo_surface_mark_dirty_rectangle(c->pixmap, pos, 0, 1, c->pixmap_height);
+        if (++pos >= c->pixmap_width)
+            pos = 0;
+    }
+    gtk_widget_queue_draw(c->da);
+}
+
+/* Periodic sampler callback.
+ * Each column covers COLUMN_PERIOD of time however often it is sampled:
+ * samples taken faster update the current column with the usage since its
+ * start, and a sample taken after a longer interval completes as many
+ * columns as the interval covers. */
+static void cpu_update(const LXPanelSample * sample, gpointer user_data)
+{
+    CPUPlugin * c = user_data;
+    const gint64 period = (gint64)COLUMN_PERIOD * 1000;
+    CPUSample usage;
+    guint start, columns, i;
+
+    if ((c->stats_cpu == NULL) || (c->pixmap == NULL)
+        || !(sample->sources & LXPANEL_SAMPLE_STAT))
+        return;
+
+    if (c->last_time == 0)
+    {
+        /* First sample only starts the current column. */
+        c->previous_cpu_stat = c->last_cpu_stat = sample->cpu;
+        c->last_time = sample->time;
+        if (c->graph_mode != CPU_GRAPH_TOTAL)
+            cpu_cores_alloc(&c->cores, sample, c->pixmap_width);
+        return;
+    }
+    c->column_time += sample->time - c->last_time;
+    c->last_time = sample->time;
+
+    /* Sample faster while usage changes and back off while it is flat. */
+    usage = cpu_usage(&sample->cpu, &c->last_cpu_stat);
+    c->last_cpu_stat = sample->cpu;
+    if (lxpanel_sample_rate_adapt(&c->rate, ABS(usage - c->last_usage)))
+        lxpanel_sampler_set_interval(c->timer, c->rate.interval);
+    c->last_usage = usage;
+
+    /* Compute user+nice+system as a fraction of total since the start of
+     * the column and introduce it to ring buffer. */
+    c->stats_cpu[c->ring_cursor] = cpu_usage(&sample->cpu, &c->previous_cpu_stat);
+    if (c->graph_mode != CPU_GRAPH_TOTAL)
+        cpu_update_cores(c, sample);
+
+    /* Complete the columns covered, the new current column starts with the
+     * usage of the last one until it is sampled. */
+    start = c->ring_cursor;
+    columns = c->column_time / period;
+    c->column_time %= period;
+    if (columns > c->pixmap_width)
+        columns = c->pixmap_width;
+    if (columns > 0)
+    {
+        c->previous_cpu_stat = sample->cpu;
+        if (c->cores.n_cores == sample->n_cpus)
+            memcpy(c->cores.previous, sample->cpus, sample->n_cpus * sizeof(LXPanelCpuTimes));
+    }
+    for (i = 0; i < columns; i++)
+    {
+        guint next = (c->ring_cursor + 1 < c->pixmap_width) ? c->ring_cursor + 1 : 0;
+
+        c->stats_cpu[next] = c->stats_cpu[c->ring_cursor];
+        if (c->cores.n_cores > 0 && c->cores.width == c->pixmap_width)
+            cpu_cores_copy(&c->cores, c->ring_cursor, next);
+        c->ring_cursor = next;
+    }
+
+    /* Draw only the columns that changed. */
+    cpu_draw_columns(c, start, columns + 1);
+}
+
+/* Sample only while the graph is on screen. The drawing area is unmapped
+ * while the panel is autohidden or the plugin is hidden. */
+static void cpu_map(GtkWidget * widget, CPUPlugin * c)
+{
+    if (c->timer == 0)
+    {
+        c->rate.interval = c->rate.min_interval;
+        c->timer = lxpanel_sampler_add(LXPANEL_SAMPLE_STAT, c->rate.interval, cpu_update, c);
+    }
+}
+
+static void cpu_unmap(GtkWidget * widget, CPUPlugin * c)
+{
+    if (c->timer != 0)
+    {
+        lxpanel_sampler_remove(c->timer);
+        c->timer = 0;
     }
-    return TRUE;
 }
 
 /* Handler for configure_event on drawing area. */
@@ -228,31 +440,34 @@ static void cpu_configuration_changed (LXPanel *panel, GtkWidget *p)
             CPUSample * new_stats_cpu = g_new0(typeof(*c->stats_cpu), new_pixmap_width);
             if (c->stats_cpu != NULL)
             {
+                /* Number of newest samples, up to and including the cursor. */
+                guint head = c->ring_cursor + 1;
+
                 if (new_pixmap_width > c->pixmap_width)
                 {
                     /* New allocation is larger.
                      * Introduce new "oldest" samples of zero following the cursor. */
                     memcpy(&new_stats_cpu[0],
-                        &c->stats_cpu[0], c->ring_cursor * sizeof(CPUSample));
-                    memcpy(&new_stats_cpu[new_pixmap_width - c->pixmap_width + c->ring_cursor],
-                        &c->stats_cpu[c->ring_cursor], (c->pixmap_width - c->ring_cursor) * sizeof(CPUSample));
+                        &c->stats_cpu[0], head * sizeof(CPUSample));
+                    memcpy(&new_stats_cpu[new_pixmap_width - c->pixmap_width + head],
+                        &c->stats_cpu[head], (c->pixmap_width - head) * sizeof(CPUSample));
                 }
-                else if (c->ring_cursor <= new_pixmap_width)
+                else if (head <= new_pixmap_width)
                 {
                     /* New allocation is smaller, but still larger than the ring buffer cursor.
                      * Discard the oldest samples following the cursor. */
                     memcpy(&new_stats_cpu[0],
-                        &c->stats_cpu[0], c->ring_cursor * sizeof(CPUSample));
-                    memcpy(&new_stats_cpu[c->ring_cursor],
-                        &c->stats_cpu[c->pixmap_width - new_pixmap_width + c->ring_cursor], (new_pixmap_width - c->ring_cursor) * sizeof(CPUSample));
+                        &c->stats_cpu[0], head * sizeof(CPUSample));
+                    memcpy(&new_stats_cpu[head],
+                        &c->stats_cpu[c->pixmap_width - new_pixmap_width + head], (new_pixmap_width - head) * sizeof(CPUSample));
                 }
                 else
                 {
                     /* New allocation is smaller, and also smaller than the ring buffer cursor.
                      * Discard all oldest samples following the ring buffer cursor and additional samples at the beginning of the buffer. */
                     memcpy(&new_stats_cpu[0],
-                        &c->stats_cpu[c->ring_cursor - new_pixmap_width], new_pixmap_width * sizeof(CPUSample));
-                    c->ring_cursor = 0;
+                        &c->stats_cpu[head - new_pixmap_width], new_pixmap_width * sizeof(CPUSample));
+                    c->ring_cursor = new_pixmap_width - 1;
                 }
                 g_free(c->stats_cpu);
             }
@@ -266,6 +481,7 @@ static void cpu_configuration_changed (LXPanel *panel, GtkWidget *p)
             cairo_surface_destroy(c->pixmap);
         c->pixmap = cairo_image_surface_create(CAIRO_FORMAT_RGB24, c->pixmap_width, c->pixmap_height);
         /* check_cairo_surface_status(&c->pixmap); */
+        gtk_widget_set_size_request(c->da, c->pixmap_width, c->pixmap_height);
 
         /* Redraw pixmap at the new size. */
         redraw_pixmap(c);
@@ -279,22 +495,58 @@ static gboolean expose_event(GtkWidget * widget, GdkEventExpose * event, CPUPlug
 static gboolean draw(GtkWidget * widget, cairo_t * cr, CPUPlugin * c)
 #endif
 {
-    /* Draw the requested part of the pixmap onto the drawing area.
-     * Translate it in both x and y by the border size. */
+    /* Paint the pixmap rotated by the ring buffer cursor so the current
+     * column is on the right, centered in the drawing area. */
     if (c->pixmap != NULL)
     {
+        GtkAllocation allocation;
+        int x, y, split;
+        guint oldest = (c->ring_cursor + 1 < c->pixmap_width) ? c->ring_cursor + 1 : 0;
+
 #if !GTK_CHECK_VERSION(3, 0, 0)
         cairo_t * cr = gdk_cairo_create(gtk_widget_get_window(widget));
-        GtkStyle * style = gtk_widget_get_style(c->da);
         gdk_cairo_region(cr, event->region);
         cairo_clip(cr);
-        gdk_cairo_set_source_color(cr, &c->foreground_color);
-#else
-        cairo_set_source_rgb(cr, 0, 0, 0); // FIXME: use black color from style
 #endif
-        cairo_set_source_surface(cr, c->pixmap,
-              BORDER_SIZE, BORDER_SIZE);
-        cairo_paint(cr);
+        gtk_widget_get_allocation(widget, &allocation);
+        x = (allocation.width - (int)c->pixmap_width) / 2;
+        y = (allocation.height - (int)c->pixmap_height) / 2;
+        split = c->pixmap_width - oldest;
+
+        cairo_set_source_surface(cr, c->pixmap, x - (int)oldest, y);
+        cairo_rectangle(cr, x, y, split, c->pixmap_height);
+        cairo_fill(cr);
+        if (oldest > 0)
+        {
+            cairo_set_source_surface(cr, c->pixmap, x + split, y);
+            cairo_rectangle(cr, x + split, y, oldest, c->pixmap_height);
+            cairo_fill(cr);
+        }
+
+        /* draw a border in black */
+        cairo_translate(cr, x, y);
+        cairo_set_source_rgb(cr, 0, 0, 0);
+        cairo_set_line_width(cr, 1);
+        cairo_move_to(cr, 0, 0);
+        cairo_line_to(cr, 0, c->pixmap_height);
+        cairo_line_to(cr, c->pixmap_width, c->pixmap_height);
+        cairo_line_to(cr, c->pixmap_width, 0);
+        cairo_line_to(cr, 0, 0);
+        cairo_stroke(cr);
+
+        if (c->show_percentage)
+        {
+            int fontsize = 12;
+            if (c->pixmap_width > 50) fontsize = c->pixmap_height / 3;
+            char buffer[10];
+            int val = 100 * c->stats_cpu[c->ring_cursor];
+            sprintf (buffer, "%3d %%", val);
+            cairo_select_font_face (cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+            cairo_set_font_size (cr, fontsize);
+            cairo_set_source_rgb (cr, 0, 0, 0);
+            cairo_move_to (cr, (c->pixmap_width >> 1) - ((fontsize * 5) / 3), ((c->pixmap_height + fontsize) >> 1) - 1);
+            cairo_show_text (cr, buffer);
+        }
         /* check_cairo_status(cr); */
 #if !GTK_CHECK_VERSION(3, 0, 0)
         cairo_destroy(cr);
@@ -315,6 +567,17 @@ static GtkWidget *cpu_constructor(LXPanel *panel, config_setting_t *settings)
 	c->settings = settings;
     if (config_setting_lookup_int(settings, "ShowPercent", &tmp_int))
         c->show_percentage = tmp_int != 0;
+    if (config_setting_lookup_int(settings, "GraphMode", &tmp_int)
+        && tmp_int >= CPU_GRAPH_TOTAL && tmp_int <= CPU_GRAPH_HEATMAP)
+        c->graph_mode = tmp_int;
+    c->rate.min_interval = MIN_INTERVAL;
+    c->rate.max_interval = MAX_INTERVAL;
+    if (config_setting_lookup_int(settings, "MinInterval", &tmp_int) && tmp_int >= 100)
+        c->rate.min_interval = tmp_int;
+    if (config_setting_lookup_int(settings, "MaxInterval", &tmp_int) && tmp_int >= 100)
+        c->rate.max_interval = tmp_int;
+    if (c->rate.max_interval < c->rate.min_interval)
+        c->rate.max_interval = c->rate.min_interval;
 
 #if GTK_CHECK_VERSION(3, 0, 0)
     if (config_setting_lookup_string(settings, "Foreground", &str))
@@ -348,7 +611,7 @@ static GtkWidget *cpu_constructor(LXPanel *panel, config_setting_t *settings)
     lxpanel_plugin_set_data(p, c, cpu_destructor);
 
     /* Allocate drawing area as a child of top level widget. */
-    c->da = gtk_image_new();
+    c->da = gtk_drawing_area_new();
     gtk_widget_add_events(c->da, GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK |
                                  GDK_BUTTON_MOTION_MASK);
     gtk_container_add(GTK_CONTAINER(p), c->da);
@@ -359,11 +622,13 @@ static GtkWidget *cpu_constructor(LXPanel *panel, config_setting_t *settings)
 #else
     g_signal_connect(G_OBJECT(c->da), "draw", G_CALLBACK(draw), (gpointer) c);
 #endif
+    /* Subscribe to the sampler to refresh the statistics while mapped. */
+    g_signal_connect(G_OBJECT(c->da), "map", G_CALLBACK(cpu_map), (gpointer) c);
+    g_signal_connect(G_OBJECT(c->da), "unmap", G_CALLBACK(cpu_unmap), (gpointer) c);
 
-    /* Show the widget.  Connect a timer to refresh the statistics. */
+    /* Show the widget. */
     gtk_widget_show(c->da);
     cpu_configuration_changed (panel,p);
-    c->timer = g_timeout_add(1500, (GSourceFunc) cpu_update, (gpointer) c);
     return p;
 }
 
@@ -372,12 +637,14 @@ static void cpu_destructor(gpointer user_data)
 {
     CPUPlugin * c = (CPUPlugin *)user_data;
 
-    /* Disconnect the timer. */
-    g_source_remove(c->timer);
+    /* Disconnect the sampler. */
+    if (c->timer != 0)
+        lxpanel_sampler_remove(c->timer);
 
     /* Deallocate memory. */
     cairo_surface_destroy(c->pixmap);
     g_free(c->stats_cpu);
+    cpu_cores_free(&c->cores);
     g_free(c);
 }
 
@@ -387,6 +654,12 @@ static gboolean cpu_apply_configuration (gpointer user_data)
     GtkWidget * p = user_data;
     CPUPlugin * c = lxpanel_plugin_get_data(p);
     config_group_set_int (c->settings, "ShowPercent", c->show_percentage);
+    config_group_set_int (c->settings, "GraphMode", c->graph_mode);
+    /* Drop per-core history so it restarts from fresh times when reenabled. */
+    if (c->graph_mode == CPU_GRAPH_TOTAL)
+        cpu_cores_free(&c->cores);
+    if (c->pixmap != NULL)
+        redraw_pixmap(c);
 #if GTK_CHECK_VERSION(3, 0, 0)
     sprintf (colbuf, "%s", gdk_rgba_to_string (&c->foreground_color));
 #else
@@ -408,6 +681,9 @@ static GtkWidget *cpu_configure(LXPanel *panel, GtkWidget *p)
     return lxpanel_generic_config_dlg(_("CPU Usage"), panel,
         cpu_apply_configuration, p,
         _("Show usage as percentage"), &dc->show_percentage, CONF_TYPE_BOOL,
+        _("Total usage"), &dc->graph_mode, CONF_TYPE_RBUTTON,
+        _("Usage per core"), &dc->graph_mode, CONF_TYPE_RBUTTON,
+        _("Heatmap per core"), &dc->graph_mode, CONF_TYPE_RBUTTON,
         _("Foreground colour"), &dc->foreground_color, CONF_TYPE_COLOR,
         _("Background colour"), &dc->background_color, CONF_TYPE_COLOR,
         NULL);
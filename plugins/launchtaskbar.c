@@ -128,6 +128,11 @@ struct LaunchTaskBarPlugin {
     int spacing;                   /* Spacing between taskbar buttons */
     guint flash_timeout;        /* Timer for urgency notification */
     gboolean flash_state;       /* One-bit counter to flash taskbar */
+    GHashTable *task_windows;   /* Window -> TaskButton, maintained by buttons */
+    GHashTable *task_classes;   /* res_class -> TaskButton, maintained by buttons */
+    GHashTable *task_desktops;  /* desktop -> set of TaskButton, maintained by buttons */
+    Window *clients;            /* Last seen NET_CLIENT_LIST, sorted */
+    int n_clients;              /* Number of windows in clients */
     /* COMMON */
 #ifndef DISABLE_MENU
     FmPath * path;              /* Current menu item path */
@@ -135,6 +140,12 @@ struct LaunchTaskBarPlugin {
     GtkWidget       *p_menuitem_unlock_tbp;
     GtkWidget       *p_menuitem_new_instance;
     GtkWidget       *p_menuitem_separator;
+    MenuCache       *mc;                /* Menu cache to match tasks with launchers */
+    gpointer         mc_reload_notify;
+    GSList          *mc_apps;           /* All applications of mc, referenced */
+    GHashTable      *apps_by_id;        /* Desktop id up to any dot -> MenuCacheItem */
+    GHashTable      *apps_by_exec;      /* First word of Exec -> MenuCacheItem */
+    GHashTable      *pid_execs;         /* PID -> executable name from task_get_cmdline() */
 #endif
     GtkWidget * plugin;                 /* Back pointer to Plugin */
     LXPanel * panel;                    /* Back pointer to panel */
@@ -196,6 +207,19 @@ static char *task_get_cmdline(Window win, LaunchTaskBarPlugin *ltbp)
     gchar *cmdline = NULL;
     gchar *p_char = NULL;
 
+    if (pid <= 0)
+        return NULL;
+    /* The executable is read only once per process, see
+       taskbar_net_client_list() for removal of dead processes. If process
+       calls exec() after it has mapped its windows then the name of the
+       old executable is used until the process dies. This is accepted,
+       since exec() is rarely done by GUI applications after mapping. */
+    if (ltbp->pid_execs == NULL)
+        ltbp->pid_execs = g_hash_table_new_full(g_direct_hash, NULL, NULL, g_free);
+    p_char = g_hash_table_lookup(ltbp->pid_execs, GINT_TO_POINTER(pid));
+    if (p_char != NULL)
+        return g_strdup(p_char);
+
     snprintf(proc_path, sizeof(proc_path),
              G_DIR_SEPARATOR_S "proc" G_DIR_SEPARATOR_S "%lu" G_DIR_SEPARATOR_S "cmdline",
              (gulong)pid);
@@ -232,71 +256,124 @@ static char *task_get_cmdline(Window win, LaunchTaskBarPlugin *ltbp)
             }
         }
     }
+    if (cmdline)
+        g_hash_table_insert(ltbp->pid_execs, GINT_TO_POINTER(pid), g_strdup(cmdline));
     return cmdline;
 }
 
+/* Callback for g_hash_table_foreach_remove() to forget dead processes. */
+static gboolean task_pid_is_gone(gpointer key, gpointer value, gpointer user_data)
+{
+    return (kill(GPOINTER_TO_INT(key), 0) < 0 && errno == ESRCH);
+}
+
+/* Forget the applications index, it will be rebuilt on next lookup. */
+static void launchtaskbar_apps_index_reset(MenuCache *mc, gpointer user_data)
+{
+    LaunchTaskBarPlugin *ltbp = user_data;
+
+    if (ltbp->apps_by_id)
+    {
+        g_hash_table_unref(ltbp->apps_by_id);
+        g_hash_table_unref(ltbp->apps_by_exec);
+        ltbp->apps_by_id = ltbp->apps_by_exec = NULL;
+    }
+    g_slist_foreach(ltbp->mc_apps, (GFunc)menu_cache_item_unref, NULL);
+    g_slist_free(ltbp->mc_apps);
+    ltbp->mc_apps = NULL;
+}
+
+/* inserts only the first item for the key, as a linear search would find */
+static void apps_index_insert(GHashTable *index, char *key, MenuCacheItem *item)
+{
+    if (g_hash_table_lookup(index, key) == NULL)
+        g_hash_table_insert(index, key, item);
+    else
+        g_free(key);
+}
+
+/* Builds indexes of applications by desktop id and by executable. Returns
+   FALSE if the menu cache isn't loaded yet. */
+static gboolean launchtaskbar_apps_index_build(LaunchTaskBarPlugin *ltbp)
+{
+    GSList *l;
+
+    if (ltbp->apps_by_id)
+        return TRUE;
+    if (ltbp->mc == NULL)
+    {
+        ltbp->mc = panel_menu_cache_new(NULL);
+        if (ltbp->mc == NULL)
+            return FALSE;
+        ltbp->mc_reload_notify = menu_cache_add_reload_notify(ltbp->mc,
+                                                              launchtaskbar_apps_index_reset,
+                                                              ltbp);
+    }
+    /* if menu cache wasn't loaded yet we'll get NULL list here, the index
+       will be built after reload */
+    ltbp->mc_apps = menu_cache_list_all_apps(ltbp->mc);
+    if (ltbp->mc_apps == NULL)
+        return FALSE;
+    ltbp->apps_by_id = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    ltbp->apps_by_exec = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (l = ltbp->mc_apps; l; l = l->next)
+    {
+        MenuCacheItem *item = MENU_CACHE_ITEM(l->data);
+        const char *id = menu_cache_item_get_id(item);
+        const char *exec = menu_cache_app_get_exec(MENU_CACHE_APP(item));
+        const char *end;
+
+        /* an executable matches any id it precedes a dot in */
+        for (end = strchr(id, '.'); end; end = strchr(end + 1, '.'))
+            apps_index_insert(ltbp->apps_by_id, g_strndup(id, end - id), item);
+        if (exec && exec[0])
+        {
+            end = strchr(exec, ' ');
+            apps_index_insert(ltbp->apps_by_exec,
+                              end ? g_strndup(exec, end - exec) : g_strdup(exec),
+                              item);
+        }
+    }
+    return TRUE;
+}
+
 static FmPath *f_find_menu_launchbutton_recursive(Window win, LaunchTaskBarPlugin *ltbp)
 {
-    MenuCache *mc;
-    guint32 flags;
-    GSList *apps, *l;
-    size_t len;
-    char *exec_bin = task_get_cmdline(win, ltbp);
-    const char *exec, *short_exec;
+    MenuCacheItem *item = NULL;
+    char *exec_bin;
+    const char *short_exec;
     char *str_path;
     FmPath *path = NULL;
 
-    /* FIXME: cache it in Task object */
-    mc = panel_menu_cache_new(&flags);
-    /* FIXME: if menu plugin wasn't loaded yet we'll get NULL list here */
-    apps = menu_cache_list_all_apps(mc);
+    if (!launchtaskbar_apps_index_build(ltbp))
+        return NULL;
+    exec_bin = task_get_cmdline(win, ltbp);
+    if (exec_bin == NULL)
+        return NULL;
     short_exec = strrchr(exec_bin, '/');
     if (short_exec != NULL)
         short_exec++;
     else
         short_exec = exec_bin;
-    len = strlen(short_exec);
     /* the same executable may be used in numerous applications so wild guess
-       estimation check for desktop id equal to short_exec+".desktop" first */
-    for (l = apps; l; l = l->next)
-    {
-        exec = menu_cache_item_get_id(MENU_CACHE_ITEM(l->data));
-        /* we don't check flags here because user always can manually
-           start any app that isn't visible in the desktop menu */
-        if (strncmp(exec, short_exec, len) == 0 && exec[len] == '.')
-            break;
-    }
+       estimation check for desktop id equal to short_exec+".desktop" first;
+       we don't check flags here because user always can manually start any
+       app that isn't visible in the desktop menu */
+    item = g_hash_table_lookup(ltbp->apps_by_id, short_exec);
     /* if not found then check for non-absolute exec name in application
        since it usually is expanded by application starting functions */
-    if (l == NULL) for (l = apps; l; l = l->next)
-    {
-        exec = menu_cache_app_get_exec(MENU_CACHE_APP(l->data));
-        if (exec && exec[0] != '/' && strncmp(exec, short_exec, len) == 0 &&
-            (exec[len] == ' ' || exec[len] == 0))
-            break;
-    }
+    if (item == NULL)
+        item = g_hash_table_lookup(ltbp->apps_by_exec, short_exec);
     /* well, not matched, let try full path, we assume here if application
        starts executable by full path then process cannot have short name */
-    if (l == NULL && exec_bin[0] == '/')
+    if (item == NULL && exec_bin[0] == '/')
+        item = g_hash_table_lookup(ltbp->apps_by_exec, exec_bin);
+    if (item)
     {
-        len = strlen(exec_bin);
-        for (l = apps; l; l = l->next)
-        {
-            exec = menu_cache_app_get_exec(MENU_CACHE_APP(l->data));
-            if (exec && exec[0] == '/' && strncmp(exec, exec_bin, len) == 0 &&
-                (exec[len] == ' ' || exec[len] == 0))
-                break;
-        }
-    }
-    if (l)
-    {
-        str_path = menu_cache_dir_make_path(MENU_CACHE_DIR(l->data));
+        str_path = menu_cache_dir_make_path(MENU_CACHE_DIR(item));
         path = fm_path_new_relative(fm_path_get_apps_menu(), str_path+13); /* skip /Applications */
         g_free(str_path);
     }
-    g_slist_foreach(apps, (GFunc)menu_cache_item_unref, NULL);
-    g_slist_free(apps);
-    menu_cache_unref(mc);
     g_debug("f_find_menu_launchbutton_recursive: search '%s' found=%d", exec_bin, (path != NULL));
     g_free(exec_bin);
     return path;
@@ -1032,6 +1109,9 @@ static void launchtaskbar_constructor_task(LaunchTaskBarPlugin *ltbp)
             ltbp->grouped_tasks = (tmp_int != 0);
         if (config_setting_lookup_int(s, "UseSmallerIcons", &tmp_int))
             ltbp->flags.use_smaller_icons = (tmp_int != 0);
+        /* the icon cache is process-wide, the last taskbar sets the limit */
+        if (config_setting_lookup_int(s, "IconCacheKB", &tmp_int) && tmp_int >= 0)
+            task_button_set_icon_cache_limit((gsize)tmp_int * 1024);
 
         /* Make container for task buttons as a child of top level widget. */
         ltbp->tb_icon_grid = panel_icon_grid_new(panel_get_orientation(ltbp->panel),
@@ -1046,9 +1126,15 @@ static void launchtaskbar_constructor_task(LaunchTaskBarPlugin *ltbp)
         /* Add GDK event filter. */
         gdk_window_add_filter(NULL, (GdkFilterFunc) taskbar_event_filter, ltbp);
 
+        /* Create index of task buttons. */
+        ltbp->task_windows = g_hash_table_new(g_direct_hash, NULL);
+        ltbp->task_classes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        ltbp->task_desktops = g_hash_table_new_full(g_direct_hash, NULL, NULL,
+                                                    (GDestroyNotify)g_hash_table_unref);
+
         /* Connect signals to receive root window events and initialize root window properties. */
-        ltbp->number_of_desktops = get_net_number_of_desktops();
-        ltbp->current_desktop = get_net_current_desktop();
+        ltbp->number_of_desktops = fb_ev_number_of_desktops(fbev);
+        ltbp->current_desktop = fb_ev_current_desktop(fbev);
         g_signal_connect(G_OBJECT(fbev), "current-desktop", G_CALLBACK(taskbar_net_current_desktop), (gpointer) ltbp);
         g_signal_connect(G_OBJECT(fbev), "active-window", G_CALLBACK(taskbar_net_active_window), (gpointer) ltbp);
         g_signal_connect(G_OBJECT(fbev), "number-of-desktops", G_CALLBACK(taskbar_net_number_of_desktops), (gpointer) ltbp);
@@ -1224,6 +1310,12 @@ static void launchtaskbar_destructor_task(LaunchTaskBarPlugin *ltbp)
     }
     if (ltbp->dnd_delay_task)
         g_object_remove_weak_pointer(G_OBJECT(ltbp->dnd_delay_task), (gpointer *)&ltbp->dnd_delay_task);
+
+    /* Task buttons may outlive us, they hold own references on the index. */
+    g_hash_table_unref(ltbp->task_windows);
+    g_hash_table_unref(ltbp->task_classes);
+    g_hash_table_unref(ltbp->task_desktops);
+    g_free(ltbp->clients);
 }
 
 /* Plugin destructor. */
@@ -1238,6 +1330,16 @@ static void launchtaskbar_destructor(gpointer user_data)
     if(ltbp->lb_built) launchtaskbar_destructor_launch(ltbp);
 
     // LAUNCHTASKBAR
+#ifndef DISABLE_MENU
+    if (ltbp->mc)
+    {
+        menu_cache_remove_reload_notify(ltbp->mc, ltbp->mc_reload_notify);
+        launchtaskbar_apps_index_reset(ltbp->mc, ltbp);
+        menu_cache_unref(ltbp->mc);
+    }
+    if (ltbp->pid_execs)
+        g_hash_table_unref(ltbp->pid_execs);
+#endif
 
     /* Deallocate all memory. */
     if (ltbp->p_key_file_special_cases != NULL)
@@ -1929,6 +2031,28 @@ static gboolean launchtaskbar_control(GtkWidget *p, const char *cmd)
                 return TRUE;
             }
         }
+        /* "icc<KB>" sets the icon cache limit */
+        else if (strncmp(cmd, "icc", 3) == 0)
+        {
+            int val;
+            if (sscanf (cmd, "icc%d", &val) == 1 && val >= 0)
+            {
+                task_button_set_icon_cache_limit((gsize)val * 1024);
+                return TRUE;
+            }
+        }
+        /* "iconstats" reports the icon cache usage; lxpanelctl gets no
+           reply so it goes to the panel log only */
+        else if (strcmp(cmd, "iconstats") == 0)
+        {
+            guint hits, misses, entries;
+            gsize bytes;
+
+            task_button_get_icon_cache_stats(&hits, &misses, &entries, &bytes);
+            g_message("taskbar icon cache: %u hits, %u misses, %u icons, %" G_GSIZE_FORMAT " bytes",
+                      hits, misses, entries, bytes);
+            return TRUE;
+        }
     }
     return FALSE;
 }
@@ -1944,11 +2068,32 @@ static void taskbar_redraw(LaunchTaskBarPlugin * tb)
     if (tb->flags.use_smaller_icons)
         icon_size -= 4;
     for (l = children; l; l = l->next)
-        task_button_update(l->data, tb->current_desktop, tb->number_of_desktops,
+        task_button_update(l->data, tb->number_of_desktops,
                            mon, icon_size, tb->flags);
     g_list_free(children);
 }
 
+/* Redraw tasks which have windows on the desktop, returns how many. */
+static guint taskbar_redraw_desktop(LaunchTaskBarPlugin * tb, gint desktop)
+{
+    GHashTable *bucket = g_hash_table_lookup(tb->task_desktops, GINT_TO_POINTER(desktop));
+    GList *buttons, *l;
+    guint mon, icon_size, n = 0;
+
+    if (bucket == NULL)
+        return 0;
+    mon = panel_get_monitor(tb->panel);
+    icon_size = panel_get_icon_size(tb->panel);
+    if (tb->flags.use_smaller_icons)
+        icon_size -= 4;
+    buttons = g_hash_table_get_keys(bucket);
+    for (l = buttons; l; l = l->next, n++)
+        task_button_update(l->data, tb->number_of_desktops,
+                           mon, icon_size, tb->flags);
+    g_list_free(buttons);
+    return n;
+}
+
 /* Determine if a task should be visible given its NET_WM_STATE. */
 static gboolean accept_net_wm_state(NetWMState * nws)
 {
@@ -1964,45 +2109,32 @@ static gboolean accept_net_wm_window_type(NetWMWindowType * nwwt)
 /* Set the class associated with a task. */
 static char *task_get_class(Window win)
 {
-    /* Read the WM_CLASS property. */
-    XClassHint ch;
-    ch.res_name = NULL;
-    ch.res_class = NULL;
+    /* Read the WM_CLASS property, the same way as XGetClassHint() does but
+     * via get_xaproperty() so it can be prefetched. It contains res_name
+     * and res_class separated by zero. */
+    int len, len_name;
+    char *ch = get_xaproperty(win, XA_WM_CLASS, XA_STRING, &len);
     char *res_class = NULL;
-    XGetClassHint(GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), win, &ch);
 
-    /* If the res_name was returned, free it.  We make no use of it at this time. */
-    if (ch.res_name != NULL)
-    {
-        XFree(ch.res_name);
-    }
+    if (ch == NULL)
+        return NULL;
+    /* We make no use of res_name at this time. */
+    len_name = strlen(ch);
+    if (len_name == len)
+        len_name--;
 
-    /* If the res_class was returned, process it.
+    /* Process the res_class.
      * This identifies the application that created the window and is the basis for taskbar grouping. */
-    if (ch.res_class != NULL)
-    {
-        /* Convert the class to UTF-8 and enter it in the class table. */
-        res_class = g_locale_to_utf8(ch.res_class, -1, NULL, NULL, NULL);
-        XFree(ch.res_class);
-    }
+    /* Convert the class to UTF-8 and enter it in the class table. */
+    res_class = g_locale_to_utf8(ch + len_name + 1, -1, NULL, NULL, NULL);
+    XFree(ch);
     return res_class;
 }
 
 /* Look up a task in the task list. */
-static TaskButton *task_lookup(LaunchTaskBarPlugin * tb, Window win)
+static inline TaskButton *task_lookup(LaunchTaskBarPlugin * tb, Window win)
 {
-    TaskButton *task = NULL;
-    GList *children = gtk_container_get_children(GTK_CONTAINER(tb->tb_icon_grid));
-    GList *l;
-
-    for (l = children; l; l = l->next)
-        if (task_button_has_window(l->data, win))
-        {
-            task = l->data;
-            break;
-        }
-    g_list_free(children);
-    return task;
+    return g_hash_table_lookup(tb->task_windows, GUINT_TO_POINTER(win));
 }
 
 
@@ -2212,23 +2344,53 @@ static void taskbar_add_task_button(LaunchTaskBarPlugin * tb, TaskButton * task)
                            G_CALLBACK(taskbar_button_enter), tb);
 }
 
-/* add win to tb, using list of task buttons */
-static void taskbar_add_new_window(LaunchTaskBarPlugin * tb, Window win, GList *list)
+/* add win to tb, grouping it with existing button of the same class */
+static void taskbar_add_new_window(LaunchTaskBarPlugin * tb, Window win)
 {
     gchar *res_class = task_get_class(win);
-    TaskButton *task;
+    TaskButton *task = NULL;
 
-    if (!tb->grouped_tasks || res_class == NULL)
-        list = NULL;
-    else for (; list; list = list->next)
-        if (task_button_add_window(list->data, win, res_class))
-            break;
-    if (list != NULL)
-        return; /* some button accepted it, done */
+    if (tb->grouped_tasks && res_class != NULL)
+        task = g_hash_table_lookup(tb->task_classes, res_class);
+    if (task == NULL || !task_button_add_window(task, win, res_class))
+    {
+        task = task_button_new(win, tb->number_of_desktops,
+                               tb->panel, res_class, tb->flags,
+                               tb->task_windows, tb->task_classes,
+                               tb->task_desktops);
+        taskbar_add_task_button(tb, task);
+    }
+    g_free(res_class);
+}
 
-    task = task_button_new(win, tb->current_desktop, tb->number_of_desktops,
-                           tb->panel, res_class, tb->flags);
-    taskbar_add_task_button(tb, task);
+static int window_compare(const void *a, const void *b)
+{
+    Window wa = *(const Window *)a, wb = *(const Window *)b;
+
+    return (wa > wb) - (wa < wb);
+}
+
+/* Evaluate window state and window type to see if it should be in task list. */
+static void taskbar_check_new_window(LaunchTaskBarPlugin * tb, Window win)
+{
+    NetWMWindowType nwwt;
+    NetWMState nws;
+
+    get_net_wm_state(win, &nws);
+    get_net_wm_window_type(win, &nwwt);
+    if ((accept_net_wm_state(&nws))
+    && (accept_net_wm_window_type(&nwwt)))
+        /* Allocate and initialize new task structure. */
+        taskbar_add_new_window(tb, win);
+#if GTK_CHECK_VERSION(2, 24, 0)
+    else if (!gdk_x11_window_lookup_for_display(gdk_display_get_default(), win))
+#else
+    else if (!gdk_window_lookup(win))
+#endif
+        /* Watch rejected window, it may become acceptable later. The mask
+           should be the same as set by task button, see the NOTE there. */
+        XSelectInput(GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), win,
+                     PropertyChangeMask | StructureNotifyMask);
 }
 
 /*****************************************************
@@ -2243,51 +2405,83 @@ static void taskbar_net_client_list(GtkWidget * widget, LaunchTaskBarPlugin * tb
 
     /* Get the NET_CLIENT_LIST property. */
     int client_count;
-    Window * client_list = get_xaproperty(GDK_ROOT_WINDOW(), a_NET_CLIENT_LIST, XA_WINDOW, &client_count);
+    Window * client_list = fb_ev_client_list(fbev, &client_count);
     if (client_list != NULL)
     {
-        GList *children = gtk_container_get_children(GTK_CONTAINER(tb->tb_icon_grid)), *l;
-        /* Remove windows from the task list that are not present in the NET_CLIENT_LIST. */
-        for (l = children; l; l = l->next)
-            task_button_update_windows_list(l->data, client_list, client_count);
-        g_list_free(children);
-        children = gtk_container_get_children(GTK_CONTAINER(tb->tb_icon_grid));
-        /* Loop over client list, correlating it with task list. */
-        int i;
-        for (i = 0; i < client_count; i++)
+        Window *sorted, *added;
+        int i, j, n_added = 0;
+        gboolean removed = FALSE;
+
+        /* Sort the new list once and walk it along with the previous one:
+           windows only in the old list are gone, only in the new are added. */
+        sorted = g_new(Window, client_count);
+        memcpy(sorted, client_list, client_count * sizeof(Window));
+        qsort(sorted, client_count, sizeof(Window), window_compare);
+        added = g_new(Window, client_count);
+        for (i = j = 0; i < tb->n_clients || j < client_count; )
         {
-            /* Search for the window in the task list.  Set up context to do an insert right away if needed. */
-            for (l = children; l; l = l->next)
+            if (j >= client_count || (i < tb->n_clients && tb->clients[i] < sorted[j]))
             {
-                if (task_button_has_window(l->data, client_list[i]))
-                    break;
+                /* Remove window from the task list, it's not present in the NET_CLIENT_LIST. */
+                TaskButton *tk = task_lookup(tb, tb->clients[i]);
+                if (tk != NULL)
+                    task_button_drop_window(tk, tb->clients[i], FALSE);
+                removed = TRUE;
+                i++;
             }
+            else if (i >= tb->n_clients || sorted[j] < tb->clients[i])
+                added[n_added++] = sorted[j++];
+            else
+                i++, j++;
+        }
+#ifndef DISABLE_MENU
+        if (removed && tb->pid_execs)
+            g_hash_table_foreach_remove(tb->pid_execs, task_pid_is_gone, NULL);
+#endif
+        g_free(tb->clients);
+        tb->clients = sorted;
+        tb->n_clients = client_count;
 
-            /* Task is not in task list. */
-            if (l == NULL)
-            {
-                /* Evaluate window state and window type to see if it should be in task list. */
-                NetWMWindowType nwwt;
-                NetWMState nws;
-                get_net_wm_state(client_list[i], &nws);
-                get_net_wm_window_type(client_list[i], &nwwt);
-                if ((accept_net_wm_state(&nws))
-                && (accept_net_wm_window_type(&nwwt)))
-                {
-                    /* Allocate and initialize new task structure. */
-                    taskbar_add_new_window(tb, client_list[i], children);
-                    g_list_free(children);
-                    children = gtk_container_get_children(GTK_CONTAINER(tb->tb_icon_grid));
-                }
-            }
+        /* Add new windows keeping the NET_CLIENT_LIST order. */
+        if (n_added > 0)
+        {
+            /* Everything that is needed to check and set up new windows,
+               requested at once for all of them. */
+            Atom props[] = {
+                a_NET_WM_STATE, XA_ATOM,
+                a_NET_WM_WINDOW_TYPE, XA_ATOM,
+                XA_WM_CLASS, XA_STRING,
+                a_NET_WM_DESKTOP, XA_CARDINAL,
+                a_WM_STATE, a_WM_STATE,
+                XA_WM_HINTS, XA_WM_HINTS,
+                a_NET_WM_VISIBLE_NAME, a_UTF8_STRING,
+                a_NET_WM_NAME, a_UTF8_STRING,
+                XA_WM_NAME, AnyPropertyType
+            };
+            XErrorHandler previous_error_handler = XSetErrorHandler(panel_handle_x_error_swallow_BadWindow_BadDrawable);
+
+            xproperty_prefetch(added, n_added, props, G_N_ELEMENTS(props) / 2);
+            for (i = 0; i < client_count; i++)
+                if (bsearch(&client_list[i], added, n_added, sizeof(Window), window_compare)
+                    && task_lookup(tb, client_list[i]) == NULL)
+                    taskbar_check_new_window(tb, client_list[i]);
+            xproperty_prefetch_done();
+            XSetErrorHandler(previous_error_handler);
         }
-        g_list_free(children);
-        XFree(client_list);
+        g_free(added);
     }
 
     else /* clear taskbar */
+    {
         gtk_container_foreach(GTK_CONTAINER(tb->tb_icon_grid),
                               (GtkCallback)gtk_widget_destroy, NULL);
+        g_hash_table_remove_all(tb->task_windows);
+        g_hash_table_remove_all(tb->task_classes);
+        g_hash_table_remove_all(tb->task_desktops);
+        g_free(tb->clients);
+        tb->clients = NULL;
+        tb->n_clients = 0;
+    }
 }
 
 /* Handler for "current-desktop" event from root window listener. */
@@ -2296,9 +2490,24 @@ static void taskbar_net_current_desktop(GtkWidget * widget, LaunchTaskBarPlugin
     LaunchTaskBarPlugin *ltbp = tb;
     if(ltbp->mode == LAUNCHBAR) return;
 
-    /* Store the local copy of current desktops.  Redisplay the taskbar. */
-    tb->current_desktop = get_net_current_desktop();
-    taskbar_redraw(tb);
+    /* Store the local copy of current desktops.  Redisplay only buttons
+       which have windows on the previous or the new desktop, visibility
+       of other buttons cannot change. */
+    gint old_desktop = tb->current_desktop;
+    gint64 start;
+    guint n;
+
+    tb->current_desktop = fb_ev_current_desktop(fbev);
+    if (tb->current_desktop == old_desktop)
+        return;
+    /* cost of the switch, see it with G_MESSAGES_DEBUG=all */
+    start = g_get_monotonic_time();
+    n = taskbar_redraw_desktop(tb, old_desktop);
+    n += taskbar_redraw_desktop(tb, tb->current_desktop);
+    g_debug("launchtaskbar: desktop %d -> %d: %u button updates for %u windows in %" G_GINT64_FORMAT " us",
+            old_desktop, tb->current_desktop, n,
+            g_hash_table_size(tb->task_windows),
+            g_get_monotonic_time() - start);
 }
 
 /* Handler for "number-of-desktops" event from root window listener. */
@@ -2308,7 +2517,7 @@ static void taskbar_net_number_of_desktops(GtkWidget * widget, LaunchTaskBarPlug
     if(ltbp->mode == LAUNCHBAR) return;
 
     /* Store the local copy of number of desktops.  Recompute the popup menu and redisplay the taskbar. */
-    tb->number_of_desktops = get_net_number_of_desktops();
+    tb->number_of_desktops = fb_ev_number_of_desktops(fbev);
     taskbar_reset_menu(tb);
     taskbar_redraw(tb);
 }
@@ -2320,12 +2529,11 @@ static void taskbar_net_active_window(GtkWidget * widget, LaunchTaskBarPlugin *
     if(ltbp->mode == LAUNCHBAR) return;
 
     /* Get the window that has focus. */
-    Window * f = get_xaproperty(GDK_ROOT_WINDOW(), a_NET_ACTIVE_WINDOW, XA_WINDOW, 0);
+    Window * f = fb_ev_active_window(fbev);
 
     gtk_container_foreach(GTK_CONTAINER(tb->tb_icon_grid),
-                          (GtkCallback)task_button_window_focus_changed, f);
-    if (f != NULL)
-        XFree(f);
+                          (GtkCallback)task_button_window_focus_changed,
+                          *f != None ? f : NULL);
 }
 
 /* Handle PropertyNotify event.
@@ -2370,11 +2578,9 @@ static void taskbar_property_notify_event(LaunchTaskBarPlugin *tb, XEvent *ev)
                 else if (at == XA_WM_CLASS && tb->grouped_tasks
                          && task_button_drop_window(tk, win, TRUE))
                 {
-                    GList *children = gtk_container_get_children(GTK_CONTAINER(tb->tb_icon_grid));
                     /* if Window was not single window of that class then
                        add it to another class or make another button */
-                    taskbar_add_new_window(tb, win, children);
-                    g_list_free(children);
+                    taskbar_add_new_window(tb, win);
                 }
                 else
                 {
@@ -2384,6 +2590,14 @@ static void taskbar_property_notify_event(LaunchTaskBarPlugin *tb, XEvent *ev)
 
                 XSetErrorHandler(previous_error_handler);
             }
+            else if ((at == a_NET_WM_STATE || at == a_NET_WM_WINDOW_TYPE)
+                     && bsearch(&win, tb->clients, tb->n_clients, sizeof(Window), window_compare))
+            {
+                /* Window was rejected before, check if it's acceptable now. */
+                XErrorHandler previous_error_handler = XSetErrorHandler(panel_handle_x_error_swallow_BadWindow_BadDrawable);
+                taskbar_check_new_window(tb, win);
+                XSetErrorHandler(previous_error_handler);
+            }
         }
     }
 }
@@ -38,7 +38,8 @@
 /*
  * HOWTO : Add your own monitor for the resource "foo".
  *
- * 1) Write the foo_update() function, that fills in the stats.
+ * 1) Write the foo_update() function, that fills in the stats from the
+ *    sampler snapshot, and add its source to the "update_sources" table.
  * 2) Write the foo_tooltip_update() function, that updates your tooltip. This
  *    is optional, but recommended.
  * 3) Add a #define FOO_POSITION, and increment N_MONITORS.
@@ -79,6 +80,7 @@
 #include <libfm/fm-gtk.h>
 
 #include "plugin.h"
+#include "sampler.h"
 
 #include "dbg.h"
 
@@ -86,7 +88,9 @@
 #define PLUGIN_NAME      "MonitorsPlugin"
 #define BORDER_SIZE      2                  /* Pixels               */
 #define DEFAULT_WIDTH    40                 /* Pixels               */
-#define UPDATE_PERIOD    1                  /* Seconds              */
+#define UPDATE_PERIOD    1000               /* Milliseconds per column */
+#define MIN_INTERVAL     250                /* Milliseconds         */
+#define MAX_INTERVAL     4000               /* Milliseconds         */
 #define COLOR_SIZE       8                  /* In chars : #xxxxxx\0 */
 
 #ifndef ENTER
@@ -94,8 +98,8 @@
 #endif
 
 /*
- * Stats are stored in a circular buffer.
- * Newest values are on the left of the ring cursor.
+ * Stats are stored in a circular buffer, one value per UPDATE_PERIOD.
+ * The current value is at the ring cursor, older values are on its left.
  * Oldest values are on the right of the ring cursor.
  */
 typedef float stats_set;
@@ -113,13 +117,19 @@ struct Monitor {
     stats_set    *stats;            /* Circular buffer of values              */
     stats_set    total;             /* Maximum possible value, as in mem_total*/
     gint         ring_cursor;       /* Cursor for ring/circular buffer        */
+    gint64       last_time;         /* Time of the last sample                */
+    gint64       column_time;       /* Microseconds sampled into the cursor   */
+    gdouble      column_sum;        /* Values sampled into it times duration  */
+    stats_set    last_value;        /* Last sampled value                     */
+    stats_set    change;            /* Change of the last sampled value       */
     gchar        *color;            /* Color of the graph                     */
-    gboolean     (*update) (struct Monitor *); /* Update function             */
+    LXPanelCpuTimes previous_cpu_stat; /* Previous values, for CPU monitor   */
+    gboolean     (*update) (struct Monitor *, const LXPanelSample *); /* Update function */
     void         (*update_tooltip) (struct Monitor *);
 };
 
 typedef struct Monitor Monitor;
-typedef gboolean (*update_func) (Monitor *);
+typedef gboolean (*update_func) (Monitor *, const LXPanelSample *);
 typedef void (*tooltip_update_func) (Monitor *);
 
 /*
@@ -138,7 +148,9 @@ typedef struct {
     Monitor  *monitors[N_MONITORS];          /* Monitors                      */
     int      displayed_monitors[N_MONITORS]; /* Booleans                      */
     char     *action;                        /* What to do on click           */
-    guint    timer;                          /* Timer for regular updates     */
+    guint    timer;                          /* Sampler subscription          */
+    LXPanelSampleRate rate;                  /* Adaptive sampling interval    */
+    GtkWidget *plugin;                       /* Top level widget              */
 } MonitorsPlugin;
 
 /*
@@ -147,11 +159,11 @@ typedef struct {
 static void monitor_set_foreground_color(MonitorsPlugin *, Monitor *, const gchar *);
 
 /* CPU Monitor */
-static gboolean cpu_update(Monitor *);
+static gboolean cpu_update(Monitor *, const LXPanelSample *);
 static void     cpu_tooltip_update (Monitor *m);
 
 /* RAM Monitor */
-static gboolean mem_update(Monitor *);
+static gboolean mem_update(Monitor *, const LXPanelSample *);
 static void     mem_tooltip_update (Monitor *m);
 
 
@@ -162,6 +174,7 @@ static gboolean expose_event(GtkWidget *, GdkEventExpose *, Monitor *);
 static gboolean draw(GtkWidget *, cairo_t *, Monitor *);
 #endif
 static void redraw_pixmap (Monitor *m);
+static void monitor_push_sample (Monitor *m, stats_set value, gint64 time);
 
 /* Monitors functions */
 static void monitors_destructor(gpointer);
@@ -223,6 +236,9 @@ monitor_set_foreground_color(MonitorsPlugin *mp, Monitor *m, const gchar *color)
 #else
     gdk_color_parse(color, &m->foreground_color);
 #endif
+    /* Columns are drawn incrementally so repaint the old ones as well */
+    if (m->pixmap)
+        redraw_pixmap(m);
 }
 /******************************************************************************
  *                          End of monitor functions                          *
@@ -231,54 +247,28 @@ monitor_set_foreground_color(MonitorsPlugin *mp, Monitor *m, const gchar *color)
 /******************************************************************************
  *                                 CPU monitor                                *
  ******************************************************************************/
-typedef unsigned long long CPUTick;/* Value from /proc/stat                   */
-typedef float CPUSample;	   /* Saved CPU utilization value as 0.0..1.0 */
-
-struct cpu_stat {
-    CPUTick u, n, s, i;		  /* User, nice, system, idle */
-};
-
 static gboolean
-cpu_update(Monitor * c)
+cpu_update(Monitor * c, const LXPanelSample *sample)
 {
-    static struct cpu_stat previous_cpu_stat = { 0, 0, 0, 0 };
-
-    if ((c->stats != NULL) && (c->pixmap != NULL))
+    if ((c->stats != NULL) && (c->pixmap != NULL) &&
+        (sample->sources & LXPANEL_SAMPLE_STAT))
     {
-        /* Open statistics file and scan out CPU usage. */
-        struct cpu_stat cpu;
-        FILE * stat = fopen("/proc/stat", "r");
-        if (stat == NULL)
-            return TRUE;
-        int fscanf_result = fscanf(stat, "cpu %llu %llu %llu %llu",
-                                    &cpu.u, &cpu.n, &cpu.s, &cpu.i);
-        fclose(stat);
-
-        /* Ensure that fscanf succeeded. */
-        if (fscanf_result == 4)
-        {
-            /* Comcolors delta from previous statistics. */
-            struct cpu_stat cpu_delta;
-            cpu_delta.u = cpu.u - previous_cpu_stat.u;
-            cpu_delta.n = cpu.n - previous_cpu_stat.n;
-            cpu_delta.s = cpu.s - previous_cpu_stat.s;
-            cpu_delta.i = cpu.i - previous_cpu_stat.i;
-
-            /* Copy current to previous. */
-            memcpy(&previous_cpu_stat, &cpu, sizeof(struct cpu_stat));
-
-            /* Comcolors user+nice+system as a fraction of total.
-             * Introduce this sample to ring buffer, increment and wrap ring
-             * buffer cursor. */
-            float cpu_uns = cpu_delta.u + cpu_delta.n + cpu_delta.s;
-            c->stats[c->ring_cursor] = cpu_uns / (cpu_uns + cpu_delta.i);
-            c->ring_cursor += 1;
-            if (c->ring_cursor >= c->pixmap_width)
-                c->ring_cursor = 0;
-
-            /* Redraw with the new sample. */
-            redraw_pixmap(c);
-        }
+        /* Compute delta from previous statistics. */
+        const LXPanelCpuTimes *cpu = &sample->cpu;
+        float cpu_uns = (cpu->user - c->previous_cpu_stat.user)
+                      + (cpu->nice - c->previous_cpu_stat.nice)
+                      + (cpu->system - c->previous_cpu_stat.system);
+        float cpu_idle = cpu->idle - c->previous_cpu_stat.idle;
+
+        /* Copy current to previous. */
+        c->previous_cpu_stat = *cpu;
+
+        /* Compute user+nice+system as a fraction of total.
+         * Introduce this sample to ring buffer, increment and wrap ring
+         * buffer cursor. */
+        monitor_push_sample(c, (cpu_uns + cpu_idle > 0)
+                               ? cpu_uns / (cpu_uns + cpu_idle) : 0,
+                            sample->time);
     }
     return TRUE;
 }
@@ -288,8 +278,7 @@ cpu_tooltip_update (Monitor *m)
 {
     if (m && m->stats) {
         gchar *tooltip_text;
-        gint ring_pos = (m->ring_cursor == 0)
-            ? m->pixmap_width - 1 : m->ring_cursor - 1;
+        gint ring_pos = m->ring_cursor;
         tooltip_text = g_strdup_printf(_("CPU usage: %.2f%%"),
                 m->stats[ring_pos] * 100);
         gtk_widget_set_tooltip_text(m->da, tooltip_text);
@@ -305,61 +294,22 @@ cpu_tooltip_update (Monitor *m)
  *                               RAM Monitor                                  *
  ******************************************************************************/
 static gboolean
-mem_update(Monitor * m)
+mem_update(Monitor * m, const LXPanelSample *sample)
 {
-    ENTER;
+    gint64 used;
 
-    FILE *meminfo;
-    char buf[80];
-    long int mem_total = 0;
-    long int mem_free  = 0;
-    long int mem_buffers = 0;
-    long int mem_cached = 0;
-    long int mem_sreclaimable = 0;
-    unsigned int readmask = 0x10 | 0x8 | 0x4 | 0x2 | 0x1;
+    ENTER;
 
     if (!m->stats || !m->pixmap)
         RET(TRUE);
 
-    meminfo = fopen("/proc/meminfo", "r");
-    if (!meminfo) {
-        g_warning("monitors: Could not open /proc/meminfo: %d, %s",
-                  errno, strerror(errno));
+    if (!(sample->sources & LXPANEL_SAMPLE_MEMINFO))
         RET(FALSE);
-    }
 
-    while (readmask && fgets(buf, sizeof(buf), meminfo)) {
-        if (sscanf(buf, "MemTotal: %ld kB\n", &mem_total) == 1) {
-            readmask ^= 0x1;
-            continue;
-        }
-        if (sscanf(buf, "MemFree: %ld kB\n", &mem_free) == 1) {
-            readmask ^= 0x2;
-            continue;
-        }
-        if (sscanf(buf, "Buffers: %ld kB\n", &mem_buffers) == 1) {
-            readmask ^= 0x4;
-            continue;
-        }
-        if (sscanf(buf, "Cached: %ld kB\n", &mem_cached) == 1) {
-            readmask ^= 0x8;
-            continue;
-        }
-        if (sscanf(buf, "SReclaimable: %ld kB\n", &mem_sreclaimable) == 1) {
-            readmask ^= 0x10;
-            continue;
-        }
-    }
-
-    fclose(meminfo);
-
-    if (readmask) {
-        g_warning("monitors: Couldn't read all values from /proc/meminfo: "
-                  "readmask %x", readmask);
+    if (sample->mem_total == 0)
         RET(FALSE);
-    }
 
-    m->total = mem_total;
+    m->total = sample->mem_total;
 
     /* Adding stats to the buffer:
      * It is debatable if 'mem_buffers' counts as free or not. I'll go with
@@ -370,16 +320,14 @@ mem_update(Monitor * m)
      * SReclaimable as free so it's counted it here as well (note that
      * 'man free' doesn't specify this)
      * 'mem_cached' definitely counts as 'free' because it is immediately
-     * released should any application need it. */
-    m->stats[m->ring_cursor] = (mem_total - mem_buffers - mem_free -
-            mem_cached - mem_sreclaimable) / (float)mem_total;
-
-    m->ring_cursor++;
-    if (m->ring_cursor >= m->pixmap_width)
-        m->ring_cursor = 0;
-
-    /* Redraw the pixmap, with the new sample */
-    redraw_pixmap (m);
+     * released should any application need it.
+     * In containers the reclaimable parts may exceed the total, so compute
+     * it signed and clamp at zero. */
+    used = (gint64)sample->mem_total - (gint64)sample->mem_buffers -
+           (gint64)sample->mem_free - (gint64)sample->mem_cached -
+           (gint64)sample->mem_sreclaimable;
+    monitor_push_sample(m, (float)MAX(used, 0) / (float)sample->mem_total,
+                        sample->time);
 
     RET(TRUE);
 }
@@ -389,8 +337,7 @@ mem_tooltip_update (Monitor *m)
 {
     if (m && m->stats) {
         gchar *tooltip_text;
-        gint ring_pos = (m->ring_cursor == 0)
-            ? m->pixmap_width - 1 : m->ring_cursor - 1;
+        gint ring_pos = m->ring_cursor;
         tooltip_text = g_strdup_printf(_("RAM usage: %.1fMB (%.2f%%)"),
                 m->stats[ring_pos] * m->total / 1024,
                 m->stats[ring_pos] * 100);
@@ -436,32 +383,35 @@ configure_event(GtkWidget* widget, GdkEventConfigure* dummy, gpointer data)
 
             if (m->stats)
             {
+                /* Number of newest values, up to and including the cursor */
+                int head = m->ring_cursor + 1;
+
                 /* New allocation is larger.
                  * Add new "oldest" samples of zero following the cursor*/
                 if (new_pixmap_width > m->pixmap_width)
                 {
                     /* Number of values between the ring cursor and the end of
                      * the buffer */
-                    int nvalues = m->pixmap_width - m->ring_cursor;
+                    int nvalues = m->pixmap_width - head;
 
                     memcpy(new_stats,
                            m->stats,
-                           m->ring_cursor * sizeof (stats_set));
-                    memcpy(new_stats + nvalues,
-                           m->stats + m->ring_cursor,
+                           head * sizeof (stats_set));
+                    memcpy(new_stats + new_pixmap_width - nvalues,
+                           m->stats + head,
                            nvalues * sizeof(stats_set));
                 }
                 /* New allocation is smaller, but still larger than the ring
                  * buffer cursor */
-                else if (m->ring_cursor <= new_pixmap_width)
+                else if (head <= new_pixmap_width)
                 {
                     /* Numver of values that can be stored between the end of
                      * the new buffer and the ring cursor */
-                    int nvalues = new_pixmap_width - m->ring_cursor;
+                    int nvalues = new_pixmap_width - head;
                     memcpy(new_stats,
                            m->stats,
-                           m->ring_cursor * sizeof(stats_set));
-                    memcpy(new_stats + m->ring_cursor,
+                           head * sizeof(stats_set));
+                    memcpy(new_stats + head,
                            m->stats + m->pixmap_width - nvalues,
                            nvalues * sizeof(stats_set));
                 }
@@ -472,8 +422,9 @@ configure_event(GtkWidget* widget, GdkEventConfigure* dummy, gpointer data)
                 else
                 {
                     memcpy(new_stats,
-                           m->stats + m->ring_cursor - new_pixmap_width,
+                           m->stats + head - new_pixmap_width,
                            new_pixmap_width * sizeof(stats_set));
+                    m->ring_cursor = new_pixmap_width - 1;
                 }
                 g_free(m->stats);
             }
@@ -503,20 +454,29 @@ draw(GtkWidget * widget, cairo_t * cr, Monitor *m)
 #endif
 {
     /* Draw the requested part of the pixmap onto the drawing area.
-     * Translate it in both x and y by the border size. */
+     * Translate it in both x and y by the border size, and rotate it by the
+     * ring cursor so the current value is on the right. */
     if (m->pixmap != NULL)
     {
+        int oldest = (m->ring_cursor + 1 < m->pixmap_width) ? m->ring_cursor + 1 : 0;
+        int split = m->pixmap_width - oldest;
 #if !GTK_CHECK_VERSION(3, 0, 0)
         cairo_t *cr = gdk_cairo_create(gtk_widget_get_window(widget));
-        GtkStyle *style = gtk_widget_get_style(m->da);
         gdk_cairo_region(cr, event->region);
         cairo_clip(cr);
-        gdk_cairo_set_source_color(cr, &style->black);
-#else
-        cairo_set_source_rgb(cr, 0, 0, 0); // FIXME: set the color from style
 #endif
-        cairo_set_source_surface(cr, m->pixmap, BORDER_SIZE, BORDER_SIZE);
-        cairo_paint(cr);
+        cairo_set_source_surface(cr, m->pixmap,
+                                 BORDER_SIZE - oldest, BORDER_SIZE);
+        cairo_rectangle(cr, BORDER_SIZE, BORDER_SIZE, split, m->pixmap_height);
+        cairo_fill(cr);
+        if (oldest > 0)
+        {
+            cairo_set_source_surface(cr, m->pixmap,
+                                     BORDER_SIZE + split, BORDER_SIZE);
+            cairo_rectangle(cr, BORDER_SIZE + split, BORDER_SIZE,
+                            oldest, m->pixmap_height);
+            cairo_fill(cr);
+        }
         check_cairo_status(cr);
 #if !GTK_CHECK_VERSION(3, 0, 0)
         cairo_destroy(cr);
@@ -546,43 +506,102 @@ static gboolean monitors_button_press_event(GtkWidget* widget, GdkEventButton* e
  *                       End of basic events handlers                         *
  ******************************************************************************/
 
+/*
+ * The pixmap keeps each value at the column of its ring buffer position and is
+ * rotated when painted, so a new value only needs its own column drawn.
+ */
 static void
-redraw_pixmap (Monitor *m)
+monitor_draw_column (Monitor *m, cairo_t *cr, int pos)
 {
-    int i;
-    cairo_t *cr = cairo_create(m->pixmap);
+    float value = m->stats[pos];
 #if !GTK_CHECK_VERSION(3, 0, 0)
     GtkStyle *style = gtk_widget_get_style(m->da);
 #endif
 
-    cairo_set_line_width (cr, 1.0);
-
-    /* Erase pixmap */
+    /* Erase column */
+    cairo_rectangle(cr, pos, 0, 1, m->pixmap_height);
 #if GTK_CHECK_VERSION(3, 0, 0)
     cairo_set_source_rgb(cr, 0, 0, 0); // FIXME: use black color from style
 #else
     gdk_cairo_set_source_color(cr, &style->black);
 #endif
-    cairo_paint(cr);
+    cairo_fill(cr);
 
+    /* Draw one bar of the graph */
+    if (value > 0)
+    {
+        cairo_rectangle(cr, pos, (1.0 - value) * m->pixmap_height,
+                        1, value * m->pixmap_height);
 #if GTK_CHECK_VERSION(3, 0, 0)
-    gdk_cairo_set_source_rgba(cr, &m->foreground_color);
+        gdk_cairo_set_source_rgba(cr, &m->foreground_color);
 #else
-    gdk_cairo_set_source_color(cr, &m->foreground_color);
+        gdk_cairo_set_source_color(cr, &m->foreground_color);
 #endif
+        cairo_fill(cr);
+    }
+}
+
+static void
+redraw_pixmap (Monitor *m)
+{
+    int i;
+    cairo_t *cr = cairo_create(m->pixmap);
+
     for (i = 0; i < m->pixmap_width; i++)
-    {
-        unsigned int drawing_cursor = (m->ring_cursor + i) % m->pixmap_width;
+        monitor_draw_column(m, cr, i);
 
-        /* Draw one bar of the graph */
-        cairo_move_to(cr, i + 0.5, m->pixmap_height);
-        cairo_line_to(cr, i + 0.5, (1.0 - m->stats[drawing_cursor]) * m->pixmap_height);
-        cairo_stroke(cr);
+    check_cairo_status(cr);
+    cairo_destroy(cr);
+    /* Redraw pixmap */
+    gtk_widget_queue_draw(m->da);
+}
+
+/*
+ * Add a value sampled at time to the ring buffer and draw changed columns
+ * only. Each column covers UPDATE_PERIOD however often it is sampled: the
+ * current column holds the average of the values sampled into it weighted by
+ * their sampling period, and a value sampled after a longer interval
+ * completes as many columns as the interval covers.
+ */
+static void
+monitor_push_sample (Monitor *m, stats_set value, gint64 time)
+{
+    const gint64 period = (gint64)UPDATE_PERIOD * 1000;
+    gint64 elapsed = m->last_time ? time - m->last_time : period;
+    gint columns, i;
+    stats_set average;
+    cairo_t *cr;
+
+    m->change = m->last_time ? ABS(value - m->last_value) : 0;
+    m->last_time = time;
+    m->last_value = value;
+
+    m->column_time += elapsed;
+    m->column_sum += value * elapsed;
+    average = (m->column_time > 0) ? m->column_sum / m->column_time : value;
+    m->stats[m->ring_cursor] = average;
+
+    /* The new current column starts with the average of the last one */
+    columns = MIN(m->column_time / period, m->pixmap_width);
+    if (columns > 0)
+    {
+        m->column_time %= period;
+        m->column_sum = average * m->column_time;
     }
 
+    cr = cairo_create(m->pixmap);
+    for (i = 0; i < columns; i++)
+    {
+        monitor_draw_column(m, cr, m->ring_cursor);
+        m->ring_cursor++;
+        if (m->ring_cursor >= m->pixmap_width)
+            m->ring_cursor = 0;
+        m->stats[m->ring_cursor] = average;
+    }
+    monitor_draw_column(m, cr, m->ring_cursor);
     check_cairo_status(cr);
     cairo_destroy(cr);
-    /* Redraw pixmap */
+
     gtk_widget_queue_draw(m->da);
 }
 
@@ -592,6 +611,11 @@ static update_func update_functions [N_MONITORS] = {
     [MEM_POSITION] = mem_update
 };
 
+static guint update_sources[N_MONITORS] = {
+    [CPU_POSITION] = LXPANEL_SAMPLE_STAT,
+    [MEM_POSITION] = LXPANEL_SAMPLE_MEMINFO
+};
+
 static char *default_colors[N_MONITORS] = {
     [CPU_POSITION] = "#0000FF",
     [MEM_POSITION] = "#FF0000"
@@ -612,32 +636,62 @@ static char *colors[N_MONITORS] = {
 };
 
 /*
- * This function is called every UPDATE_PERIOD seconds. It updates all
- * monitors.
+ * This function is called by the sampler, every MIN_INTERVAL milliseconds
+ * while values change and up to every MAX_INTERVAL milliseconds while they
+ * are flat. It updates all monitors.
  */
-static gboolean
-monitors_update(gpointer data)
+static void
+monitors_update(const LXPanelSample *sample, gpointer data)
 {
-    MonitorsPlugin *mp;
+    MonitorsPlugin *mp = (MonitorsPlugin *) data;
+    stats_set change = 0;
     int i;
 
-    if (g_source_is_destroyed(g_main_current_source()))
-        return FALSE;
-    mp = (MonitorsPlugin *) data;
-    if (!mp)
-        RET(FALSE);
-
     for (i = 0; i < N_MONITORS; i++)
     {
         if (mp->monitors[i])
         {
-            mp->monitors[i]->update(mp->monitors[i]);
+            mp->monitors[i]->update(mp->monitors[i], sample);
             if (mp->monitors[i]->update_tooltip)
                 mp->monitors[i]->update_tooltip(mp->monitors[i]);
+            change = MAX(change, mp->monitors[i]->change);
         }
     }
 
-    return TRUE;
+    if (lxpanel_sample_rate_adapt(&mp->rate, change))
+        lxpanel_sampler_set_interval(mp->timer, mp->rate.interval);
+}
+
+/*
+ * (Re)subscribes to the sources of the displayed monitors only. Monitors are
+ * sampled only while they are on screen, the plugin is unmapped while the
+ * panel is autohidden.
+ */
+static void
+monitors_subscribe(MonitorsPlugin *mp)
+{
+    guint sources = 0;
+    int i;
+
+    for (i = 0; i < N_MONITORS; i++)
+        if (mp->monitors[i])
+            sources |= update_sources[i];
+
+    if (mp->timer)
+        lxpanel_sampler_remove(mp->timer);
+    mp->timer = 0;
+    if (!gtk_widget_get_mapped(mp->plugin))
+        return;
+    mp->rate.interval = mp->rate.min_interval;
+    mp->timer = lxpanel_sampler_add(sources, mp->rate.interval, monitors_update, mp);
+}
+
+static void
+monitors_unsubscribe(MonitorsPlugin *mp)
+{
+    if (mp->timer)
+        lxpanel_sampler_remove(mp->timer);
+    mp->timer = 0;
 }
 
 static Monitor*
@@ -670,6 +724,8 @@ monitors_constructor(LXPanel *panel, config_setting_t *settings)
     mp = g_new0(MonitorsPlugin, 1);
     mp->panel = panel;
     mp->settings = settings;
+    mp->rate.min_interval = MIN_INTERVAL;
+    mp->rate.max_interval = MAX_INTERVAL;
 
 #if GTK_CHECK_VERSION(3, 0, 0)
     p = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
@@ -678,6 +734,7 @@ monitors_constructor(LXPanel *panel, config_setting_t *settings)
     p = gtk_hbox_new(TRUE, 2);
 #endif
     lxpanel_plugin_set_data(p, mp, monitors_destructor);
+    mp->plugin = p;
 
     /* First time we use this plugin : only display CPU usage */
     mp->displayed_monitors[CPU_POSITION] = 1;
@@ -693,6 +750,12 @@ monitors_constructor(LXPanel *panel, config_setting_t *settings)
         colors[CPU_POSITION] = g_strndup(tmp, COLOR_SIZE-1);
     if (config_setting_lookup_string(settings, "RAMColor", &tmp))
         colors[MEM_POSITION] = g_strndup(tmp, COLOR_SIZE-1);
+    if (config_setting_lookup_int(settings, "MinInterval", &i) && i >= 100)
+        mp->rate.min_interval = i;
+    if (config_setting_lookup_int(settings, "MaxInterval", &i) && i >= 100)
+        mp->rate.max_interval = i;
+    if (mp->rate.max_interval < mp->rate.min_interval)
+        mp->rate.max_interval = mp->rate.min_interval;
 
     /* Initializing monitors */
     for (i = 0; i < N_MONITORS; i++)
@@ -709,10 +772,11 @@ monitors_constructor(LXPanel *panel, config_setting_t *settings)
         }
     }
 
-    /* Adding a timer : monitors will be updated every UPDATE_PERIOD
-     * seconds */
-    mp->timer = g_timeout_add_seconds(UPDATE_PERIOD, (GSourceFunc) monitors_update,
-                              (gpointer) mp);
+    /* Subscribing to the sampler while the plugin is on screen */
+    g_signal_connect_swapped(G_OBJECT(p), "map",
+        G_CALLBACK(monitors_subscribe), (gpointer) mp);
+    g_signal_connect_swapped(G_OBJECT(p), "unmap",
+        G_CALLBACK(monitors_unsubscribe), (gpointer) mp);
     RET(p);
 }
 
@@ -725,8 +789,8 @@ monitors_destructor(gpointer user_data)
 
     mp = (MonitorsPlugin *) user_data;
 
-    /* Removing timer */
-    g_source_remove(mp->timer);
+    /* Removing sampler subscription */
+    monitors_unsubscribe(mp);
 
     /* Freeing all monitors */
     for (i = 0; i < N_MONITORS; i++)
@@ -826,6 +890,7 @@ start:
         mp->displayed_monitors[0] = 1;
         goto start;
     }
+    monitors_subscribe(mp);
     config_group_set_int(mp->settings, "DisplayCPU", mp->displayed_monitors[CPU_POSITION]);
     config_group_set_int(mp->settings, "DisplayRAM", mp->displayed_monitors[MEM_POSITION]);
     config_group_set_string(mp->settings, "Action", mp->action);
@@ -39,6 +39,10 @@
 #include "devproc.h"
 #include "dbg.h"
 
+#ifndef IFF_LOWER_UP
+#define IFF_LOWER_UP 0x10000
+#endif
+
 /* network device list */
 static void netproc_netdevlist_add(NETDEVLIST_PTR *netdev_list,
                                    const char *ifname,
@@ -70,6 +74,7 @@ static void netproc_netdevlist_add(NETDEVLIST_PTR *netdev_list,
 	new_dev->info.trans_packets = trans_packets;
 	new_dev->info.status_icon = NULL;
 	new_dev->info.pg = NULL;
+	new_dev->info.scan = NULL;
 	new_dev->prev = NULL;
 	new_dev->next = *netdev_list;
 	if (new_dev->next!=NULL) {
@@ -87,6 +92,7 @@ static void netproc_netdevlist_destroy(NETDEVLIST_PTR netdev_list)
 	g_free(netdev_list->info.bcast);
 	g_free(netdev_list->info.mask);
 	statusicon_destroy(netdev_list->info.status_icon);
+	wireless_scan_free(netdev_list->info.scan);
 }
 
 int netproc_netdevlist_clear(NETDEVLIST_PTR *netdev_list)
@@ -131,134 +137,62 @@ static NETDEVLIST_PTR netproc_netdevlist_find(
 	return NULL;
 }
 
-static char *netproc_parse_ifname(const char *buffer)
-{
-	char *ptr;
-	if ((ptr = strchr(buffer, ':'))) {
-		*ptr++ = '\0';
-	}
-
-	return ptr;
-}
-
-static void netproc_parse_stats_header(char *buffer,
-                                       int *prx_idx,
-                                       int *ptx_idx,
-                                       int *brx_idx,
-                                       int *btx_idx)
-{
-	char *p;
-	int i;
-
-	*prx_idx = *ptx_idx = -1;
-	*brx_idx = *btx_idx = -1;
-
-	p = strtok (buffer, "| \t\n");
-	p = strtok (NULL, "| \t\n");
-	for (i = 0; p; i++, p = strtok (NULL, "| \t\n")) {
-		if (!strcmp (p, "packets")) {
-			if (*prx_idx == -1)
-				*prx_idx = i;
-			else
-				*ptx_idx = i;
-		} else if (!strcmp (p, "bytes")) {
-			if (*brx_idx == -1)
-				*brx_idx = i;
-			else
-				*btx_idx = i;
-		}
-	}
-}
-
-static gboolean netproc_parse_status(char *buffer,
-                                     int prx_idx,
-                                     int ptx_idx,
-                                     gulong *in_packets,
-                                     gulong *out_packets,
-                                     int brx_idx,
-                                     int btx_idx,
-                                     gulong *in_bytes,
-                                     gulong *out_bytes)
-{
-	char *ptr;
-	int i;
-	ptr = strtok(buffer, " \t\n");
-	for (i=0;ptr;i++, ptr = strtok(NULL, " \t\n")) {
-		if (i==prx_idx)
-			*in_packets = g_ascii_strtoull(ptr, NULL, 10);
-		else if (i==ptx_idx)
-			*out_packets = g_ascii_strtoull(ptr, NULL, 10);
-		else if (i==brx_idx)
-			*in_bytes = g_ascii_strtoull(ptr, NULL, 10);
-		else if (i==btx_idx)
-			*out_bytes = g_ascii_strtoull(ptr, NULL, 10);
-	}
-
-	if (i <= prx_idx || i <= ptx_idx || i <= brx_idx || i <=btx_idx)
-		return FALSE;
-
-	return TRUE;
-}
-
-FILE *netproc_open()
-{
-	return fopen("/proc/net/dev", "r");
-}
-
-void netproc_close(FILE *fp)
+/* Link state comes from the rtnetlink dump of the sample if there is one, so
+ * ioctls are needed only for addresses, and only when addresses changed. */
+int netproc_scandevice(int sockfd, int iwsockfd, const LXPanelSample *sample,
+                       gboolean addresses, NETDEVLIST_PTR *netdev_list)
 {
-	fclose(fp);
-}
-
-int netproc_scandevice(int sockfd, int iwsockfd, FILE *fp, NETDEVLIST_PTR *netdev_list)
-{
-	char buffer[512];
 	int count = 0;
-	int prx_idx, ptx_idx, brx_idx, btx_idx;
+	guint i;
 	gulong in_packets, out_packets, in_bytes, out_bytes;
 	NETDEVLIST_PTR devptr = NULL;
+	gboolean has_link = (sample->sources & LXPANEL_SAMPLE_NET_LINK) != 0;
+	gboolean refresh_addr;
+	guint hw_type;
+	const guint8 *hw_addr;
 
 	/* interface information */
 	struct ifreq ifr;
 	struct ethtool_test edata;
 	iwstats iws;
-	char *status;
-	char *name;
+	const char *name;
 	struct iw_range iwrange;
 	int has_iwrange = 0;
 
-	status = fgets (buffer, sizeof(buffer), fp);
-	if (!status)
-		g_warning("netstat: netproc_scnadevice(): Error reading first line from stream!");
-	status = fgets (buffer, sizeof(buffer), fp);
-	if (!status)
-		g_warning("netstat: netproc_scnadevice(): Error reading second line from stream!");
-	netproc_parse_stats_header(buffer, &prx_idx, &ptx_idx, &brx_idx, &btx_idx);
+	if (!(sample->sources & LXPANEL_SAMPLE_NET_DEV))
+		g_warning("netstat: netproc_scandevice(): No data from /proc/net/dev!");
 
-	while (fgets(buffer, sizeof(buffer), fp)) {
+	for (i = 0; i < sample->n_net_devices; i++) {
 		/* getting interface name */
-		name = buffer;
-		while (g_ascii_isspace(name[0])) {
-			name++;
-		}
+		name = sample->net_devices[i].name;
 
 		/* reading packet infomation */
-		in_packets = out_packets = in_bytes = out_bytes = 0L;
-		status = netproc_parse_ifname(name);
-		netproc_parse_status(status, prx_idx, ptx_idx, &in_packets, &out_packets,
-				     brx_idx, btx_idx, &in_bytes, &out_bytes);
+		in_packets = sample->net_devices[i].rx_packets;
+		out_packets = sample->net_devices[i].tx_packets;
+		in_bytes = sample->net_devices[i].rx_bytes;
+		out_bytes = sample->net_devices[i].tx_bytes;
 
 		/* check interface hw_type */
-		bzero(&ifr, sizeof(ifr));
-		strncpy(ifr.ifr_name, name, strlen(name));
-		ifr.ifr_name[strlen(name)+1] = '\0';
-		if (ioctl(sockfd, SIOCGIFHWADDR, &ifr)<0)
-			continue;
+		if (has_link) {
+			hw_type = sample->net_devices[i].type;
+			hw_addr = sample->net_devices[i].address;
+		} else {
+			bzero(&ifr, sizeof(ifr));
+			strncpy(ifr.ifr_name, name, strlen(name));
+			ifr.ifr_name[strlen(name)+1] = '\0';
+			if (ioctl(sockfd, SIOCGIFHWADDR, &ifr)<0)
+				continue;
+			hw_type = ifr.ifr_hwaddr.sa_family;
+			hw_addr = (const guint8 *)ifr.ifr_hwaddr.sa_data;
+		}
 
 		/* hw_types is not Ethernet and PPP */
-		if (ifr.ifr_hwaddr.sa_family!=ARPHRD_ETHER&&ifr.ifr_hwaddr.sa_family!=ARPHRD_PPP)
+		if (hw_type!=ARPHRD_ETHER&&hw_type!=ARPHRD_PPP)
 			continue;
 
+		/* without link events addresses have to be polled */
+		refresh_addr = addresses || !has_link;
+
 		/* detecting new interface */
 		if ((devptr = netproc_netdevlist_find(*netdev_list, name))==NULL) {
 			/* check wireless device */
@@ -272,12 +206,9 @@ int netproc_scandevice(int sockfd, int iwsockfd, FILE *fp, NETDEVLIST_PTR *netde
 
 			/* MAC Address */
 			devptr->info.mac = g_strdup_printf ("%02X:%02X:%02X:%02X:%02X:%02X",
-					ifr.ifr_hwaddr.sa_data[0] & 0377,
-					ifr.ifr_hwaddr.sa_data[1] & 0377,
-					ifr.ifr_hwaddr.sa_data[2] & 0377,
-					ifr.ifr_hwaddr.sa_data[3] & 0377,
-					ifr.ifr_hwaddr.sa_data[4] & 0377,
-					ifr.ifr_hwaddr.sa_data[5] & 0377);
+					hw_addr[0], hw_addr[1], hw_addr[2],
+					hw_addr[3], hw_addr[4], hw_addr[5]);
+			refresh_addr = TRUE;
 		} else {
 			/* Setting device status and update flags */
 			if (devptr->info.recv_packets!=in_packets&&devptr->info.trans_packets!=out_packets) {
@@ -316,9 +247,9 @@ int netproc_scandevice(int sockfd, int iwsockfd, FILE *fp, NETDEVLIST_PTR *netde
 		bzero(&ifr, sizeof(ifr));
 		strcpy(ifr.ifr_name, devptr->info.ifname);
 		ifr.ifr_name[IF_NAMESIZE - 1] = '\0';
-		if (ioctl(sockfd, SIOCGIFFLAGS, &ifr)>=0) {
-			devptr->info.flags = ifr.ifr_flags;
-			if (ifr.ifr_flags & IFF_UP) {
+		if (has_link || ioctl(sockfd, SIOCGIFFLAGS, &ifr)>=0) {
+			devptr->info.flags = has_link ? (int)sample->net_devices[i].flags : ifr.ifr_flags;
+			if (devptr->info.flags & IFF_UP) {
 				devptr->info.enable = TRUE;
 				devptr->info.updated = TRUE;
 			} else {
@@ -328,8 +259,11 @@ int netproc_scandevice(int sockfd, int iwsockfd, FILE *fp, NETDEVLIST_PTR *netde
 
 			if (devptr->info.enable) {
 				/* Workaround for Atheros Cards */
-				if (strncmp(devptr->info.ifname, "ath", 3)==0)
-					wireless_refresh(iwsockfd, devptr->info.ifname);
+				if (strncmp(devptr->info.ifname, "ath", 3)==0) {
+					if (devptr->info.scan == NULL)
+						devptr->info.scan = wireless_scan_new(iwsockfd, devptr->info.ifname);
+					wireless_scan_start(devptr->info.scan);
+				}
 
 				/* plug */
 				bzero(&ifr, sizeof(ifr));
@@ -338,7 +272,18 @@ int netproc_scandevice(int sockfd, int iwsockfd, FILE *fp, NETDEVLIST_PTR *netde
 
 				edata.cmd = 0x0000000a;
 				ifr.ifr_data = (caddr_t)&edata;
-				if (ioctl(sockfd, SIOCETHTOOL, &ifr)<0) {
+				if (has_link) {
+					/* rtnetlink reports the carrier as IFF_LOWER_UP */
+					if (devptr->info.flags & IFF_LOWER_UP) {
+						if (!devptr->info.plug) {
+							devptr->info.plug = TRUE;
+							devptr->info.updated = TRUE;
+						}
+					} else if (devptr->info.plug) {
+						devptr->info.plug = FALSE;
+						devptr->info.updated = TRUE;
+					}
+				} else if (ioctl(sockfd, SIOCETHTOOL, &ifr)<0) {
 					/* using IFF_RUNNING instead due to system doesn't have ethtool or working in non-root */
 					if (devptr->info.flags & IFF_RUNNING) {
 						if (!devptr->info.plug) {
@@ -364,51 +309,57 @@ int netproc_scandevice(int sockfd, int iwsockfd, FILE *fp, NETDEVLIST_PTR *netde
 				/* get network information */
 				if (devptr->info.enable&&devptr->info.plug) {
 					if (devptr->info.flags & IFF_RUNNING) {
-						/* release old information */
-						g_free(devptr->info.ipaddr);
-						g_free(devptr->info.bcast);
-						g_free(devptr->info.mask);
-
-						/* IP Address */
-						bzero(&ifr, sizeof(ifr));
-						strcpy(ifr.ifr_name, devptr->info.ifname);
-						ifr.ifr_name[IF_NAMESIZE - 1] = '\0';
-						if (ioctl(sockfd, SIOCGIFADDR, &ifr)<0)
-							devptr->info.ipaddr = g_strdup("0.0.0.0");
-						else
-							devptr->info.ipaddr = g_strdup(inet_ntoa(((struct sockaddr_in*)&ifr.ifr_addr)->sin_addr));
-
-						/* Point-to-Porint Address */
-						if (devptr->info.flags & IFF_POINTOPOINT) {
+						/* addresses change only with link or address events */
+						if (refresh_addr || devptr->info.ipaddr == NULL) {
+							/* release old information */
+							g_free(devptr->info.ipaddr);
+							g_free(devptr->info.bcast);
+							g_free(devptr->info.dest);
+							g_free(devptr->info.mask);
+							devptr->info.dest = NULL;
+							devptr->info.bcast = NULL;
+
+							/* IP Address */
 							bzero(&ifr, sizeof(ifr));
 							strcpy(ifr.ifr_name, devptr->info.ifname);
 							ifr.ifr_name[IF_NAMESIZE - 1] = '\0';
-							if (ioctl(sockfd, SIOCGIFDSTADDR, &ifr)<0)
-								devptr->info.dest = NULL;
+							if (ioctl(sockfd, SIOCGIFADDR, &ifr)<0)
+								devptr->info.ipaddr = g_strdup("0.0.0.0");
 							else
-								devptr->info.dest = g_strdup(inet_ntoa(((struct sockaddr_in*)&ifr.ifr_dstaddr)->sin_addr));
-						}
+								devptr->info.ipaddr = g_strdup(inet_ntoa(((struct sockaddr_in*)&ifr.ifr_addr)->sin_addr));
+
+							/* Point-to-Porint Address */
+							if (devptr->info.flags & IFF_POINTOPOINT) {
+								bzero(&ifr, sizeof(ifr));
+								strcpy(ifr.ifr_name, devptr->info.ifname);
+								ifr.ifr_name[IF_NAMESIZE - 1] = '\0';
+								if (ioctl(sockfd, SIOCGIFDSTADDR, &ifr)<0)
+									devptr->info.dest = NULL;
+								else
+									devptr->info.dest = g_strdup(inet_ntoa(((struct sockaddr_in*)&ifr.ifr_dstaddr)->sin_addr));
+							}
+
+							/* Broadcast */
+							if (devptr->info.flags & IFF_BROADCAST) {
+								bzero(&ifr, sizeof(ifr));
+								strcpy(ifr.ifr_name, devptr->info.ifname);
+								ifr.ifr_name[IF_NAMESIZE - 1] = '\0';
+								if (ioctl(sockfd, SIOCGIFBRDADDR, &ifr)<0)
+									devptr->info.bcast = NULL;
+								else
+									devptr->info.bcast = g_strdup(inet_ntoa(((struct sockaddr_in*)&ifr.ifr_broadaddr)->sin_addr));
+							}
 
-						/* Broadcast */
-						if (devptr->info.flags & IFF_BROADCAST) {
+							/* Netmask */
 							bzero(&ifr, sizeof(ifr));
 							strcpy(ifr.ifr_name, devptr->info.ifname);
 							ifr.ifr_name[IF_NAMESIZE - 1] = '\0';
-							if (ioctl(sockfd, SIOCGIFBRDADDR, &ifr)<0)
-								devptr->info.bcast = NULL;
+							if (ioctl(sockfd, SIOCGIFNETMASK, &ifr)<0)
+								devptr->info.mask = NULL;
 							else
-								devptr->info.bcast = g_strdup(inet_ntoa(((struct sockaddr_in*)&ifr.ifr_broadaddr)->sin_addr));
+								devptr->info.mask = g_strdup(inet_ntoa(((struct sockaddr_in*)&ifr.ifr_addr)->sin_addr));
 						}
 
-						/* Netmask */
-						bzero(&ifr, sizeof(ifr));
-						strcpy(ifr.ifr_name, devptr->info.ifname);
-						ifr.ifr_name[IF_NAMESIZE - 1] = '\0';
-						if (ioctl(sockfd, SIOCGIFNETMASK, &ifr)<0)
-							devptr->info.mask = NULL;
-						else
-							devptr->info.mask = g_strdup(inet_ntoa(((struct sockaddr_in*)&ifr.ifr_addr)->sin_addr));
-
 						/* Wireless Information */
 						if (devptr->info.wireless) {
 							struct wireless_config wconfig;
@@ -455,9 +406,6 @@ int netproc_scandevice(int sockfd, int iwsockfd, FILE *fp, NETDEVLIST_PTR *netde
 		count++;
 	}
 
-	rewind(fp);
-	fflush(fp);
-
 	return count;
 }
 
@@ -497,13 +445,11 @@ void netproc_devicelist_clear(NETDEVLIST_PTR *netdev_list)
 	}
 }
 
-void netproc_listener(FNETD *fnetd)
+void netproc_listener(FNETD *fnetd, const LXPanelSample *sample, gboolean addresses)
 {
 	if (fnetd->sockfd) {
 		netproc_alive(fnetd->netdevlist);
-		fnetd->netdev_fp = netproc_open();
-		netproc_scandevice(fnetd->sockfd, fnetd->iwsockfd, fnetd->netdev_fp, &fnetd->netdevlist);
-		netproc_close(fnetd->netdev_fp);
+		netproc_scandevice(fnetd->sockfd, fnetd->iwsockfd, sample, addresses, &fnetd->netdevlist);
 	}
 }
 
@@ -127,12 +127,11 @@ g_free_weaknotify(void *ptr, GObject *dummy)
     g_free(ptr);
 }
 
-static GtkWidget *
-wireless_menu(netdev_info *ni)
+/* Fill the menu with the access points, replacing the previous items. */
+static void
+wireless_menu_fill(GtkWidget *menu, netdev_info *ni, APLIST *aplist, gboolean scanning)
 {
-    APLIST *aplist;
     APLIST *ptr;
-    GtkWidget *menu;
     GtkWidget *menu_item;
     GtkWidget *wireless_label;
 
@@ -144,15 +143,9 @@ wireless_menu(netdev_info *ni)
     gdouble quality_per;
     ap_setting *aps;
 
-    /* create menu */
-    menu = gtk_menu_new();
-    g_signal_connect(menu, "selection-done", G_CALLBACK(gtk_widget_destroy), NULL);
+    gtk_container_foreach(GTK_CONTAINER(menu), (GtkCallback)gtk_widget_destroy, NULL);
 
-    /* Scanning AP */
-    aplist = wireless_scanning(ni->ns->fnetd->iwsockfd, ni->netdev_list->info.ifname);
     if (aplist!=NULL) {
-        /* release AP list after menu */
-        g_object_weak_ref(G_OBJECT(menu), wireless_aplist_free, aplist);
         ptr = aplist;
         do {
             /* skip hidden AP with Encryption */
@@ -224,9 +217,12 @@ wireless_menu(netdev_info *ni)
             ptr = ptr->next;
         } while(ptr!=NULL);
     } else {
-        /* we do not found any wireless networks */
+        /* we do not found any wireless networks yet */
         menu_item = gtk_menu_item_new();
-        wireless_label = gtk_label_new(_("Wireless Networks not found in range"));
+        if (scanning)
+            wireless_label = gtk_label_new(_("Scanning for wireless networks..."));
+        else
+            wireless_label = gtk_label_new(_("Wireless Networks not found in range"));
         gtk_label_set_justify(GTK_LABEL(wireless_label), GTK_JUSTIFY_LEFT);
         gtk_widget_set_sensitive(GTK_WIDGET(wireless_label), FALSE);
         gtk_container_add(GTK_CONTAINER(menu_item), wireless_label);
@@ -234,6 +230,51 @@ wireless_menu(netdev_info *ni)
     }
 
     gtk_widget_show_all(menu);
+}
+
+/* Scan finished while the menu is shown: update it in place. */
+static void
+wireless_menu_update(APLIST *aplist, gpointer user_data)
+{
+    GtkWidget *menu = user_data;
+
+    wireless_menu_fill(menu, g_object_get_data(G_OBJECT(menu), "netdev_info"),
+                       aplist, FALSE);
+    gtk_menu_reposition(GTK_MENU(menu));
+}
+
+static void
+wireless_menu_destroyed(void *scan, GObject *menu)
+{
+    wireless_scan_remove_notify(scan, wireless_menu_update, menu);
+}
+
+static GtkWidget *
+wireless_menu(netdev_info *ni)
+{
+    GtkWidget *menu;
+    WirelessScan *scan;
+    gboolean scanning;
+
+    /* create menu */
+    menu = gtk_menu_new();
+    g_signal_connect(menu, "selection-done", G_CALLBACK(gtk_widget_destroy), NULL);
+
+    /* Show cached APs right away, scanning takes seconds and runs in the
+     * background, the menu is updated when it finishes. */
+    if (ni->netdev_list->info.scan == NULL)
+        ni->netdev_list->info.scan = wireless_scan_new(ni->ns->fnetd->iwsockfd,
+                                                       ni->netdev_list->info.ifname);
+    scan = ni->netdev_list->info.scan;
+    scanning = wireless_scan_start(scan);
+    wireless_menu_fill(menu, ni, wireless_scan_get(scan), scanning);
+
+    g_object_set_data(G_OBJECT(menu), "netdev_info", ni);
+    /* the scan is freed with the device, the menu items refer to its
+     * results, so the menu goes away with them */
+    wireless_scan_add_notify(scan, wireless_menu_update,
+                             (GDestroyNotify)gtk_widget_destroy, menu);
+    g_object_weak_ref(G_OBJECT(menu), wireless_menu_destroyed, scan);
 
     return menu;
 }
@@ -430,17 +471,28 @@ static void refresh_systray(netstat *ns, NETDEVLIST_PTR netdev_list)
     } while(ptr!=NULL);
 }
 
-static gboolean refresh_devstat(netstat *ns)
+static void update_devstat(netstat *ns, const LXPanelSample *sample, gboolean addresses)
 {
-    if (g_source_is_destroyed(g_main_current_source()))
-        return FALSE;
-    netproc_listener(ns->fnetd);
+    netproc_listener(ns->fnetd, sample, addresses);
 #ifdef DEBUG
     netproc_print(ns->fnetd->netdevlist);
 #endif
     refresh_systray(ns, ns->fnetd->netdevlist);
     netproc_devicelist_clear(&ns->fnetd->netdevlist);
-    return TRUE;
+}
+
+static void refresh_devstat(const LXPanelSample *sample, gpointer user_data)
+{
+    netstat *ns = user_data;
+
+    /* addresses are polled only if there are no link events */
+    update_devstat(ns, sample, ns->net_watch == 0);
+}
+
+/* A link or address changed: update the list right away and re-read addresses */
+static void devstat_changed(gpointer user_data)
+{
+    update_devstat(user_data, lxpanel_sampler_get(LXPANEL_SAMPLE_NET_DEV), TRUE);
 }
 
 /* Plugin constructor */
@@ -449,7 +501,9 @@ static void netstat_destructor(gpointer user_data)
     netstat *ns = (netstat *) user_data;
 
     ENTER;
-    g_source_remove(ns->ttag);
+    lxpanel_sampler_remove(ns->ttag);
+    if (ns->net_watch)
+        lxpanel_sampler_remove_net_watch(ns->net_watch);
     netproc_netdevlist_clear(&ns->fnetd->netdevlist);
     /* The widget is destroyed in plugin_stop().
     gtk_widget_destroy(ns->mainw);
@@ -492,13 +546,15 @@ static GtkWidget *netstat_constructor(LXPanel *panel, config_setting_t *settings
     gtk_widget_show_all(ns->mainw);
 
     /* Initializing network device list*/
-    ns->fnetd->netdev_fp = netproc_open();
     ns->fnetd->dev_count = netproc_netdevlist_clear(&ns->fnetd->netdevlist);
-    ns->fnetd->dev_count = netproc_scandevice(ns->fnetd->sockfd, ns->fnetd->iwsockfd, ns->fnetd->netdev_fp, &ns->fnetd->netdevlist);
-    netproc_close(ns->fnetd->netdev_fp);
+    ns->fnetd->dev_count = netproc_scandevice(ns->fnetd->sockfd, ns->fnetd->iwsockfd,
+                                              lxpanel_sampler_get(LXPANEL_SAMPLE_NET_DEV),
+                                              TRUE, &ns->fnetd->netdevlist);
     refresh_systray(ns, ns->fnetd->netdevlist);
 
-    ns->ttag = g_timeout_add(NETSTAT_IFACE_POLL_DELAY, (GSourceFunc)refresh_devstat, ns);
+    ns->ttag = lxpanel_sampler_add(LXPANEL_SAMPLE_NET_DEV, NETSTAT_IFACE_POLL_DELAY,
+                                   refresh_devstat, ns);
+    ns->net_watch = lxpanel_sampler_add_net_watch(devstat_changed, ns);
 
     p = gtk_event_box_new();
     lxpanel_plugin_set_data(p, ns, netstat_destructor);
@@ -16,6 +16,7 @@
 
 /* forward declaration for UI interaction. */
 struct statusicon;
+struct wireless_scan;
 
 struct pgui {
     GtkWidget *dlg;
@@ -42,6 +43,7 @@ typedef struct {
 	char *essid;
 	int quality;
 	struct pgui *pg;
+	struct wireless_scan *scan;
 
 	int status;
 	gulong recv_bytes;
@@ -65,7 +67,6 @@ typedef struct {
 	int sockfd;
 	int iwsockfd;
 	GIOChannel *lxnmchannel;
-	FILE *netdev_fp;
 	NETDEVLIST_PTR netdevlist;
 } FNETD;
 
@@ -75,6 +76,7 @@ typedef struct {
     FNETD *fnetd;
     char *fixcmd;
     gint ttag;
+    guint net_watch;
     gboolean use_theme;
 } netstat;
 
@@ -23,10 +23,16 @@
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <sys/time.h>
+#include <errno.h>
 #include <iwlib.h>
 #include "netstat.h"
 #include "wireless.h"
 
+#define WIRELESS_SCAN_TTL        30       /* seconds scan results stay valid */
+#define WIRELESS_SCAN_TIMEOUT    15000    /* ms to wait for scan results */
+#define WIRELESS_SCAN_FIRST_POLL 250      /* ms between trigger and first read */
+#define WIRELESS_SCAN_POLL       100      /* ms between reads while not ready */
+
 /*
 static const char * iw_ie_cypher_name[] = {
     "none",
@@ -260,210 +266,231 @@ wireless_parse_scanning_event(struct iw_event *event, ap_info *oldinfo)
     return info;
 }
 
-/* when we have some workaround problems,
- * we need this function to rescanning access-point.
- * */
-gboolean wireless_refresh(int iwsockfd, const char *ifname)
-{
-	struct iwreq wrq;
+typedef struct {
+	WirelessScanFunc func;
+	GDestroyNotify destroy;
+	gpointer user_data;
+} WirelessScanNotify;
+
+/* Scanning is a state machine driven by a timeout source, so the scan runs
+ * in the driver while the main loop keeps running: trigger the scan, then
+ * try to read the results until they are ready. */
+struct wireless_scan {
+	int iwsockfd;
+	char *ifname;
+	APLIST *aplist;			/* last results */
+	gint64 stamp;			/* monotonic time of last results, 0 if none */
+	guint source;			/* timeout of the scan in progress, 0 if idle */
+	gint64 deadline;		/* monotonic time to give up the scan */
 	struct iw_range range;
-	struct timeval tv;
-	fd_set rfds; /* File descriptors for select */
-	int selfd;
-	char buffer[IW_SCAN_MAX_DATA];
+	unsigned char *buffer;
+	int buflen;
+	GSList *notify;			/* WirelessScanNotify */
+};
 
-	/* setting interfaces name */
-	strncpy(wrq.ifr_name, ifname, IFNAMSIZ);
+static APLIST *wireless_parse_scan(unsigned char *buffer, int len, int we_version)
+{
+	APLIST *ap = NULL;
+	APLIST *newap;
+	struct iw_event iwe;
+	struct stream_descr stream;
+	int ret;
+
+	iw_init_event_stream(&stream, (char *) buffer, len);
+	do {
+		/* Extract an event and parse it */
+		ret = iw_extract_event_stream(&stream, &iwe, we_version);
+		if (ret <= 0)
+			break;
+		if (iwe.cmd==SIOCGIWAP) {
+			newap = g_new0(APLIST, 1);
+			newap->next = ap;
+			ap = newap;
+		} else if (ap == NULL) {
+			/* events before the first AP address */
+			continue;
+		}
+		ap->info = wireless_parse_scanning_event(&iwe, ap->info);
+	}
+	while (ret > 0);
 
-	/* Getting range */
-	iw_get_range_info(iwsockfd, ifname, &range);
+	return ap;
+}
+
+static void wireless_scan_done(WirelessScan *scan, APLIST *aplist)
+{
+	APLIST *old = scan->aplist;
+	GSList *l;
+
+	scan->source = 0;
+	scan->stamp = g_get_monotonic_time();
+	/* keep previous results if the scan failed */
+	if (aplist != NULL)
+		scan->aplist = aplist;
+	for (l = scan->notify; l; ) {
+		WirelessScanNotify *n = l->data;
+
+		/* the callback may remove itself */
+		l = l->next;
+		n->func(scan->aplist, n->user_data);
+	}
+	/* free old results only after users switched to new ones */
+	if (aplist != NULL)
+		wireless_aplist_free(old, NULL);
+}
+
+static gboolean wireless_scan_poll(gpointer user_data)
+{
+	WirelessScan *scan = user_data;
+	struct iwreq wrq;
 
-	/* check scanning support */
-	if (range.we_version_compiled < 14)
+	if (g_source_is_destroyed(g_main_current_source()))
 		return FALSE;
 
-	/* Initiate Scanning */
-	wrq.u.data.pointer = buffer;
-	wrq.u.data.length = IW_SCAN_MAX_DATA;
-	wrq.u.data.flags = 0;
+	for (;;) {
+		/* Try to read the results */
+		wrq.u.data.pointer = scan->buffer;
+		wrq.u.data.flags = 0;
+		wrq.u.data.length = scan->buflen;
+		if (iw_get_ext(scan->iwsockfd, scan->ifname, SIOCGIWSCAN, &wrq) >= 0)
+			break;
 
-	if (ioctl(iwsockfd, SIOCSIWSCAN, &wrq) < 0) {
-		if (errno!=EPERM)
+		/* Check if buffer was too small (WE-17 only) */
+		if ((errno == E2BIG) && (scan->range.we_version_compiled > 16)) {
+			/* Check if the driver gave us any hints. */
+			if (wrq.u.data.length > scan->buflen)
+				scan->buflen = wrq.u.data.length;
+			else
+				scan->buflen *= 2;
+			scan->buffer = g_realloc(scan->buffer, scan->buflen);
+			continue;
+		}
+
+		/* Check if results not available yet */
+		if ((errno == EAGAIN) && (g_get_monotonic_time() < scan->deadline)) {
+			scan->source = g_timeout_add(WIRELESS_SCAN_POLL, wireless_scan_poll, scan);
 			return FALSE;
+		}
+
+		g_warning("netstat: %s: failed to read scan data: %s",
+				  scan->ifname, g_strerror(errno));
+		wireless_scan_done(scan, NULL);
+		return FALSE;
 	}
 
-	/* Init timeout value -> 250ms */
-	tv.tv_sec = 0;
-	tv.tv_usec = 250000;
+	wireless_scan_done(scan, wrq.u.data.length
+			   ? wireless_parse_scan(scan->buffer, wrq.u.data.length,
+						 scan->range.we_version_compiled)
+			   : NULL);
+	return FALSE;
+}
 
-	/* Scanning APs */
-	while(1) {
-		if (ioctl(iwsockfd, SIOCGIWSCAN, &wrq) < 0) {
-			if (errno == EAGAIN) { /* not yet ready */
-				FD_ZERO(&rfds);
-				selfd = -1;
+WirelessScan *wireless_scan_new(int iwsockfd, const char *ifname)
+{
+	WirelessScan *scan = g_new0(WirelessScan, 1);
 
-				if (select(selfd + 1, &rfds, NULL, NULL, &tv)==0)
-					continue; /* timeout */
-			} else {
-				break;
-			}
-		}
+	scan->iwsockfd = iwsockfd;
+	scan->ifname = g_strdup(ifname);
+	return scan;
+}
 
-		if (wrq.u.data.length <= 0)
-			break;
-	}
+void wireless_scan_free(WirelessScan *scan)
+{
+	GSList *notify, *l;
 
-	return TRUE;
+	if (scan == NULL)
+		return;
+	if (scan->source)
+		g_source_remove(scan->source);
+	/* users may hold the results, tell them to drop them; detach the list
+	 * first since they may try to remove their notify in response */
+	notify = scan->notify;
+	scan->notify = NULL;
+	for (l = notify; l; l = l->next) {
+		WirelessScanNotify *n = l->data;
+
+		if (n->destroy)
+			n->destroy(n->user_data);
+		g_free(n);
+	}
+	g_slist_free(notify);
+	wireless_aplist_free(scan->aplist, NULL);
+	g_free(scan->buffer);
+	g_free(scan->ifname);
+	g_free(scan);
 }
 
-APLIST *wireless_scanning(int iwsockfd, const char *ifname)
+APLIST *wireless_scan_get(WirelessScan *scan)
 {
-	APLIST *ap = NULL;
-	APLIST *newap;
+	return scan->aplist;
+}
 
+gboolean wireless_scan_start(WirelessScan *scan)
+{
 	struct iwreq wrq;
-	int scanflags = 0;		/* Flags for scan */
-	unsigned char *	buffer = NULL;	/* Results */
-	int buflen = IW_SCAN_MAX_DATA;	/* Min for compat WE < 17 */
-	struct iw_range	range;
-	int has_range;
-	struct timeval tv;		/* select timeout */
-	int timeout = 15000000;		/* 15s */
+	guint delay = WIRELESS_SCAN_FIRST_POLL;
 
-	/* Get range stuff */
-	has_range = (iw_get_range_info(iwsockfd, ifname, &range) >= 0);
+	if (scan->source)
+		return TRUE;
+	/* cached results are fresh enough */
+	if (scan->stamp != 0 &&
+	    g_get_monotonic_time() - scan->stamp < WIRELESS_SCAN_TTL * G_USEC_PER_SEC)
+		return FALSE;
 
 	/* Check if the interface could support scanning. */
-	if ((!has_range) || (range.we_version_compiled < 14)) {
-		fprintf(stderr, "%-8.16s  Interface doesn't support scanning.\n\n",
-				ifname);
-		return NULL;
+	if (iw_get_range_info(scan->iwsockfd, scan->ifname, &scan->range) < 0 ||
+	    scan->range.we_version_compiled < 14) {
+		g_warning("netstat: %s: interface doesn't support scanning", scan->ifname);
+		scan->stamp = g_get_monotonic_time();
+		return FALSE;
 	}
 
-	/* Init timeout value -> 250ms between set and first get */
-	tv.tv_sec = 0;
-	tv.tv_usec = 250000;
-
+	/* Initiate Scanning */
 	wrq.u.data.pointer = NULL;
 	wrq.u.data.flags = 0;
 	wrq.u.data.length = 0;
-
-	/* Initiate Scanning */
-	if (iw_set_ext(iwsockfd, ifname, SIOCSIWSCAN, &wrq) < 0) {
-		if ((errno != EPERM) || (scanflags != 0)) {
-			fprintf(stderr, "%-8.16s  Interface doesn't support "
-				"scanning : %s\n\n", ifname, strerror(errno));
-			return NULL;
+	if (iw_set_ext(scan->iwsockfd, scan->ifname, SIOCSIWSCAN, &wrq) < 0) {
+		if (errno != EPERM) {
+			g_warning("netstat: %s: interface doesn't support scanning: %s",
+					  scan->ifname, g_strerror(errno));
+			scan->stamp = g_get_monotonic_time();
+			return FALSE;
 		}
-		tv.tv_usec = 0;
+		/* not allowed to scan, read results of the last scan now */
+		delay = 0;
 	}
-	timeout -= tv.tv_usec;
-
-	/* Forever */
-	while (1) {
-		fd_set rfds;		/* File descriptors for select */
-		int last_fd;	/* Last fd */
-		int ret;
-
-		/* Guess what ? We must re-generate rfds each time */
-		FD_ZERO(&rfds);
-		last_fd = -1;
-
-		/* In here, add the rtnetlink fd in the list */
-
-		/* Wait until something happens */
-		ret = select(last_fd + 1, &rfds, NULL, NULL, &tv);
 
-		/* Check if there was an error */
-		if (ret < 0) {
-			if (errno == EAGAIN || errno == EINTR)
-				continue;
-			fprintf(stderr, "Unhandled signal - exiting...\n");
-			return NULL;
-		}
+	if (scan->buffer == NULL) {
+		scan->buflen = IW_SCAN_MAX_DATA; /* Min for compat WE < 17 */
+		scan->buffer = g_malloc(scan->buflen);
+	}
+	scan->deadline = g_get_monotonic_time() + (gint64)WIRELESS_SCAN_TIMEOUT * 1000;
+	scan->source = g_timeout_add(delay, wireless_scan_poll, scan);
+	return TRUE;
+}
 
-		/* Check if there was a timeout */
-		if (ret == 0) {
-			unsigned char *newbuf;
-
-realloc:
-			/* (Re)allocate the buffer - realloc(NULL, len) == malloc(len) */
-			newbuf = realloc(buffer, buflen);
-			if (newbuf == NULL) {
-				if (buffer)
-					free(buffer);
-				fprintf(stderr, "%s: Allocation failed\n", __FUNCTION__);
-				return NULL;
-			}
-			buffer = newbuf;
-
-			/* Try to read the results */
-			wrq.u.data.pointer = buffer;
-			wrq.u.data.flags = 0;
-			wrq.u.data.length = buflen;
-			if (iw_get_ext(iwsockfd, ifname, SIOCGIWSCAN, &wrq) < 0)	{
-				/* Check if buffer was too small (WE-17 only) */
-				if ((errno == E2BIG) &&
-				    (range.we_version_compiled > 16)) {
-					/* Check if the driver gave us any hints. */
-					if (wrq.u.data.length > buflen)
-						buflen = wrq.u.data.length;
-					else
-						buflen *= 2;
-					/* Try again */
-					goto realloc;
-				}
+void wireless_scan_add_notify(WirelessScan *scan, WirelessScanFunc func,
+			      GDestroyNotify destroy, gpointer user_data)
+{
+	WirelessScanNotify *n = g_new(WirelessScanNotify, 1);
 
-				/* Check if results not available yet */
-				if(errno == EAGAIN) {
-					/* Restart timer for only 100ms*/
-					tv.tv_sec = 0;
-					tv.tv_usec = 100000;
-					timeout -= tv.tv_usec;
-					if (timeout > 0)
-						continue; /* Try again later */
-				}
+	n->func = func;
+	n->destroy = destroy;
+	n->user_data = user_data;
+	scan->notify = g_slist_append(scan->notify, n);
+}
 
-				/* Bad error */
-				free(buffer);
-				fprintf(stderr,
-				"%-8.16s  Failed to read scan data : %s\n\n",
-						ifname, strerror(errno));
-				return NULL;
-			}
-			else
-				/* We have the results, go to process them */
-				break;
-		}
+void wireless_scan_remove_notify(WirelessScan *scan, WirelessScanFunc func, gpointer user_data)
+{
+	GSList *l;
 
-		/* In here, check if event and event type
-		 * if scan event, read results. All errors bad & no reset timeout */
-	}
+	for (l = scan->notify; l; l = l->next) {
+		WirelessScanNotify *n = l->data;
 
-	if(wrq.u.data.length) {
-		struct iw_event           iwe;
-		struct stream_descr       stream;
-		int                       ret;
-
-		iw_init_event_stream(&stream, (char *) buffer, wrq.u.data.length);
-		do {
-			/* Extract an event and print it */
-			ret = iw_extract_event_stream(&stream, &iwe, range.we_version_compiled);
-			if (iwe.cmd==SIOCGIWAP) {
-				newap = malloc(sizeof(APLIST));
-				newap->info = NULL;
-				newap->next = ap;
-				ap = newap;
-			}
-			ap->info = wireless_parse_scanning_event(&iwe, ap->info);
+		if (n->func == func && n->user_data == user_data) {
+			scan->notify = g_slist_delete_link(scan->notify, l);
+			g_free(n);
+			return;
 		}
-		while (ret > 0);
-		printf("\n");
 	}
-	else
-		printf("%-8.16s  No scan results\n\n", ifname);
-
-	free(buffer);
-	return ap;
 }
@@ -38,8 +38,21 @@ typedef struct ap_info_node {
 } APLIST;
 
 void wireless_aplist_free(void *aplist, GObject *dummy);
-APLIST *wireless_scanning(int iwsockfd, const char *ifname);
 
-gboolean wireless_refresh(int iwsockfd, const char *ifname);
+/* Asynchronous scan of one interface with cached results. */
+typedef struct wireless_scan WirelessScan;
+typedef void (*WirelessScanFunc)(APLIST *aplist, gpointer user_data);
+
+WirelessScan *wireless_scan_new(int iwsockfd, const char *ifname);
+void wireless_scan_free(WirelessScan *scan);
+/* Last results, owned by scan and valid until the next notification. */
+APLIST *wireless_scan_get(WirelessScan *scan);
+/* Starts a scan unless results are fresh, returns TRUE if one is running. */
+gboolean wireless_scan_start(WirelessScan *scan);
+/* func is called each time a scan finishes, destroy is called if scan is
+ * freed while the notify is still attached, results are invalid then. */
+void wireless_scan_add_notify(WirelessScan *scan, WirelessScanFunc func,
+			      GDestroyNotify destroy, gpointer user_data);
+void wireless_scan_remove_notify(WirelessScan *scan, WirelessScanFunc func, gpointer user_data);
 
 #endif
@@ -40,6 +40,10 @@
 #define NETWORK_CONFIG_TOOL_DIR "/apps/netstatus_applet"
 #define NETWORK_CONFIG_TOOL_KEY NETWORK_CONFIG_TOOL_DIR "/config_tool"
 
+#define RATE_GRAPH_WIDTH    240
+#define RATE_GRAPH_HEIGHT   80
+#define RATE_GRAPH_MIN_PEAK 1024.0 /* bytes per second at full height */
+
 #if 0 /* stripped-down version does nothing to configurators. */
 static const char *network_config_tools[] = {
   "network-admin --configure %i",
@@ -69,6 +73,7 @@ typedef struct
   GtkWidget      *status;
   GtkWidget      *received;
   GtkWidget      *sent;
+  GtkWidget      *rate_graph;
   GtkWidget      *signal_strength_frame;
   GtkWidget      *signal_strength_bar;
   GtkWidget      *signal_strength_label;
@@ -167,27 +172,153 @@ print_bytes_string (GString *str,
     }
 }
 
+static inline void
+print_rate_string (GString *str,
+		   gdouble  rate)
+{
+  if (rate >= 1 << 30)
+    g_string_append_printf (str, _("%.1f GiB/s"), rate / (1 << 30));
+  else if (rate >= 1 << 20)
+    g_string_append_printf (str, _("%.1f MiB/s"), rate / (1 << 20));
+  else if (rate >= 1 << 10)
+    g_string_append_printf (str, _("%.1f KiB/s"), rate / (1 << 10));
+  else
+    g_string_append_printf (str, _("%.0f B/s"), rate);
+}
+
 static void
 netstatus_dialog_update_activity (NetstatusDialogData *data)
 {
   NetstatusStats  stats = { 0, };
   GString        *str;
+  gdouble         in_rate, out_rate;
+  gboolean        have_rates;
 
   netstatus_iface_get_statistics (data->iface, &stats);
+  have_rates = netstatus_rate_history_get (netstatus_iface_get_rate_history (data->iface),
+					   0, NULL, &in_rate, &out_rate);
 
   str = g_string_new (NULL);
 
   print_packets_string (str, stats.out_packets);
   print_bytes_string (str, stats.out_bytes);
+  if (have_rates)
+    {
+      g_string_append (str, ", ");
+      print_rate_string (str, out_rate);
+    }
   gtk_label_set_text (GTK_LABEL (data->sent), str->str);
 
   print_packets_string (str, stats.in_packets);
   print_bytes_string (str, stats.in_bytes);
+  if (have_rates)
+    {
+      g_string_append (str, ", ");
+      print_rate_string (str, in_rate);
+    }
   gtk_label_set_text (GTK_LABEL (data->received), str->str);
 
   g_string_free (str, TRUE);
 }
 
+/* Draws the whole rate history: received bytes filled, sent bytes as a
+ * line on top, scaled to the peak of the history.
+ */
+static void
+netstatus_dialog_draw_rates (NetstatusDialogData *data,
+			     cairo_t             *cr,
+			     int                  width,
+			     int                  height)
+{
+  const NetstatusRateHistory *rates;
+  GString                    *str;
+  gint64                      newest, time;
+  gdouble                     in_rate, out_rate;
+  gdouble                     peak, scale, x, y;
+  guint                       age;
+
+  cairo_set_source_rgb (cr, 0.0, 0.0, 0.0);
+  cairo_rectangle (cr, 0, 0, width, height);
+  cairo_fill (cr);
+
+  rates = netstatus_iface_get_rate_history (data->iface);
+  if (!netstatus_rate_history_get (rates, 0, &newest, NULL, NULL))
+    return;
+
+  peak  = MAX (netstatus_rate_history_get_peak (rates), RATE_GRAPH_MIN_PEAK);
+  scale = (gdouble) width / NETSTATUS_RATE_HISTORY_LENGTH / G_USEC_PER_SEC;
+
+  /* received */
+  x = width;
+  cairo_move_to (cr, x, height);
+  for (age = 0; netstatus_rate_history_get (rates, age, &time, &in_rate, NULL); age++)
+    {
+      x = width - (newest - time) * scale;
+      if (x < 0)
+	break;
+      cairo_line_to (cr, x, height - in_rate / peak * (height - 1));
+    }
+  cairo_line_to (cr, MAX (x, 0), height);
+  cairo_close_path (cr);
+  cairo_set_source_rgba (cr, 0.31, 0.60, 0.02, 0.8);
+  cairo_fill (cr);
+
+  /* sent */
+  for (age = 0; netstatus_rate_history_get (rates, age, &time, NULL, &out_rate); age++)
+    {
+      x = width - (newest - time) * scale;
+      if (x < 0)
+	break;
+      y = height - 0.5 - out_rate / peak * (height - 1);
+      if (age == 0)
+	cairo_move_to (cr, x, y);
+      else
+	cairo_line_to (cr, x, y);
+    }
+  cairo_set_line_width (cr, 1.5);
+  cairo_set_source_rgb (cr, 0.80, 0.00, 0.00);
+  cairo_stroke (cr);
+
+  str = g_string_new (NULL);
+  print_rate_string (str, peak);
+  cairo_set_source_rgb (cr, 0.8, 0.8, 0.8);
+  cairo_move_to (cr, 4, 12);
+  cairo_show_text (cr, str->str);
+  g_string_free (str, TRUE);
+}
+
+#if GTK_CHECK_VERSION(3, 0, 0)
+static gboolean
+netstatus_dialog_rate_graph_draw (GtkWidget           *widget,
+				  cairo_t             *cr,
+				  NetstatusDialogData *data)
+{
+  netstatus_dialog_draw_rates (data, cr,
+			       gtk_widget_get_allocated_width (widget),
+			       gtk_widget_get_allocated_height (widget));
+  return FALSE;
+}
+#else
+static gboolean
+netstatus_dialog_rate_graph_expose_event (GtkWidget           *widget,
+					  GdkEventExpose      *event,
+					  NetstatusDialogData *data)
+{
+  GtkAllocation  allocation;
+  cairo_t       *cr;
+
+  gtk_widget_get_allocation (widget, &allocation);
+
+  cr = gdk_cairo_create (gtk_widget_get_window (widget));
+  gdk_cairo_region (cr, event->region);
+  cairo_clip (cr);
+  netstatus_dialog_draw_rates (data, cr, allocation.width, allocation.height);
+  cairo_destroy (cr);
+
+  return FALSE;
+}
+#endif
+
 static void
 netstatus_dialog_update_signal_strength (NetstatusDialogData *data)
 {
@@ -353,6 +484,15 @@ netstatus_dialog_iface_stats_changed (NetstatusIface      *iface,
   netstatus_dialog_update_activity (data);
 }
 
+static void
+netstatus_dialog_iface_rates_changed (NetstatusIface      *iface,
+				      GParamSpec          *pspec,
+				      NetstatusDialogData *data)
+{
+  netstatus_dialog_update_activity (data);
+  gtk_widget_queue_draw (data->rate_graph);
+}
+
 static void
 netstatus_dialog_iface_signal_strength_changed (NetstatusIface      *iface,
 						GParamSpec          *pspec,
@@ -679,6 +819,19 @@ netstatus_dialog_setup_activity (NetstatusDialogData *data)
   data->sent     = (GtkWidget*)gtk_builder_get_object(data->builder, "sent_label");
   data->received = (GtkWidget*)gtk_builder_get_object(data->builder, "received_label");
 
+  data->rate_graph = gtk_drawing_area_new ();
+  gtk_widget_set_size_request (data->rate_graph, RATE_GRAPH_WIDTH, RATE_GRAPH_HEIGHT);
+#if GTK_CHECK_VERSION(3, 0, 0)
+  g_signal_connect (data->rate_graph, "draw",
+		    G_CALLBACK (netstatus_dialog_rate_graph_draw), data);
+#else
+  g_signal_connect (data->rate_graph, "expose-event",
+		    G_CALLBACK (netstatus_dialog_rate_graph_expose_event), data);
+#endif
+  gtk_box_pack_start (GTK_BOX (gtk_builder_get_object (data->builder, "activity_frame")),
+		      data->rate_graph, FALSE, FALSE, 0);
+  gtk_widget_show (data->rate_graph);
+
   netstatus_dialog_update_activity (data);
 }
 
@@ -815,6 +968,12 @@ netstatus_dialog_new (NetstatusIface *iface)
 					data,
 					data->dialog);
 
+  netstatus_connect_signal_while_alive (data->iface,
+					"notify::rates",
+					G_CALLBACK (netstatus_dialog_iface_rates_changed),
+					data,
+					data->dialog);
+
   netstatus_connect_signal_while_alive (data->iface,
 					"notify::name",
 					G_CALLBACK (netstatus_dialog_iface_name_changed),
@@ -33,6 +33,8 @@
 
 #include "gtk-compat.h"
 
+#define NETSTATUS_ICON_GRAPH_MIN_PEAK 1024.0 /* bytes per second at full height */
+
 typedef enum
 {
   NETSTATUS_SIGNAL_0_24 = 0,
@@ -46,6 +48,7 @@ struct _NetstatusIconPrivate
 {
   GtkWidget      *image;
   GtkWidget      *signal_image;
+  GtkWidget      *graph;
   GtkWidget      *error_dialog;
 
   NetstatusIface *iface;
@@ -69,9 +72,11 @@ struct _NetstatusIconPrivate
   gulong          name_changed_id;
   gulong          wireless_changed_id;
   gulong          signal_changed_id;
+  gulong          rates_changed_id;
 
   guint           tooltips_enabled : 1;
   guint           show_signal : 1;
+  guint           show_graph : 1;
 };
 
 enum {
@@ -456,6 +461,106 @@ netstatus_icon_signal_changed (NetstatusIface *iface,
     }
 }
 
+static void
+netstatus_icon_rates_changed (NetstatusIface *iface __attribute__((unused)),
+			      GParamSpec     *pspec __attribute__((unused)),
+			      NetstatusIcon  *icon)
+{
+  if (icon->priv->show_graph)
+    gtk_widget_queue_draw (icon->priv->graph);
+}
+
+/* Draws the received and sent rates as two lines, one pixel per second
+ * with the newest sample at the right edge. */
+static void
+netstatus_icon_draw_rates (NetstatusIcon *icon,
+			   cairo_t       *cr,
+			   int            width,
+			   int            height)
+{
+  const NetstatusRateHistory *rates;
+  gint64                      newest, time;
+  gdouble                     in_rate, out_rate;
+  gdouble                     peak, x, y;
+  guint                       age;
+  int                         sent;
+
+  rates = netstatus_iface_get_rate_history (icon->priv->iface);
+  if (!netstatus_rate_history_get (rates, 0, &newest, NULL, NULL))
+    return;
+
+  peak = MAX (netstatus_rate_history_get_peak (rates), NETSTATUS_ICON_GRAPH_MIN_PEAK);
+
+  cairo_set_line_width (cr, 1.0);
+
+  for (sent = 0; sent < 2; sent++)
+    {
+      if (sent)
+	cairo_set_source_rgb (cr, 0.80, 0.00, 0.00);
+      else
+	cairo_set_source_rgb (cr, 0.31, 0.60, 0.02);
+
+      for (age = 0; netstatus_rate_history_get (rates, age, &time, &in_rate, &out_rate); age++)
+	{
+	  x = width - 0.5 - (gdouble) (newest - time) / G_USEC_PER_SEC;
+	  if (x < 0)
+	    break;
+	  y = height - 0.5 - (sent ? out_rate : in_rate) / peak * (height - 1);
+
+	  if (age == 0)
+	    cairo_move_to (cr, x, y);
+	  else
+	    cairo_line_to (cr, x, y);
+	}
+
+      cairo_stroke (cr);
+    }
+}
+
+#if GTK_CHECK_VERSION(3, 0, 0)
+static gboolean
+netstatus_icon_graph_draw (GtkWidget     *widget,
+			   cairo_t       *cr,
+			   NetstatusIcon *icon)
+{
+  netstatus_icon_draw_rates (icon, cr,
+			     gtk_widget_get_allocated_width (widget),
+			     gtk_widget_get_allocated_height (widget));
+  return FALSE;
+}
+#else
+static gboolean
+netstatus_icon_graph_expose_event (GtkWidget      *widget,
+				   GdkEventExpose *event,
+				   NetstatusIcon  *icon)
+{
+  GtkAllocation  allocation;
+  cairo_t       *cr;
+
+  gtk_widget_get_allocation (widget, &allocation);
+
+  cr = gdk_cairo_create (gtk_widget_get_window (widget));
+  gdk_cairo_region (cr, event->region);
+  cairo_clip (cr);
+  netstatus_icon_draw_rates (icon, cr, allocation.width, allocation.height);
+  cairo_destroy (cr);
+
+  return FALSE;
+}
+#endif
+
+static void
+netstatus_icon_update_graph_size (NetstatusIcon *icon)
+{
+  if (icon->priv->size <= 1)
+    return;
+
+  if (icon->priv->orientation == GTK_ORIENTATION_HORIZONTAL)
+    gtk_widget_set_size_request (icon->priv->graph, icon->priv->size, -1);
+  else
+    gtk_widget_set_size_request (icon->priv->graph, -1, icon->priv->size);
+}
+
 static void
 #if GTK_CHECK_VERSION(3, 0, 0)
 netstatus_icon_destroy (GtkWidget *widget)
@@ -481,13 +586,17 @@ netstatus_icon_destroy (GtkObject *widget)
 				   icon->priv->wireless_changed_id);
       g_signal_handler_disconnect (icon->priv->iface,
 				   icon->priv->signal_changed_id);
+      g_signal_handler_disconnect (icon->priv->iface,
+				   icon->priv->rates_changed_id);
     }
   icon->priv->state_changed_id    = 0;
   icon->priv->name_changed_id     = 0;
   icon->priv->wireless_changed_id = 0;
   icon->priv->signal_changed_id   = 0;
+  icon->priv->rates_changed_id    = 0;
 
   icon->priv->image = NULL;
+  icon->priv->graph = NULL;
 
 #if GTK_CHECK_VERSION(3, 0, 0)
   GTK_WIDGET_CLASS (parent_class)->destroy (widget);
@@ -640,6 +749,7 @@ netstatus_icon_size_allocate (GtkWidget     *widget,
       icon->priv->size = size;
 
       netstatus_icon_scale_icons (icon, size);
+      netstatus_icon_update_graph_size (icon);
     }
 
   if (gtk_widget_get_realized(widget))
@@ -923,6 +1033,17 @@ netstatus_icon_instance_init (NetstatusIcon      *icon,
   gtk_container_add (GTK_CONTAINER (icon), icon->priv->signal_image);
   gtk_widget_hide (icon->priv->signal_image);
 
+  icon->priv->graph = gtk_drawing_area_new ();
+  gtk_container_add (GTK_CONTAINER (icon), icon->priv->graph);
+#if GTK_CHECK_VERSION(3, 0, 0)
+  g_signal_connect (icon->priv->graph, "draw",
+		    G_CALLBACK (netstatus_icon_graph_draw), icon);
+#else
+  g_signal_connect (icon->priv->graph, "expose-event",
+		    G_CALLBACK (netstatus_icon_graph_expose_event), icon);
+#endif
+  gtk_widget_hide (icon->priv->graph);
+
   gtk_widget_add_events (GTK_WIDGET (icon),
 			 GDK_BUTTON_PRESS_MASK | GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK);
 }
@@ -1034,6 +1155,8 @@ netstatus_icon_set_iface (NetstatusIcon  *icon,
 				       icon->priv->wireless_changed_id);
 	  g_signal_handler_disconnect (icon->priv->iface,
 				       icon->priv->signal_changed_id);
+	  g_signal_handler_disconnect (icon->priv->iface,
+				       icon->priv->rates_changed_id);
 	}
 
       if (iface)
@@ -1051,11 +1174,14 @@ netstatus_icon_set_iface (NetstatusIcon  *icon,
 							   G_CALLBACK (netstatus_icon_is_wireless_changed), icon);
       icon->priv->signal_changed_id    = g_signal_connect (icon->priv->iface, "notify::signal-strength",
 							   G_CALLBACK (netstatus_icon_signal_changed), icon);
+      icon->priv->rates_changed_id     = g_signal_connect (icon->priv->iface, "notify::rates",
+							   G_CALLBACK (netstatus_icon_rates_changed), icon);
 
       netstatus_icon_state_changed       (icon->priv->iface, NULL, icon);
       netstatus_icon_name_changed        (icon->priv->iface, NULL, icon);
       netstatus_icon_is_wireless_changed (icon->priv->iface, NULL, icon);
       netstatus_icon_signal_changed      (icon->priv->iface, NULL, icon);
+      netstatus_icon_rates_changed       (icon->priv->iface, NULL, icon);
 
       /* g_object_notify (G_OBJECT (icon), "iface"); */
     }
@@ -1150,3 +1276,30 @@ netstatus_icon_get_show_signal (NetstatusIcon *icon)
 
   return icon->priv->show_signal;
 }
+
+void
+netstatus_icon_set_show_graph (NetstatusIcon *icon,
+			       gboolean       show_graph)
+{
+  g_return_if_fail (NETSTATUS_IS_ICON (icon));
+
+  show_graph = show_graph != FALSE;
+
+  if (icon->priv->show_graph != show_graph)
+    {
+      icon->priv->show_graph = show_graph;
+
+      if (show_graph)
+	gtk_widget_show (icon->priv->graph);
+      else
+	gtk_widget_hide (icon->priv->graph);
+    }
+}
+
+gboolean
+netstatus_icon_get_show_graph (NetstatusIcon *icon)
+{
+  g_return_val_if_fail (NETSTATUS_IS_ICON (icon), FALSE);
+
+  return icon->priv->show_graph;
+}
@@ -76,6 +76,10 @@ void            netstatus_icon_set_show_signal      (NetstatusIcon  *icon,
 						     gboolean        show_signal);
 gboolean        netstatus_icon_get_show_signal      (NetstatusIcon  *icon);
 
+void            netstatus_icon_set_show_graph       (NetstatusIcon  *icon,
+						     gboolean        show_graph);
+gboolean        netstatus_icon_get_show_graph       (NetstatusIcon  *icon);
+
 G_END_DECLS
 
 #endif /* __NETSTATUS_ICON_H__ */
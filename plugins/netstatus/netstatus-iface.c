@@ -50,10 +50,13 @@
 
 #include "netstatus-sysdeps.h"
 #include "netstatus-enums.h"
+#include "sampler.h"
 
 #define NETSTATUS_IFACE_POLL_DELAY       500  /* milliseconds between polls */
 #define NETSTATUS_IFACE_POLLS_IN_ERROR   10   /* no. of polls in error before increasing delay */
 #define NETSTATUS_IFACE_ERROR_POLL_DELAY 5000 /* delay to use when in error state */
+#define NETSTATUS_IFACE_RATE_PERIOD      (G_USEC_PER_SEC - NETSTATUS_IFACE_POLL_DELAY * 1000 / 2)
+                                              /* shortest time between rate samples */
 
 enum
 {
@@ -61,6 +64,7 @@ enum
   PROP_NAME,
   PROP_STATE,
   PROP_STATS,
+  PROP_RATES,
   PROP_WIRELESS,
   PROP_SIGNAL_STRENGTH,
   PROP_ERROR
@@ -75,11 +79,18 @@ struct _NetstatusIfacePrivate
   int             signal_strength;
   GError         *error;
 
+  NetstatusRateHistory rates;
+  guint64         rate_in_bytes;
+  guint64         rate_out_bytes;
+  gint64          rate_time;
+
   int             sockfd;
   guint           monitor_id;
+  guint           net_watch_id;
 
   guint           error_polling : 1;
   guint           is_wireless : 1;
+  guint           rate_bytes_valid : 1;
 };
 
 static void     netstatus_iface_instance_init   (NetstatusIface      *iface,
@@ -94,7 +105,9 @@ static void     netstatus_iface_get_property    (GObject             *object,
 						 guint                property_id,
 						 GValue              *value,
 						 GParamSpec          *pspec);
-static gboolean netstatus_iface_monitor_timeout (NetstatusIface      *iface);
+static void     netstatus_iface_monitor_timeout (const LXPanelSample *sample,
+						 gpointer             data);
+static void     netstatus_iface_net_changed     (gpointer             data);
 static void     netstatus_iface_init_monitor    (NetstatusIface      *iface);
 
 static GObjectClass *parent_class;
@@ -167,6 +180,13 @@ netstatus_iface_class_init (NetstatusIfaceClass *klass)
 						       NETSTATUS_TYPE_STATS,
 						       G_PARAM_READABLE));
 
+  g_object_class_install_property (gobject_class,
+				   PROP_RATES,
+				   g_param_spec_pointer ("rates",
+							 _("Rates"),
+							 _("History of the interface byte rates"),
+							 G_PARAM_READABLE));
+
   g_object_class_install_property (gobject_class,
 				   PROP_WIRELESS,
 				   g_param_spec_boolean ("wireless",
@@ -204,9 +224,13 @@ netstatus_iface_finalize (GObject *object)
   iface->priv->error = NULL;
 
   if (iface->priv->monitor_id)
-    g_source_remove (iface->priv->monitor_id);
+    lxpanel_sampler_remove (iface->priv->monitor_id);
   iface->priv->monitor_id = 0;
 
+  if (iface->priv->net_watch_id)
+    lxpanel_sampler_remove_net_watch (iface->priv->net_watch_id);
+  iface->priv->net_watch_id = 0;
+
   if (iface->priv->sockfd)
     close (iface->priv->sockfd);
   iface->priv->sockfd = 0;
@@ -261,6 +285,9 @@ netstatus_iface_get_property (GObject    *object,
     case PROP_STATS:
       g_value_set_boxed (value, &iface->priv->stats);
       break;
+    case PROP_RATES:
+      g_value_set_pointer (value, &iface->priv->rates);
+      break;
     case PROP_WIRELESS:
       g_value_set_boolean (value, iface->priv->is_wireless);
       break;
@@ -334,6 +361,14 @@ netstatus_iface_get_statistics (NetstatusIface *iface,
     *stats  = iface->priv->stats;
 }
 
+const NetstatusRateHistory *
+netstatus_iface_get_rate_history (NetstatusIface *iface)
+{
+  g_return_val_if_fail (NETSTATUS_IS_IFACE (iface), NULL);
+
+  return &iface->priv->rates;
+}
+
 gboolean
 netstatus_iface_get_is_wireless (NetstatusIface *iface)
 {
@@ -479,18 +514,36 @@ netstatus_iface_poll_iface_statistics (NetstatusIface *iface,
   return TRUE;
 }
 
-static NetstatusState
-netstatus_iface_poll_state (NetstatusIface *iface)
+/* Reads the interface flags from the shared rtnetlink link dump when it is
+ * available, which is read once per tick for all interfaces, and with an
+ * ioctl otherwise. */
+static gboolean
+netstatus_iface_poll_flags (NetstatusIface *iface,
+			    guint          *flags)
 {
-  NetstatusState state;
-  struct ifreq   if_req;
-  gboolean       tx, rx;
-  int            fd;
-  gulong         in_packets, out_packets;
-  gulong         in_bytes, out_bytes;
+  const LXPanelSample    *sample;
+  const LXPanelNetDevice *dev;
+  struct ifreq            if_req;
+  int                     fd;
+
+  sample = lxpanel_sampler_get (LXPANEL_SAMPLE_NET_LINK);
+  if (sample->sources & LXPANEL_SAMPLE_NET_LINK)
+    {
+      dev = lxpanel_sample_find_net_device (sample, iface->priv->name);
+      if (!dev)
+	{
+	  netstatus_iface_set_polling_error (iface,
+					     NETSTATUS_ERROR_IOCTL_IFFLAGS,
+					     _("SIOCGIFFLAGS error: %s"),
+					     g_strerror (ENODEV));
+	  return FALSE;
+	}
+      *flags = dev->flags;
+      return TRUE;
+    }
 
   if (!(fd = netstatus_iface_get_sockfd (iface)))
-    return NETSTATUS_STATE_DISCONNECTED;
+    return FALSE;
 
   memset (&if_req, 0, sizeof (struct ifreq));
   strcpy (if_req.ifr_name, iface->priv->name);
@@ -501,20 +554,93 @@ netstatus_iface_poll_state (NetstatusIface *iface)
 					 NETSTATUS_ERROR_IOCTL_IFFLAGS,
 					 _("SIOCGIFFLAGS error: %s"),
 					 g_strerror (errno));
+      return FALSE;
+    }
+
+  *flags = if_req.ifr_flags;
+  return TRUE;
+}
+
+/* Adds a sample to the rate history about once a second. The rate is
+ * zero while the byte counters can't be read, e.g. the interface is down.
+ */
+static void
+netstatus_iface_sample_rates (NetstatusIface *iface,
+			      gboolean        have_bytes,
+			      guint64         in_bytes,
+			      guint64         out_bytes)
+{
+  gint64  now;
+  gdouble elapsed;
+  gdouble in_rate = 0, out_rate = 0;
+
+  now = g_get_monotonic_time ();
+
+  if (iface->priv->rate_time &&
+      now - iface->priv->rate_time < NETSTATUS_IFACE_RATE_PERIOD)
+    return;
+
+  if (have_bytes)
+    {
+      if (iface->priv->rate_time && iface->priv->rate_bytes_valid)
+	{
+	  elapsed  = (gdouble) (now - iface->priv->rate_time) / G_USEC_PER_SEC;
+	  in_rate  = netstatus_counter_delta (iface->priv->rate_in_bytes, in_bytes) / elapsed;
+	  out_rate = netstatus_counter_delta (iface->priv->rate_out_bytes, out_bytes) / elapsed;
+	}
+
+      iface->priv->rate_in_bytes    = in_bytes;
+      iface->priv->rate_out_bytes   = out_bytes;
+      iface->priv->rate_bytes_valid = TRUE;
+    }
+
+  if (!iface->priv->rate_time)
+    {
+      /* no interval to measure yet */
+      iface->priv->rate_time = now;
+      return;
+    }
+
+  iface->priv->rate_time = now;
+  netstatus_rate_history_push (&iface->priv->rates, now, in_rate, out_rate);
+
+  g_object_notify (G_OBJECT (iface), "rates");
+}
+
+static NetstatusState
+netstatus_iface_poll_state (NetstatusIface *iface)
+{
+  NetstatusState state;
+  guint          flags;
+  gboolean       tx, rx;
+  gulong         in_packets, out_packets;
+  gulong         in_bytes, out_bytes;
+
+  if (!netstatus_iface_poll_flags (iface, &flags))
+    {
+      netstatus_iface_sample_rates (iface, FALSE, 0, 0);
       return NETSTATUS_STATE_DISCONNECTED;
     }
 
   netstatus_iface_clear_error (iface, NETSTATUS_ERROR_IOCTL_IFFLAGS);
 
   dprintf (POLLING, "Interface is %sup and %srunning\n",
-	   if_req.ifr_flags & IFF_UP ? "" : "not ",
-	   if_req.ifr_flags & IFF_RUNNING ? "" : "not ");
+	   flags & IFF_UP ? "" : "not ",
+	   flags & IFF_RUNNING ? "" : "not ");
 
-  if (!(if_req.ifr_flags & IFF_UP) || !(if_req.ifr_flags & IFF_RUNNING))
-    return NETSTATUS_STATE_DISCONNECTED;
+  if (!(flags & IFF_UP) || !(flags & IFF_RUNNING))
+    {
+      netstatus_iface_sample_rates (iface, FALSE, 0, 0);
+      return NETSTATUS_STATE_DISCONNECTED;
+    }
 
   if (!netstatus_iface_poll_iface_statistics (iface, &in_packets, &out_packets, &in_bytes, &out_bytes))
-    return NETSTATUS_STATE_IDLE;
+    {
+      netstatus_iface_sample_rates (iface, FALSE, 0, 0);
+      return NETSTATUS_STATE_IDLE;
+    }
+
+  netstatus_iface_sample_rates (iface, TRUE, in_bytes, out_bytes);
 
   dprintf (POLLING, "Packets in: %ld out: %ld. Prev in: %ld out: %ld\n",
 	   in_packets, out_packets,
@@ -590,10 +716,10 @@ netstatus_iface_increase_poll_delay_in_error (NetstatusIface *iface)
 	{
 	  dprintf (POLLING, "Increasing polling delay after too many errors\n");
 	  iface->priv->error_polling = TRUE;
-	  g_source_remove (iface->priv->monitor_id);
-	  iface->priv->monitor_id = g_timeout_add (NETSTATUS_IFACE_ERROR_POLL_DELAY,
-						   (GSourceFunc) netstatus_iface_monitor_timeout,
-						   iface);
+	  lxpanel_sampler_remove (iface->priv->monitor_id);
+	  iface->priv->monitor_id = lxpanel_sampler_add (0, NETSTATUS_IFACE_ERROR_POLL_DELAY,
+							 netstatus_iface_monitor_timeout,
+							 iface);
 	}
     }
   else if (iface->priv->error_polling)
@@ -603,22 +729,23 @@ netstatus_iface_increase_poll_delay_in_error (NetstatusIface *iface)
       iface->priv->error_polling = FALSE;
       polls_in_error = 0;
 
-      g_source_remove (iface->priv->monitor_id);
-      iface->priv->monitor_id = g_timeout_add (NETSTATUS_IFACE_POLL_DELAY,
-					       (GSourceFunc) netstatus_iface_monitor_timeout,
-					       iface);
+      lxpanel_sampler_remove (iface->priv->monitor_id);
+      iface->priv->monitor_id = lxpanel_sampler_add (0, NETSTATUS_IFACE_POLL_DELAY,
+						     netstatus_iface_monitor_timeout,
+						     iface);
     }
 }
 
-static gboolean
-netstatus_iface_monitor_timeout (NetstatusIface *iface)
+/* Interfaces share the sampler timer so /proc/net/dev is read only once
+ * per tick for all of them. */
+static void
+netstatus_iface_monitor_timeout (const LXPanelSample *sample,
+				 gpointer             data)
 {
-  NetstatusState state;
-  int            signal_strength;
-  gboolean       is_wireless;
-
-  if (g_source_is_destroyed(g_main_current_source()))
-    return FALSE;
+  NetstatusIface *iface = data;
+  NetstatusState  state;
+  int             signal_strength;
+  gboolean        is_wireless;
 
   state = netstatus_iface_poll_state (iface);
 
@@ -643,8 +770,14 @@ netstatus_iface_monitor_timeout (NetstatusIface *iface)
     }
 
   netstatus_iface_increase_poll_delay_in_error (iface);
+}
 
-  return TRUE;
+/* Link and address changes are reported by rtnetlink as they happen,
+ * poll right away instead of waiting for the next tick. */
+static void
+netstatus_iface_net_changed (gpointer data)
+{
+  netstatus_iface_monitor_timeout (NULL, data);
 }
 
 static void
@@ -656,9 +789,13 @@ netstatus_iface_init_monitor (NetstatusIface *iface)
   iface->priv->stats.out_bytes   = 0;
   iface->priv->signal_strength   = 0;
   iface->priv->is_wireless       = FALSE;
+  iface->priv->rate_time         = 0;
+  iface->priv->rate_bytes_valid  = FALSE;
+  netstatus_rate_history_clear (&iface->priv->rates);
 
   g_object_freeze_notify (G_OBJECT (iface));
   g_object_notify (G_OBJECT (iface), "state");
+  g_object_notify (G_OBJECT (iface), "rates");
   g_object_notify (G_OBJECT (iface), "wireless");
   g_object_notify (G_OBJECT (iface), "signal-strength");
   g_object_thaw_notify (G_OBJECT (iface));
@@ -666,18 +803,26 @@ netstatus_iface_init_monitor (NetstatusIface *iface)
   if (iface->priv->monitor_id)
     {
       dprintf (POLLING, "Removing existing monitor\n");
-      g_source_remove (iface->priv->monitor_id);
+      lxpanel_sampler_remove (iface->priv->monitor_id);
       iface->priv->monitor_id = 0;
     }
 
+  if (iface->priv->net_watch_id)
+    {
+      lxpanel_sampler_remove_net_watch (iface->priv->net_watch_id);
+      iface->priv->net_watch_id = 0;
+    }
+
   if (iface->priv->name)
     {
       dprintf (POLLING, "Initialising monitor with delay of %d\n", NETSTATUS_IFACE_POLL_DELAY);
-      iface->priv->monitor_id = g_timeout_add (NETSTATUS_IFACE_POLL_DELAY,
-					       (GSourceFunc) netstatus_iface_monitor_timeout,
-					       iface);
+      iface->priv->monitor_id = lxpanel_sampler_add (0, NETSTATUS_IFACE_POLL_DELAY,
+						     netstatus_iface_monitor_timeout,
+						     iface);
+      iface->priv->net_watch_id = lxpanel_sampler_add_net_watch (netstatus_iface_net_changed,
+								 iface);
 
-      /* netstatus_iface_monitor_timeout (iface); */
+      /* netstatus_iface_monitor_timeout (NULL, iface); */
     }
 }
 
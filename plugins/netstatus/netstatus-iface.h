@@ -67,6 +67,8 @@ void                   netstatus_iface_set_name              (NetstatusIface  *i
 NetstatusState         netstatus_iface_get_state             (NetstatusIface  *iface);
 void                   netstatus_iface_get_statistics        (NetstatusIface  *iface,
 							      NetstatusStats  *stats);
+const NetstatusRateHistory *
+                       netstatus_iface_get_rate_history      (NetstatusIface  *iface);
 gboolean               netstatus_iface_get_is_wireless       (NetstatusIface  *iface);
 int                    netstatus_iface_get_signal_strength   (NetstatusIface  *iface);
 
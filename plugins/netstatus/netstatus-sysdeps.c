@@ -43,6 +43,8 @@
 #include <net/if_var.h>
 #include <dev/an/if_aironet_ieee.h>
 #include <dev/wi/if_wavelan_ieee.h>
+#else
+#include "sampler.h"
 #endif
 
 static inline gboolean
@@ -106,51 +108,6 @@ parse_iface_name (const char *buf)
   return NULL;
 }
 
-static inline void
-parse_stats_header (char *buf,
-		    int  *prx_idx,
-		    int  *ptx_idx,
-		    int  *brx_idx,
-		    int  *btx_idx)
-{
-  char *p;
-  int   i;
-
-  *prx_idx = *ptx_idx = -1;
-  *brx_idx = *btx_idx = -1;
-
-  p = strtok (buf, "| \t\n");
-  p = strtok (NULL, "| \t\n"); /* Skip the first one */
-  for (i = 0; p; i++, p = strtok (NULL, "| \t\n"))
-    {
-      if (!strcmp (p, "packets"))
-	{
-	  if (*prx_idx == -1)
-	    *prx_idx = i;
-	  else
-	    *ptx_idx = i;
-	}
-      else if (!strcmp (p, "bytes"))
-	{
-	  if (*brx_idx == -1)
-	    *brx_idx = i;
-	  else
-	    *btx_idx = i;
-	}
-    }
-}
-
-static inline FILE *
-get_proc_net_dev_fh (void)
-{
-  static FILE *retval = NULL;
-
-  if (retval != NULL)
-    return retval;
-
-  return retval = fopen ("/proc/net/dev", "r");
-}
-
 char *
 netstatus_sysdeps_read_iface_statistics (const char  *iface,
 					 gulong      *in_packets,
@@ -158,11 +115,8 @@ netstatus_sysdeps_read_iface_statistics (const char  *iface,
 					 gulong      *in_bytes,
 					 gulong      *out_bytes)
 {
-  FILE *fh;
-  char  buf [512];
-  int   prx_idx, ptx_idx;
-  int   brx_idx, btx_idx;
-  char *error_message = NULL;
+  const LXPanelSample    *sample;
+  const LXPanelNetDevice *dev;
 
   g_return_val_if_fail (iface != NULL, NULL);
   g_return_val_if_fail (in_packets != NULL, NULL);
@@ -175,62 +129,21 @@ netstatus_sysdeps_read_iface_statistics (const char  *iface,
   *in_bytes    = -1;
   *out_bytes   = -1;
 
-  fh = get_proc_net_dev_fh ();
-  if (!fh)
-    return g_strdup_printf (_("Cannot open /proc/net/dev: %s"),
-			    g_strerror (errno));
-
-  if (fgets (buf, sizeof (buf), fh) == NULL ||
-      fgets (buf, sizeof (buf), fh) == NULL)
+  /* /proc/net/dev is read once per tick for all interfaces by the sampler */
+  sample = lxpanel_sampler_get (LXPANEL_SAMPLE_NET_DEV);
+  if (!(sample->sources & LXPANEL_SAMPLE_NET_DEV))
     return g_strdup (_("Could not parse /proc/net/dev. No data."));
 
-  parse_stats_header (buf, &prx_idx, &ptx_idx, &brx_idx, &btx_idx);
-  if (prx_idx == -1 || ptx_idx == -1 ||
-      brx_idx == -1 || btx_idx == -1)
-    return g_strdup (_("Could not parse /proc/net/dev. Unknown format."));
-
-  while (fgets (buf, sizeof (buf), fh))
-    {
-      char *stats;
-      char *name;
-
-      name = buf;
-      while (g_ascii_isspace (name [0]))
-	name++;
-
-      stats = parse_iface_name (name);
-      if (!stats)
-	{
-	  if (!error_message)
-	    error_message = g_strdup_printf (_("Could not parse interface name from '%s'"), buf);
-	  continue;
-	}
+  dev = lxpanel_sample_find_net_device (sample, iface);
+  if (!dev)
+    return g_strdup_printf ("Could not find information on interface '%s' in /proc/net/dev", iface);
 
-      if (strcmp (name, iface) != 0)
-	continue;
+  *in_packets  = dev->rx_packets;
+  *out_packets = dev->tx_packets;
+  *in_bytes    = dev->rx_bytes;
+  *out_bytes   = dev->tx_bytes;
 
-      if (!parse_stats (stats,
-			prx_idx, ptx_idx, in_packets, out_packets,
-			brx_idx, btx_idx, in_bytes, out_bytes))
-	{
-	  if (error_message)
-	    g_free (error_message);
-	  error_message = g_strdup_printf (_("Could not parse interface statistics from '%s'. "
-					     "prx_idx = %d; ptx_idx = %d; brx_idx = %d; btx_idx = %d;"),
-					   buf, prx_idx, ptx_idx, brx_idx, btx_idx);
-	  continue;
-	}
-
-      break;
-    }
-
-  if ((*in_packets == (gulong) -1 || *out_packets == (gulong) -1 || *in_bytes == (gulong) -1 || *out_bytes == (gulong) -1) && !error_message)
-    error_message = g_strdup_printf ("Could not find information on interface '%s' in /proc/net/dev", iface);
-
-  rewind (fh);
-  fflush (fh);
-
-  return error_message;
+  return NULL;
 }
 
 static inline gboolean
@@ -103,6 +103,92 @@ netstatus_stats_get_type (void)
   return type_id;
 }
 
+void
+netstatus_rate_history_clear (NetstatusRateHistory *history)
+{
+  g_return_if_fail (history != NULL);
+
+  history->n_samples = 0;
+  history->head      = 0;
+}
+
+void
+netstatus_rate_history_push (NetstatusRateHistory *history,
+			     gint64                time,
+			     gdouble               in_rate,
+			     gdouble               out_rate)
+{
+  g_return_if_fail (history != NULL);
+
+  if (history->n_samples > 0)
+    history->head = (history->head + 1) % NETSTATUS_RATE_HISTORY_LENGTH;
+  if (history->n_samples < NETSTATUS_RATE_HISTORY_LENGTH)
+    history->n_samples++;
+
+  history->time [history->head]     = time;
+  history->in_rate [history->head]  = in_rate;
+  history->out_rate [history->head] = out_rate;
+}
+
+/* Retrieves the sample @age samples older than the newest one.
+ */
+gboolean
+netstatus_rate_history_get (const NetstatusRateHistory *history,
+			    guint                       age,
+			    gint64                     *time,
+			    gdouble                    *in_rate,
+			    gdouble                    *out_rate)
+{
+  guint i;
+
+  g_return_val_if_fail (history != NULL, FALSE);
+
+  if (age >= history->n_samples)
+    return FALSE;
+
+  i = (history->head + NETSTATUS_RATE_HISTORY_LENGTH - age) % NETSTATUS_RATE_HISTORY_LENGTH;
+
+  if (time)
+    *time = history->time [i];
+  if (in_rate)
+    *in_rate = history->in_rate [i];
+  if (out_rate)
+    *out_rate = history->out_rate [i];
+
+  return TRUE;
+}
+
+gdouble
+netstatus_rate_history_get_peak (const NetstatusRateHistory *history)
+{
+  gdouble peak = 0;
+  guint   i;
+
+  g_return_val_if_fail (history != NULL, 0);
+
+  for (i = 0; i < history->n_samples; i++)
+    peak = MAX (peak, MAX (history->in_rate [i], history->out_rate [i]));
+
+  return peak;
+}
+
+/* Difference between two readings of a byte counter. Counters are 32 bits
+ * wide on some kernels and drivers and wrap around, a counter which goes
+ * back otherwise was reset (e.g. the interface was recreated).
+ */
+guint64
+netstatus_counter_delta (guint64 prev,
+			 guint64 now)
+{
+  if (now >= prev)
+    return now - prev;
+
+  if (prev <= G_MAXUINT32 && prev > G_MAXUINT32 / 2 && now < G_MAXUINT32 / 2)
+    return (G_MAXUINT32 - prev) + now + 1;
+
+  return 0;
+}
+
 /* Adopt an existing error into our domain.
  */
 void
@@ -68,6 +68,19 @@ typedef struct
   gulong out_bytes;
 } NetstatusStats;
 
+#define NETSTATUS_RATE_HISTORY_LENGTH 120 /* samples kept, one per second */
+
+/* Fixed size ring buffer of byte rates, pushing a sample never allocates.
+ */
+typedef struct
+{
+  guint   n_samples;                               /* valid samples */
+  guint   head;                                    /* index of the newest sample */
+  gint64  time [NETSTATUS_RATE_HISTORY_LENGTH];     /* monotonic time, microseconds */
+  gdouble in_rate [NETSTATUS_RATE_HISTORY_LENGTH];  /* bytes per second */
+  gdouble out_rate [NETSTATUS_RATE_HISTORY_LENGTH]; /* bytes per second */
+} NetstatusRateHistory;
+
 GQuark               netstatus_error_quark                (void);
 GType                netstatus_g_error_get_type           (void);
 GType                netstatus_stats_get_type             (void);
@@ -79,6 +92,20 @@ const char *         netstatus_get_state_string           (NetstatusState  state
 GList               *netstatus_list_insert_unique         (GList          *list,
 							   char           *str);
 
+void                 netstatus_rate_history_clear         (NetstatusRateHistory       *history);
+void                 netstatus_rate_history_push          (NetstatusRateHistory       *history,
+							   gint64                      time,
+							   gdouble                     in_rate,
+							   gdouble                     out_rate);
+gboolean             netstatus_rate_history_get           (const NetstatusRateHistory *history,
+							   guint                       age,
+							   gint64                     *time,
+							   gdouble                    *in_rate,
+							   gdouble                    *out_rate);
+gdouble              netstatus_rate_history_get_peak      (const NetstatusRateHistory *history);
+guint64              netstatus_counter_delta              (guint64         prev,
+							   guint64         now);
+
 void                 netstatus_connect_signal_while_alive (gpointer        object,
 							   const char     *detailed_signal,
 							   GCallback       func,
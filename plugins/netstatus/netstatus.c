@@ -36,6 +36,7 @@ typedef struct {
     config_setting_t *settings;
     char *iface;
     char *config_tool;
+    gboolean show_graph;
     GtkWidget *dlg;
 } netstatus;
 
@@ -113,6 +114,7 @@ netstatus_constructor(LXPanel *panel, config_setting_t *settings)
     NetstatusIface* iface;
     GtkWidget *p;
     const char *tmp;
+    int tmp_int;
 
     ENTER;
     ns = g_new0(netstatus, 1);
@@ -125,11 +127,15 @@ netstatus_constructor(LXPanel *panel, config_setting_t *settings)
     if (!config_setting_lookup_string(settings, "configtool", &tmp))
         tmp = "nm-connection-editor";
     ns->config_tool = g_strdup(tmp);
+    ns->show_graph = TRUE;
+    if (config_setting_lookup_int(settings, "ShowGraph", &tmp_int))
+        ns->show_graph = tmp_int != 0;
 
     iface = netstatus_iface_new(ns->iface);
     p = netstatus_icon_new( iface );
     lxpanel_plugin_set_data(p, ns, netstatus_destructor);
     netstatus_icon_set_show_signal((NetstatusIcon *)p, TRUE);
+    netstatus_icon_set_show_graph((NetstatusIcon *)p, ns->show_graph);
     g_object_unref( iface );
 
     RET(p);
@@ -143,9 +149,11 @@ static gboolean apply_config(gpointer user_data)
 
     iface = netstatus_iface_new(ns->iface);
     netstatus_icon_set_iface((NetstatusIcon *)p, iface);
+    netstatus_icon_set_show_graph((NetstatusIcon *)p, ns->show_graph);
     g_object_unref(iface);
     config_group_set_string(ns->settings, "iface", ns->iface);
     config_group_set_string(ns->settings, "configtool", ns->config_tool);
+    config_group_set_int(ns->settings, "ShowGraph", ns->show_graph);
     return FALSE;
 }
 
@@ -157,6 +165,7 @@ static GtkWidget *netstatus_config(LXPanel *panel, GtkWidget *p)
                 panel, apply_config, p,
                 _("Interface to monitor"), &ns->iface, CONF_TYPE_STR,
                 _("Config tool"), &ns->config_tool, CONF_TYPE_STR,
+                _("Show throughput graph"), &ns->show_graph, CONF_TYPE_BOOL,
                 NULL );
     return dlg;
 }
@@ -35,6 +35,7 @@
 
 #include "misc.h"
 #include "plugin.h"
+#include "ev.h"
 
 typedef struct
 {
@@ -73,8 +74,8 @@ static void on_size_allocate(GtkWidget *p, GdkRectangle *allocation, LXPanel *pa
 
 static gboolean on_scroll_event(GtkWidget * p, GdkEventScroll * ev, LXPanel *panel)
 {
-    int desknum = get_net_current_desktop();
-    int desks = get_net_number_of_desktops();
+    int desknum = fb_ev_current_desktop(fbev);
+    int desks = fb_ev_number_of_desktops(fbev);
     Screen *xscreen = GDK_SCREEN_XSCREEN(gtk_widget_get_screen(p));
 
     switch (ev->direction) {
@@ -49,6 +49,7 @@
 
 #include "plugin.h"
 #include "misc.h"
+#include "ev.h"
 #include "icon.xpm"
 #include "gtk-compat.h"
 
@@ -92,7 +93,10 @@ struct _TaskButton
     guint n_visible;            /* number of windows that are shown */
     guint idle_loader;          /* id of icons loader */
     GList * details;            /* details for each window, TaskDetails */
-    gint desktop;               /* Current desktop of the button */
+    GHashTable * windows_index; /* Window -> TaskButton, shared within taskbar */
+    GHashTable * classes_index; /* res_class -> TaskButton, shared within taskbar */
+    GHashTable * desktops_index; /* desktop -> bucket of TaskButton, shared within taskbar */
+    gint desktop;               /* Desktop the visibility was last computed for */
     gint n_desktops;            /* total number of desktops */
     gint monitor;               /* current monitor for the panel */
     guint icon_size;            /* Current value from last update */
@@ -112,6 +116,26 @@ enum {
 
 static guint signals[N_SIGNALS];
 
+/* process-wide cache of scaled _NET_WM_ICON images, so windows of the same
+   application share one pixbuf instead of decoding and scaling it again */
+typedef struct
+{
+    char * res_class;           /* class of the window the icon came from */
+    guint32 hash;               /* hash of the frame size and pixels */
+    guint width, height;        /* requested size */
+    gboolean no_upscale;        /* value of disable_taskbar_upscale flag */
+    GdkPixbuf * pixbuf;         /* the scaled icon */
+    gsize bytes;                /* memory used by pixbuf */
+    GList * lru_link;           /* link in icon_cache_lru, head is most recent */
+} IconCacheEntry;
+
+static GHashTable * icon_cache = NULL;
+static GQueue icon_cache_lru = G_QUEUE_INIT;
+static gsize icon_cache_bytes = 0;
+static gsize icon_cache_limit = 1024 * 1024;
+static guint icon_cache_hits = 0;
+static guint icon_cache_misses = 0;
+
 
 static void task_raise_window(TaskButton *tb, TaskDetails *tk, guint32 time);
 static void task_update_icon(TaskButton *task, TaskDetails *details, Atom source);
@@ -211,9 +235,11 @@ static gboolean task_is_visible(TaskButton *b, TaskDetails *task)
     /* Not on same monitor */
     if (b->flags.same_monitor_only && b->monitor != task->monitor && b->monitor >= 0)
         return FALSE;
-    /* Desktop placement. */
+    /* Desktop placement. On desktop switch the taskbar updates only buttons
+       which have windows on the old or new desktop, so b->desktop may be out
+       of date here, therefore test against actual current desktop. */
     return ((task->desktop == ALL_WORKSPACES) ||
-            (task->desktop == b->desktop) ||
+            (task->desktop == fb_ev_current_desktop(fbev)) ||
             (b->flags.show_all_desks) ||
             (b->flags.use_urgency_hint && task->urgency));
 }
@@ -269,6 +295,109 @@ static TaskDetails *task_details_lookup(TaskButton *task, Window win)
     return NULL;
 }
 
+/* Windows and classes index is shared by all buttons of the same taskbar so
+   the taskbar may find button by window or by class without scanning all of
+   them. The class index keeps only one button for each class. */
+static void task_index_add_class(TaskButton *button)
+{
+    if (button->classes_index == NULL || button->res_class == NULL)
+        return;
+    if (g_hash_table_lookup(button->classes_index, button->res_class) == NULL)
+        g_hash_table_insert(button->classes_index, g_strdup(button->res_class),
+                            button);
+}
+
+static void task_index_remove_class(TaskButton *button)
+{
+    GHashTableIter iter;
+    gpointer value;
+
+    if (button->classes_index == NULL || button->res_class == NULL)
+        return;
+    if (g_hash_table_lookup(button->classes_index, button->res_class) != button)
+        return;
+    g_hash_table_remove(button->classes_index, button->res_class);
+    /* pass ownership of the class to any other button of the same class */
+    g_hash_table_iter_init(&iter, button->windows_index);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        if (value != button &&
+            g_strcmp0(((TaskButton *)value)->res_class, button->res_class) == 0)
+        {
+            g_hash_table_insert(button->classes_index,
+                                g_strdup(button->res_class), value);
+            break;
+        }
+}
+
+static inline void task_index_add_window(TaskButton *button, Window win)
+{
+    if (button->windows_index)
+        g_hash_table_insert(button->windows_index, GUINT_TO_POINTER(win), button);
+}
+
+static inline void task_index_remove_window(TaskButton *button, Window win)
+{
+    if (button->windows_index &&
+        g_hash_table_lookup(button->windows_index, GUINT_TO_POINTER(win)) == button)
+        g_hash_table_remove(button->windows_index, GUINT_TO_POINTER(win));
+}
+
+/* Desktops index keeps a bucket for each desktop: a set of buttons which
+   have windows on that desktop, with number of such windows as value. */
+static void task_index_add_desktop(TaskButton *button, gint desktop)
+{
+    GHashTable *bucket;
+
+    if (button->desktops_index == NULL)
+        return;
+    bucket = g_hash_table_lookup(button->desktops_index, GINT_TO_POINTER(desktop));
+    if (bucket == NULL)
+    {
+        bucket = g_hash_table_new(g_direct_hash, g_direct_equal);
+        g_hash_table_insert(button->desktops_index, GINT_TO_POINTER(desktop), bucket);
+    }
+    g_hash_table_insert(bucket, button,
+                        GINT_TO_POINTER(GPOINTER_TO_INT(g_hash_table_lookup(bucket, button)) + 1));
+}
+
+static void task_index_remove_desktop(TaskButton *button, gint desktop)
+{
+    GHashTable *bucket;
+    gint n;
+
+    if (button->desktops_index == NULL)
+        return;
+    bucket = g_hash_table_lookup(button->desktops_index, GINT_TO_POINTER(desktop));
+    if (bucket == NULL)
+        return;
+    n = GPOINTER_TO_INT(g_hash_table_lookup(bucket, button)) - 1;
+    if (n > 0)
+        g_hash_table_insert(bucket, button, GINT_TO_POINTER(n));
+    else
+        g_hash_table_remove(bucket, button);
+}
+
+/* drop all references to button from the index, used before destroying it */
+static void task_index_remove_button(TaskButton *button)
+{
+    GList *l;
+    GHashTable *bucket;
+
+    for (l = button->details; l; l = l->next)
+    {
+        TaskDetails *details = l->data;
+
+        task_index_remove_window(button, details->win);
+        if (button->desktops_index == NULL)
+            continue;
+        bucket = g_hash_table_lookup(button->desktops_index,
+                                     GINT_TO_POINTER(details->desktop));
+        if (bucket)
+            g_hash_table_remove(bucket, button);
+    }
+    task_index_remove_class(button);
+}
+
 /* Position-calculation callback for grouped-task and window-management popup menu. */
 static void taskbar_popup_set_position(GtkMenu * menu, gint * px, gint * py, gboolean * push_in, gpointer data)
 {
@@ -486,7 +615,7 @@ static void task_raise_window(TaskButton *tb, TaskDetails *tk, guint32 time)
     Display *xdisplay = DisplayOfScreen(xscreen);
 
     /* Change desktop if needed. */
-    if ((tk->desktop != ALL_WORKSPACES) && (tk->desktop != tb->desktop))
+    if ((tk->desktop != ALL_WORKSPACES) && (tk->desktop != fb_ev_current_desktop(fbev)))
         Xclimsgx(xscreen, RootWindowOfScreen(xscreen), a_NET_CURRENT_DESKTOP, tk->desktop, 0, 0, 0, 0);
 
     /* Raise the window.  We can use NET_ACTIVE_WINDOW if the window manager supports it.
@@ -817,6 +946,219 @@ static GdkPixbuf * apply_mask(GdkPixbuf * pixbuf, GdkPixbuf * mask)
     return with_alpha;
 }
 
+/* Find the frame of _NET_WM_ICON which fits required size best and fetch only
+ * that frame. Only size headers of other frames are transferred, so large
+ * icons never cross the wire if a small one is available.
+ * Returns data to free with XFree() or NULL. */
+static gulong * get_net_wm_icon_frame(Display * xdisplay, Window task_win,
+                                      guint required_width, guint required_height,
+                                      guint * width, guint * height)
+{
+    /* Important Notes:
+     * According to freedesktop.org document:
+     * http://standards.freedesktop.org/wm-spec/wm-spec-1.4.html#id2552223
+     * _NET_WM_ICON contains an array of 32-bit packed CARDINAL ARGB.
+     * However, this is incorrect. Actually it's an array of long integers.
+     * Toolkits like gtk+ use unsigned long here to store icons.
+     * Besides, according to manpage of XGetWindowProperty, when returned format,
+     * is 32, the property data will be stored as an array of longs
+     * (which in a 64-bit application will be 64-bit values that are
+     * padded in the upper 4 bytes).
+     * Offsets for XGetWindowProperty are in 32-bit units though.
+     */
+    Atom type;
+    int format, n_frames = 0;
+    gulong nitems;
+    gulong bytes_after;
+    gulong * data;
+    glong offset = 0, best_offset = -1;
+    guint w, h, best_w = 0, best_h = 0;
+    gboolean fits, best_fits = FALSE;
+
+    do
+    {
+        /* Read the size header of the next frame. */
+        data = NULL;
+        if (XGetWindowProperty(xdisplay, task_win, a_NET_WM_ICON, offset, 2,
+                               False, XA_CARDINAL, &type, &format, &nitems,
+                               &bytes_after, (void *) &data) != Success)
+            return NULL;
+        if (type != XA_CARDINAL || format != 32 || nitems < 2)
+        {
+            if (data != NULL)
+                XFree(data);
+            break;
+        }
+        w = data[0];
+        h = data[1];
+        XFree(data);
+
+        /* Bounds check the icon. Also check for invalid width and height,
+           see http://bugs.debian.org/cgi-bin/bugreport.cgi?bug=801319 */
+        if (w == 0 || h == 0 || w > 1024 || h > 1024 || (gulong)w * h * 4 > bytes_after)
+            break;
+
+        /* Take the exact size, else the smallest icon which is not less
+           than required, else the largest icon available. */
+        if ((required_width == w) && (required_height == h))
+        {
+            best_offset = offset;
+            best_w = w;
+            best_h = h;
+            break;
+        }
+        fits = (w >= required_width && h >= required_height);
+        if (best_offset < 0 || (fits && (!best_fits || w * h < best_w * best_h))
+            || (!fits && !best_fits && w * h > best_w * best_h))
+        {
+            best_offset = offset;
+            best_w = w;
+            best_h = h;
+            best_fits = fits;
+        }
+        offset += 2 + (glong)w * h;
+    }
+    while (bytes_after > (gulong)w * h * 4 && ++n_frames < 32);
+
+    if (best_offset < 0)
+        return NULL;
+
+    /* Fetch pixels of the selected frame. */
+    data = NULL;
+    if (XGetWindowProperty(xdisplay, task_win, a_NET_WM_ICON, best_offset + 2,
+                           (glong)best_w * best_h, False, XA_CARDINAL, &type,
+                           &format, &nitems, &bytes_after, (void *) &data) != Success)
+        return NULL;
+    if (type != XA_CARDINAL || format != 32 || nitems != (gulong)best_w * best_h)
+    {
+        if (data != NULL)
+            XFree(data);
+        return NULL;
+    }
+    *width = best_w;
+    *height = best_h;
+    return data;
+}
+
+/* Convert a row of ARGB longs into the RGBA bytes of a pixbuf. The loop has
+ * no byte access and no branches, so the compiler can vectorize it. */
+static void argb_to_rgba(guint32 * dst, const gulong * src, guint len)
+{
+    guint i;
+
+    for (i = 0; i < len; i++)
+    {
+        guint32 argb = (guint32)src[i];
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+        /* R,G,B,A bytes in memory is ABGR word */
+        dst[i] = (argb & 0xff00ff00) | ((argb >> 16) & 0xff) | ((argb & 0xff) << 16);
+#else
+        dst[i] = (argb << 8) | (argb >> 24);
+#endif
+    }
+}
+
+/* Hash of an icon frame: FNV-1a over its size and the 32-bit pixels. */
+static guint32 icon_frame_hash(const gulong * data, guint w, guint h)
+{
+    guint32 hash = 2166136261U;
+    gulong i, len = (gulong)w * h;
+
+    hash = (hash ^ w) * 16777619U;
+    hash = (hash ^ h) * 16777619U;
+    for (i = 0; i < len; i++)
+        hash = (hash ^ (guint32)data[i]) * 16777619U;
+    return hash;
+}
+
+static guint icon_cache_entry_hash(gconstpointer key)
+{
+    const IconCacheEntry * entry = key;
+
+    return g_str_hash(entry->res_class) ^ entry->hash ^ (entry->width << 16)
+           ^ entry->height ^ entry->no_upscale;
+}
+
+static gboolean icon_cache_entry_equal(gconstpointer a, gconstpointer b)
+{
+    const IconCacheEntry * ea = a, * eb = b;
+
+    return ea->hash == eb->hash && ea->width == eb->width &&
+           ea->height == eb->height && ea->no_upscale == eb->no_upscale &&
+           g_strcmp0(ea->res_class, eb->res_class) == 0;
+}
+
+static void icon_cache_entry_free(gpointer data)
+{
+    IconCacheEntry * entry = data;
+
+    g_queue_delete_link(&icon_cache_lru, entry->lru_link);
+    icon_cache_bytes -= entry->bytes;
+    g_object_unref(entry->pixbuf);
+    g_free(entry->res_class);
+    g_slice_free(IconCacheEntry, entry);
+}
+
+/* drop least recently used icons until the cache fits the limit */
+static void icon_cache_trim(void)
+{
+    while (icon_cache_bytes > icon_cache_limit && icon_cache_lru.tail != NULL)
+        g_hash_table_remove(icon_cache, icon_cache_lru.tail->data);
+}
+
+/* returns a new reference to the cached icon or NULL */
+static GdkPixbuf * icon_cache_lookup(const char * res_class, guint32 hash,
+                                     guint width, guint height, gboolean no_upscale)
+{
+    IconCacheEntry key, * entry;
+
+    if (icon_cache == NULL)
+        return NULL;
+    key.res_class = (char *)(res_class ? res_class : "");
+    key.hash = hash;
+    key.width = width;
+    key.height = height;
+    key.no_upscale = no_upscale;
+    entry = g_hash_table_lookup(icon_cache, &key);
+    if (entry == NULL)
+    {
+        icon_cache_misses++;
+        return NULL;
+    }
+    icon_cache_hits++;
+    /* move it to the head of LRU list */
+    g_queue_unlink(&icon_cache_lru, entry->lru_link);
+    g_queue_push_head_link(&icon_cache_lru, entry->lru_link);
+    return g_object_ref(entry->pixbuf);
+}
+
+static void icon_cache_insert(const char * res_class, guint32 hash, guint width,
+                              guint height, gboolean no_upscale, GdkPixbuf * pixbuf)
+{
+    IconCacheEntry * entry;
+    gsize bytes = (gsize)gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+
+    if (bytes > icon_cache_limit)
+        return;
+    if (icon_cache == NULL)
+        icon_cache = g_hash_table_new_full(icon_cache_entry_hash, icon_cache_entry_equal,
+                                           icon_cache_entry_free, NULL);
+    entry = g_slice_new(IconCacheEntry);
+    entry->res_class = g_strdup(res_class ? res_class : "");
+    entry->hash = hash;
+    entry->width = width;
+    entry->height = height;
+    entry->no_upscale = no_upscale;
+    entry->pixbuf = g_object_ref(pixbuf);
+    entry->bytes = bytes;
+    g_queue_push_head(&icon_cache_lru, entry);
+    entry->lru_link = icon_cache_lru.head;
+    /* an equal entry, if any, is replaced and freed */
+    g_hash_table_replace(icon_cache, entry, entry);
+    icon_cache_bytes += bytes;
+    icon_cache_trim();
+}
+
 /* Get an icon from the window manager for a task, and scale it to a specified size. */
 static GdkPixbuf * get_wm_icon(Window task_win, guint required_width,
                                guint required_height, Atom source,
@@ -828,119 +1170,46 @@ static GdkPixbuf * get_wm_icon(Window task_win, guint required_width,
     int result = -1;
     Display *xdisplay = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
     GdkScreen *screen = gtk_widget_get_screen(GTK_WIDGET(tb));
+    gboolean cacheable = FALSE;
+    guint32 hash = 0;
 
     if ((source == None) || (source == a_NET_WM_ICON))
     {
-        /* Important Notes:
-         * According to freedesktop.org document:
-         * http://standards.freedesktop.org/wm-spec/wm-spec-1.4.html#id2552223
-         * _NET_WM_ICON contains an array of 32-bit packed CARDINAL ARGB.
-         * However, this is incorrect. Actually it's an array of long integers.
-         * Toolkits like gtk+ use unsigned long here to store icons.
-         * Besides, according to manpage of XGetWindowProperty, when returned format,
-         * is 32, the property data will be stored as an array of longs
-         * (which in a 64-bit application will be 64-bit values that are
-         * padded in the upper 4 bytes).
-         */
-
-        /* Get the window property _NET_WM_ICON, if possible. */
-        Atom type = None;
-        int format;
-        gulong nitems;
-        gulong bytes_after;
-        gulong * data = NULL;
-        result = XGetWindowProperty(
-            xdisplay,
-            task_win,
-            a_NET_WM_ICON,
-            0, G_MAXLONG,
-            False, XA_CARDINAL,
-            &type, &format, &nitems, &bytes_after, (void *) &data);
-
-        /* Inspect the result to see if it is usable.  If not, and we got data, free it. */
-        if ((type != XA_CARDINAL) || (nitems <= 0))
+        /* Get the best fitting frame of _NET_WM_ICON, if possible. */
+        guint w, h;
+        gulong * data = get_net_wm_icon_frame(xdisplay, task_win, required_width,
+                                              required_height, &w, &h);
+
+        /* If the same icon was scaled already then just take it from cache. */
+        if (data != NULL && icon_cache_limit > 0)
         {
-            if (data != NULL)
+            hash = icon_frame_hash(data, w, h);
+            pixmap = icon_cache_lookup(tb->res_class, hash, required_width,
+                                       required_height, tb->flags.disable_taskbar_upscale);
+            if (pixmap != NULL)
+            {
                 XFree(data);
-            result = -1;
+                *current_source = a_NET_WM_ICON;
+                return pixmap;
+            }
+            cacheable = TRUE;
         }
 
-        /* If the result is usable, extract the icon from it. */
-        if (result == Success)
+        /* If an icon was extracted, convert it to a pixbuf. */
+        if (data != NULL)
         {
-            /* Get the largest icon available, unless there is one that is the desired size. */
-            /* FIXME: should we try to find an icon whose size is closest to
-             * required_width and required_height to reduce unnecessary resizing? */
-            gulong * pdata = data;
-            gulong * pdata_end = data + nitems;
-            gulong * max_icon = NULL;
-            gulong max_w = 0;
-            gulong max_h = 0;
-            while ((pdata + 2) < pdata_end)
+            pixmap = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, w, h);
+            if (pixmap != NULL)
             {
-                /* Extract the width and height. */
-                guint w = pdata[0];
-                guint h = pdata[1];
-                gulong size = w * h;
-                pdata += 2;
-
-                /* Bounds check the icon. Also check for invalid width and height,
-                   see http://bugs.debian.org/cgi-bin/bugreport.cgi?bug=801319 */
-                if (size == 0 || w > 1024 || h > 1024 || pdata + size > pdata_end)
-                    break;
-
-                /* Rare special case: the desired size is the same as icon size. */
-                if ((required_width == w) && (required_height == h))
-                {
-                    max_icon = pdata;
-                    max_w = w;
-                    max_h = h;
-                    break;
-                }
-
-                /* If the icon is the largest so far, capture it. */
-                if ((w > max_w) && (h > max_h))
-                {
-                    max_icon = pdata;
-                    max_w = w;
-                    max_h = h;
-                }
-                pdata += size;
-            }
+                guchar * pixels = gdk_pixbuf_get_pixels(pixmap);
+                int rowstride = gdk_pixbuf_get_rowstride(pixmap);
+                guint y;
 
-            /* If an icon was extracted, convert it to a pixbuf.
-             * Its size is max_w and max_h. */
-            if (max_icon != NULL)
-            {
-                /* Allocate enough space for the pixel data. */
-                gulong len = max_w * max_h;
-                guchar * pixdata = g_new(guchar, len * 4);
-
-                /* Loop to convert the pixel data. */
-                guchar * p = pixdata;
-                gulong i;
-                for (i = 0; i < len; p += 4, i += 1)
-                {
-                    guint argb = max_icon[i];
-                    guint rgba = (argb << 8) | (argb >> 24);
-                    p[0] = rgba >> 24;
-                    p[1] = (rgba >> 16) & 0xff;
-                    p[2] = (rgba >> 8) & 0xff;
-                    p[3] = rgba & 0xff;
-                }
-
-                /* Initialize a pixmap with the pixel data. */
-                pixmap = gdk_pixbuf_new_from_data(
-                    pixdata,
-                    GDK_COLORSPACE_RGB,
-                    TRUE, 8,    /* has_alpha, bits_per_sample */
-                    max_w, max_h, max_w * 4,
-                    (GdkPixbufDestroyNotify) g_free,
-                    NULL);
+                for (y = 0; y < h; y++)
+                    argb_to_rgba((guint32 *)(pixels + y * rowstride), data + y * w, w);
                 possible_source = a_NET_WM_ICON;
+                result = Success;
             }
-            else
-                result = -1;
 
             /* Free the X property data. */
             XFree(data);
@@ -1064,17 +1333,23 @@ static GdkPixbuf * get_wm_icon(Window task_win, guint required_width,
     {
         GdkPixbuf * ret;
 
+        guint w = gdk_pixbuf_get_width (pixmap);
+        guint h = gdk_pixbuf_get_height (pixmap);
+
         *current_source = possible_source;
-        if (tb->flags.disable_taskbar_upscale)
+        if ((w == required_width && h == required_height) ||
+            (tb->flags.disable_taskbar_upscale &&
+             (w <= required_width || h <= required_height)))
+            ret = pixmap;
+        else
         {
-            guint w = gdk_pixbuf_get_width (pixmap);
-            guint h = gdk_pixbuf_get_height (pixmap);
-            if (w <= required_width || h <= required_height)
-                return pixmap;
+            ret = gdk_pixbuf_scale_simple(pixmap, required_width, required_height,
+                                          GDK_INTERP_BILINEAR);
+            g_object_unref(pixmap);
         }
-        ret = gdk_pixbuf_scale_simple(pixmap, required_width, required_height,
-                                      GDK_INTERP_BILINEAR);
-        g_object_unref(pixmap);
+        if (cacheable && ret != NULL && possible_source == a_NET_WM_ICON)
+            icon_cache_insert(tb->res_class, hash, required_width, required_height,
+                              tb->flags.disable_taskbar_upscale, ret);
         return ret;
     }
 }
@@ -1203,6 +1478,7 @@ static gboolean task_update_visibility(TaskButton *task)
     GList *l;
     TaskDetails *details, *first_visible = NULL;
 
+    task->desktop = fb_ev_current_desktop(fbev);
     task->same_name = TRUE;
     task->visible = FALSE;
     task->n_visible = 0;
@@ -1252,6 +1528,13 @@ static void task_button_finalize(GObject *object)
     TaskButton *self = (TaskButton *)object;
 
     /* free all data */
+    task_index_remove_button(self);
+    if (self->windows_index)
+        g_hash_table_unref(self->windows_index);
+    if (self->classes_index)
+        g_hash_table_unref(self->classes_index);
+    if (self->desktops_index)
+        g_hash_table_unref(self->desktops_index);
     g_free(self->res_class);
     if (self->menu_list)
         g_object_remove_weak_pointer(G_OBJECT(self->menu_list),
@@ -1524,15 +1807,17 @@ static void task_button_init(TaskButton *self)
  */
 
 /* creates new button and sets rendering options */
-TaskButton *task_button_new(Window win, gint desk, gint desks, LXPanel *panel,
-                            const char *res_class, TaskShowFlags flags)
+TaskButton *task_button_new(Window win, gint desks, LXPanel *panel,
+                            const char *res_class, TaskShowFlags flags,
+                            GHashTable *windows, GHashTable *classes,
+                            GHashTable *desktops)
 {
     TaskButton *self = g_object_new(PANEL_TYPE_TASK_BUTTON,
                                     "relief", flags.flat_button ? GTK_RELIEF_NONE : GTK_RELIEF_NORMAL,
                                     NULL);
 
     /* remember data */
-    self->desktop = desk;
+    self->desktop = fb_ev_current_desktop(fbev);
     self->n_desktops = desks;
     self->panel = panel;
     self->monitor = panel_get_monitor(panel);
@@ -1541,6 +1826,12 @@ TaskButton *task_button_new(Window win, gint desk, gint desks, LXPanel *panel,
         self->icon_size -= 4;
     self->res_class = g_strdup(res_class);
     self->flags = flags;
+    if (windows)
+        self->windows_index = g_hash_table_ref(windows);
+    if (classes)
+        self->classes_index = g_hash_table_ref(classes);
+    if (desktops)
+        self->desktops_index = g_hash_table_ref(desktops);
     /* create empty image and label */
     self->image = gtk_image_new();
     self->label = gtk_label_new(NULL);
@@ -1565,50 +1856,6 @@ gboolean task_button_has_window(TaskButton *button, Window win)
     return FALSE;
 }
 
-/* removes windows from button, that are missing in list */
-void task_button_update_windows_list(TaskButton *button, Window *list, gint n)
-{
-    GList *l, *next;
-    TaskDetails *details;
-    gint i;
-    gboolean has_removed = FALSE;
-
-    g_return_if_fail(PANEL_IS_TASK_BUTTON(button));
-
-    for (l = button->details; l; )
-    {
-        next = l->next;
-        details = l->data;
-        for (i = 0; i < n; i++)
-            if (list[i] == details->win)
-                break;
-        if (i >= n) /* not found, remove details now */
-        {
-            button->details = g_list_delete_link(button->details, l);
-            free_task_details(details);
-            if (button->last_focused == details)
-                button->last_focused = NULL;
-            has_removed = TRUE;
-        }
-        l = next; /* go next details */
-    }
-    if (button->details == NULL) /* all windows were deleted */
-    {
-        GList *menu_list = gtk_menu_get_for_attach_widget(GTK_WIDGET(button));
-        menu_list = g_list_copy(menu_list);
-        for (l = menu_list; l; l = l->next)
-        {
-            GtkMenu *menu = GTK_MENU(l->data);
-            gtk_menu_detach(menu);
-        }
-        g_list_free(menu_list);
-        gtk_widget_destroy(GTK_WIDGET(button));
-    }
-    else if (has_removed && task_update_visibility(button))
-        task_redraw_label(button);
-    // FIXME: test if need to update menu
-}
-
 /* returns TRUE if found and updated */
 gboolean task_button_window_xprop_changed(TaskButton *button, Window win, Atom atom)
 {
@@ -1624,7 +1871,9 @@ gboolean task_button_window_xprop_changed(TaskButton *button, Window win, Atom a
     if (atom == a_NET_WM_DESKTOP)
     {
         /* Window changed desktop. */
+        task_index_remove_desktop(button, details->desktop);
         details->desktop = get_net_wm_desktop(win);
+        task_index_add_desktop(button, details->desktop);
         details->visible = task_is_visible(button, details);
         if (task_update_visibility(button))
             task_redraw_label(button);
@@ -1652,8 +1901,10 @@ gboolean task_button_window_xprop_changed(TaskButton *button, Window win, Atom a
             XFree(ch.res_class);
             if (res_class != NULL)
             {
+                task_index_remove_class(button);
                 g_free(button->res_class);
                 button->res_class = res_class;
+                task_index_add_class(button);
                 if (!button->same_name)
                     task_redraw_label(button);
             }
@@ -1788,14 +2039,16 @@ gboolean task_button_window_reconfigured(TaskButton *button, Window win)
 }
 
 /* updates rendering options */
-void task_button_update(TaskButton *button, gint desk, gint desks,
+void task_button_update(TaskButton *button, gint desks,
                         gint mon, guint icon_size, TaskShowFlags flags)
 {
     gboolean changed = FALSE, changed_icon = FALSE, changed_label = FALSE;
 
     g_return_if_fail(PANEL_IS_TASK_BUTTON(button));
 
-    if (button->desktop != desk
+    /* button->desktop is the desktop visibility was computed for, it may be
+       out of date since not every button is updated on desktop switch */
+    if (button->desktop != fb_ev_current_desktop(fbev)
         || button->monitor != mon
         || button->flags.show_all_desks != flags.show_all_desks
         || button->flags.same_monitor_only != flags.same_monitor_only)
@@ -1822,7 +2075,6 @@ void task_button_update(TaskButton *button, gint desk, gint desks,
         else
             gtk_button_set_relief(GTK_BUTTON(button), GTK_RELIEF_NORMAL);
     }
-    button->desktop = desk;
     button->n_desktops = desks;
     button->monitor = mon;
     button->icon_size = icon_size;
@@ -1915,6 +2167,9 @@ gboolean task_button_add_window(TaskButton *button, Window win, const char *cl)
     /* fetch task details */
     details = task_details_for_window(button, win);
     button->details = g_list_append(button->details, details);
+    task_index_add_window(button, win);
+    task_index_add_desktop(button, details->desktop);
+    task_index_add_class(button);
     /* redraw label on the button if need */
     if (details->visible)
     {
@@ -1945,10 +2200,13 @@ gboolean task_button_drop_window(TaskButton *button, Window win, gboolean leave_
     if (g_list_length(button->details) == 1)
     {
         /* this was last window, destroy the button */
+        task_index_remove_button(button);
         gtk_widget_destroy(GTK_WIDGET(button));
         return TRUE;
     }
     details = l->data;
+    task_index_remove_window(button, win);
+    task_index_remove_desktop(button, details->desktop);
     button->details = g_list_delete_link(button->details, l);
     was_last_focused = (button->last_focused == details);
     if (was_last_focused)
@@ -1972,7 +2230,7 @@ gboolean task_button_drop_window(TaskButton *button, Window win, gboolean leave_
 TaskButton *task_button_split(TaskButton *button)
 {
     TaskButton *sibling;
-    GList *llast;
+    GList *llast, *l;
 
     g_return_val_if_fail(PANEL_IS_TASK_BUTTON(button), NULL);
 
@@ -1983,18 +2241,32 @@ TaskButton *task_button_split(TaskButton *button)
                            NULL);
     sibling->res_class = g_strdup(button->res_class);
     sibling->panel = button->panel;
+    if (button->windows_index)
+        sibling->windows_index = g_hash_table_ref(button->windows_index);
+    if (button->classes_index)
+        sibling->classes_index = g_hash_table_ref(button->classes_index);
+    if (button->desktops_index)
+        sibling->desktops_index = g_hash_table_ref(button->desktops_index);
     sibling->image = gtk_image_new();
     sibling->label = gtk_label_new(NULL);
     llast = g_list_last(button->details);
     sibling->details = g_list_remove_link(button->details, llast);
     button->details = llast;
+    for (l = sibling->details; l; l = l->next)
+    {
+        TaskDetails *details = l->data;
+
+        task_index_add_window(sibling, details->win);
+        task_index_remove_desktop(button, details->desktop);
+        task_index_add_desktop(sibling, details->desktop);
+    }
     if (button->last_focused != llast->data)
     {
         /* focused item migrated to sibling */
         sibling->last_focused = button->last_focused;
         button->last_focused = NULL;
     }
-    sibling->desktop = button->desktop;
+    sibling->desktop = fb_ev_current_desktop(fbev);
     sibling->n_desktops = button->n_desktops;
     sibling->monitor = button->monitor;
     sibling->icon_size = button->icon_size;
@@ -2020,13 +2292,24 @@ TaskButton *task_button_split(TaskButton *button)
 /* merges buttons if they are the same class */
 gboolean task_button_merge(TaskButton *button, TaskButton *sibling)
 {
+    GList *l;
+
     g_return_val_if_fail(PANEL_IS_TASK_BUTTON(button) && PANEL_IS_TASK_BUTTON(sibling), FALSE);
 
     if (g_strcmp0(button->res_class, sibling->res_class) != 0)
         return FALSE;
     /* move data lists from sibling appending to button */
+    for (l = sibling->details; l; l = l->next)
+    {
+        TaskDetails *details = l->data;
+
+        task_index_add_window(button, details->win);
+        task_index_remove_desktop(sibling, details->desktop);
+        task_index_add_desktop(button, details->desktop);
+    }
     button->details = g_list_concat(button->details, sibling->details);
     sibling->details = NULL;
+    task_index_remove_class(sibling);
     /* update visibility */
     button->n_visible += sibling->n_visible;
     button->visible = (button->visible | sibling->visible);
@@ -2059,3 +2342,20 @@ void task_button_raise_window(TaskButton *button, guint32 time)
     if (button->details)
         task_raise_window(button, button->details->data, time);
 }
+
+/* icon cache is shared by all taskbars, 0 disables it */
+void task_button_set_icon_cache_limit(gsize bytes)
+{
+    icon_cache_limit = bytes;
+    if (icon_cache != NULL)
+        icon_cache_trim();
+}
+
+void task_button_get_icon_cache_stats(guint *hits, guint *misses,
+                                      guint *entries, gsize *bytes)
+{
+    *hits = icon_cache_hits;
+    *misses = icon_cache_misses;
+    *entries = icon_cache ? g_hash_table_size(icon_cache) : 0;
+    *bytes = icon_cache_bytes;
+}
@@ -61,19 +61,23 @@ struct _TaskButtonClass
     void (*menu_target_set)(TaskButton *button, gulong win); /* "menu-target-set" signal */
 };
 
-/* creates new button and sets rendering options */
-TaskButton *task_button_new(Window win, gint desk, gint desks, LXPanel *panel,
-                            const char *cl, TaskShowFlags flags);
+/* creates new button and sets rendering options; windows, classes and
+   desktops are the taskbar-wide indexes (Window -> TaskButton, class ->
+   TaskButton and desktop -> set of TaskButton) which the button keeps up
+   to date, any of them can be NULL; visibility is always computed for the
+   current desktop */
+TaskButton *task_button_new(Window win, gint desks, LXPanel *panel,
+                            const char *cl, TaskShowFlags flags,
+                            GHashTable *windows, GHashTable *classes,
+                            GHashTable *desktops);
 
 gboolean task_button_has_window(TaskButton *button, Window win);
-/* removes windows from button, that are missing in list */
-void task_button_update_windows_list(TaskButton *button, Window *list, gint n);
 /* returns TRUE if found and updated */
 gboolean task_button_window_xprop_changed(TaskButton *button, Window win, Atom atom);
 gboolean task_button_window_focus_changed(TaskButton *button, Window *win);
 gboolean task_button_window_reconfigured(TaskButton *button, Window win);
 /* updates rendering options */
-void task_button_update(TaskButton *button, gint desk, gint desks,
+void task_button_update(TaskButton *button, gint desks,
                         gint mon, guint icon_size, TaskShowFlags flags);
 void task_button_set_flash_state(TaskButton *button, gboolean state);
 /* adds task only if it's the same class */
@@ -87,6 +91,10 @@ gboolean task_button_merge(TaskButton *button, TaskButton *sibling);
 void task_button_reset_menu(GtkWidget *parent);
 /* request for a minimized window to raise */
 void task_button_raise_window(TaskButton *button, guint32 time);
+/* process-wide cache of window icons, limit is in bytes, 0 disables it */
+void task_button_set_icon_cache_limit(gsize bytes);
+void task_button_get_icon_cache_stats(guint *hits, guint *misses,
+                                      guint *entries, gsize *bytes);
 
 G_END_DECLS
 
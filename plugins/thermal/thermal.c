@@ -25,6 +25,9 @@
 #include <sys/types.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 #include <glib/gi18n.h>
 
 #include <string.h>
@@ -44,7 +47,11 @@
 #define SYSFS_THERMAL_TEMPF  "temp"
 #define SYSFS_THERMAL_TRIP  "trip_point_0_temp"
 
-#define MAX_NUM_SENSORS 10
+#define HWMON_DIRECTORY "/sys/class/hwmon/" /* must be slash-terminated */
+
+#define HISTORY_SIZE 60 /* samples kept for the tooltip graph, 3 minutes */
+#define TOOLTIP_GRAPH_WIDTH 160
+#define TOOLTIP_GRAPH_HEIGHT 48
 #define MAX_AUTOMATIC_CRITICAL_TEMP 150 /* in degrees Celsius */
 
 #if !GLIB_CHECK_VERSION(2, 40, 0)
@@ -52,6 +59,18 @@
 #endif
 
 typedef gint (*GetTempFunc)(char const *);
+typedef gint (*ParseTempFunc)(char *);
+
+typedef struct {
+    char *path;                 /* as passed to get_critical */
+    char *name;
+    int fd;                     /* temperature file, kept open */
+    ParseTempFunc parse_temperature;
+    GetTempFunc get_critical;
+    gint temperature;
+    gint critical;
+    gint history[HISTORY_SIZE];
+} thermal_sensor;
 
 typedef struct thermal {
     LXPanel *panel;
@@ -60,7 +79,7 @@ typedef struct thermal {
     GString *tip;
     int warning1;
     int warning2;
-    int not_custom_levels, auto_sensor;
+    int not_custom_levels, auto_sensor, show_average;
     char *sensor,
          *str_cl_normal,
          *str_cl_warning1,
@@ -76,29 +95,33 @@ typedef struct thermal {
              cl_warning2;
 #endif
     int numsensors;
-    char *sensor_array[MAX_NUM_SENSORS];
-    char *sensor_name[MAX_NUM_SENSORS];
-    GetTempFunc get_temperature[MAX_NUM_SENSORS];
-    GetTempFunc get_critical[MAX_NUM_SENSORS];
-    gint temperature[MAX_NUM_SENSORS];
-    gint critical[MAX_NUM_SENSORS];
+    thermal_sensor *sensors;
+    /* displayed temperature and per sensor history, newest at history_head */
+    gint history[HISTORY_SIZE];
+    guint history_len, history_head;
+    GtkWidget *tooltip_box,
+              *tooltip_label,
+              *tooltip_graph;
 } thermal;
 
 
 static gint
 proc_get_critical(char const* sensor_path){
     FILE *state;
-    char buf[ 256 ], sstmp [ 100 ];
+    char buf[ 256 ];
+    gchar *sstmp;
     char* pstr;
 
     if(sensor_path == NULL) return -1;
 
-    snprintf(sstmp,sizeof(sstmp),"%s%s",sensor_path,PROC_THERMAL_TRIP);
+    sstmp = g_strconcat(sensor_path, PROC_THERMAL_TRIP, NULL);
 
     if (!(state = fopen( sstmp, "r"))) {
         g_warning("thermal: cannot open %s", sstmp);
+        g_free(sstmp);
         return -1;
     }
+    g_free(sstmp);
 
     while( fgets(buf, 256, state) &&
             ! ( pstr = strstr(buf, PROC_TRIP_CRITICAL) ) );
@@ -118,35 +141,22 @@ proc_get_critical(char const* sensor_path){
 }
 
 static gint
-proc_get_temperature(char const* sensor_path){
-    FILE *state;
-    char buf[ 256 ], sstmp [ 100 ];
+proc_parse_temperature(char *buf){
     char* pstr;
 
-    if(sensor_path == NULL) return -1;
-
-    snprintf(sstmp,sizeof(sstmp),"%s%s",sensor_path,PROC_THERMAL_TEMPF);
-
-    if (!(state = fopen( sstmp, "r"))) {
-        g_warning("thermal: cannot open %s", sstmp);
+    if (!(pstr = strstr(buf, "temperature:")))
         return -1;
-    }
 
-    while( fgets(buf, 256, state) &&
-            ! ( pstr = strstr(buf, "temperature:") ) );
-    if( pstr )
-    {
-        pstr += 12;
-        while( *pstr && *pstr == ' ' )
-            ++pstr;
+    pstr += 12;
+    while( *pstr && *pstr == ' ' )
+        ++pstr;
 
-        pstr[strlen(pstr)-3] = '\0';
-        fclose(state);
-        return atoi(pstr);
-    }
+    return atoi(pstr);
+}
 
-    fclose(state);
-    return -1;
+static gint
+sysfs_parse_temperature(char *buf){
+    return atoi(buf)/1000;
 }
 
 static gint _get_reading(const char *path, gboolean quiet)
@@ -175,78 +185,98 @@ static gint _get_reading(const char *path, gboolean quiet)
 
 static gint
 sysfs_get_critical(char const* sensor_path){
-    char sstmp [ 100 ];
-
-    if(sensor_path == NULL) return -1;
-
-    snprintf(sstmp,sizeof(sstmp),"%s%s",sensor_path,SYSFS_THERMAL_TRIP);
-
-    return _get_reading(sstmp, TRUE);
-}
-
-static gint
-sysfs_get_temperature(char const* sensor_path){
-    char sstmp [ 100 ];
+    gchar *sstmp;
+    gint value;
 
     if(sensor_path == NULL) return -1;
 
-    snprintf(sstmp,sizeof(sstmp),"%s%s",sensor_path,SYSFS_THERMAL_TEMPF);
+    sstmp = g_strconcat(sensor_path, SYSFS_THERMAL_TRIP, NULL);
+    value = _get_reading(sstmp, TRUE);
+    g_free(sstmp);
 
-    return _get_reading(sstmp, FALSE);
+    return value;
 }
 
 static gint
 hwmon_get_critical(char const* sensor_path)
 {
-    char sstmp [ 100 ];
-    int spl;
-
-    if(sensor_path == NULL) return -1;
+    gchar *sstmp;
+    gint value;
 
-    spl = strlen(sensor_path) - 6;
-    if (spl < 17 || spl > 94)
+    if(sensor_path == NULL || !g_str_has_suffix(sensor_path, "_input"))
         return -1;
 
-    snprintf(sstmp, sizeof(sstmp), "%.*s_crit", spl, sensor_path);
+    /* tempN_input -> tempN_crit */
+    sstmp = g_strdup_printf("%.*s_crit", (int)strlen(sensor_path) - 6, sensor_path);
+    value = _get_reading(sstmp, TRUE);
+    g_free(sstmp);
 
-    return _get_reading(sstmp, TRUE);
+    return value;
 }
 
-static gint
-hwmon_get_temperature(char const* sensor_path)
+/* Re-reads the open temperature file from its start. */
+static gint read_temperature(thermal_sensor *sensor)
 {
-    if(sensor_path == NULL) return -1;
+    char buf[256];
+    ssize_t len;
+
+    if (sensor->fd < 0)
+        return -1;
+
+    while ((len = pread(sensor->fd, buf, sizeof(buf) - 1, 0)) < 0 && errno == EINTR)
+        continue;
+    if (len <= 0)
+        return -1;
 
-    return _get_reading(sensor_path, FALSE);
+    buf[len] = '\0';
+    return sensor->parse_temperature(buf);
 }
 
+/* Reads all sensors and records their values in the history. Returns the
+   highest or the average temperature. */
 static gint get_temperature(thermal *th, gint *warn)
 {
-    gint max = -273;
+    thermal_sensor *sensor;
+    gint max = -273, sum = 0, n = 0;
     gint cur, i, w = 0;
 
+    if (th->history_len > 0)
+        th->history_head = (th->history_head + 1) % HISTORY_SIZE;
+    if (th->history_len < HISTORY_SIZE)
+        th->history_len++;
+
     for(i = 0; i < th->numsensors; i++){
-        cur = th->get_temperature[i](th->sensor_array[i]);
+        sensor = &th->sensors[i];
+        cur = read_temperature(sensor);
         if (w == 2) ; /* already warning2 */
         else if (th->not_custom_levels &&
-                 th->critical[i] > 0 && cur >= th->critical[i] - 5)
+                 sensor->critical > 0 && cur >= sensor->critical - 5)
             w = 2;
-        else if ((!th->not_custom_levels || th->critical[i] < 0) &&
+        else if ((!th->not_custom_levels || sensor->critical < 0) &&
                  cur >= th->warning2)
             w = 2;
         else if (w == 1) ; /* already warning1 */
         else if (th->not_custom_levels &&
-                 th->critical[i] > 0 && cur >= th->critical[i] - 10)
+                 sensor->critical > 0 && cur >= sensor->critical - 10)
             w = 1;
-        else if ((!th->not_custom_levels || th->critical[i] < 0) &&
+        else if ((!th->not_custom_levels || sensor->critical < 0) &&
                  cur >= th->warning1)
             w = 1;
         if (cur > max)
             max = cur;
-        th->temperature[i] = cur;
+        if (cur != -1) {
+            sum += cur;
+            n++;
+        }
+        sensor->temperature = cur;
+        sensor->history[th->history_head] = cur;
     }
     *warn = w;
 
+    if (th->show_average)
+        max = n ? (sum + n / 2) / n : -1;
+    th->history[th->history_head] = max;
+
     return max;
 }
 
@@ -256,14 +286,137 @@ static gint get_critical(thermal *th)
     gint i;
 
     for(i = 0; i < th->numsensors; i++){
-        th->critical[i] = th->get_critical[i](th->sensor_array[i]);
-        if (th->critical[i] > 0 && th->critical[i] < min)
-            min = th->critical[i];
+        th->sensors[i].critical = th->sensors[i].get_critical(th->sensors[i].path);
+        if (th->sensors[i].critical > 0 && th->sensors[i].critical < min)
+            min = th->sensors[i].critical;
     }
 
     return min;
 }
 
+/* Draws the history of each sensor in grey and of the displayed value on top. */
+static void draw_history(thermal *th, cairo_t *cr, int width, int height)
+{
+    gint lo = G_MAXINT, hi = G_MININT, value;
+    guint i;
+    int s;
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_paint(cr);
+
+    if (th->history_len < 2)
+        return;
+
+    for (s = -1; s < th->numsensors; s++)
+        for (i = 0; i < th->history_len; i++) {
+            value = (s < 0 ? th->history : th->sensors[s].history)
+                        [(th->history_head + HISTORY_SIZE - i) % HISTORY_SIZE];
+            if (value == -1)
+                continue;
+            lo = MIN(lo, value);
+            hi = MAX(hi, value);
+        }
+    if (lo > hi)
+        return;
+    /* leave some room above and below */
+    lo -= 2;
+    hi += 2;
+
+    for (s = 0; s <= th->numsensors; s++) {
+        const gint *history = s < th->numsensors ? th->sensors[s].history : th->history;
+        gboolean drawing = FALSE;
+
+        for (i = 0; i < th->history_len; i++) {
+            value = history[(th->history_head + HISTORY_SIZE - i) % HISTORY_SIZE];
+            if (value == -1) {
+                drawing = FALSE;
+                continue;
+            }
+            if (drawing)
+                cairo_line_to(cr, width - 0.5 - (double)i * (width - 1) / (HISTORY_SIZE - 1),
+                              height - 0.5 - (double)(value - lo) * (height - 1) / (hi - lo));
+            else
+                cairo_move_to(cr, width - 0.5 - (double)i * (width - 1) / (HISTORY_SIZE - 1),
+                              height - 0.5 - (double)(value - lo) * (height - 1) / (hi - lo));
+            drawing = TRUE;
+        }
+        if (s < th->numsensors) {
+            cairo_set_source_rgba(cr, 0.7, 0.7, 0.7, 0.6);
+            cairo_set_line_width(cr, 1.0);
+        } else {
+#if GTK_CHECK_VERSION(3, 0, 0)
+            gdk_cairo_set_source_rgba(cr, &th->cl_normal);
+#else
+            gdk_cairo_set_source_color(cr, &th->cl_normal);
+#endif
+            cairo_set_line_width(cr, 2.0);
+        }
+        cairo_stroke(cr);
+    }
+}
+
+#if GTK_CHECK_VERSION(3, 0, 0)
+static gboolean tooltip_graph_draw(GtkWidget *widget, cairo_t *cr, thermal *th)
+{
+    draw_history(th, cr, gtk_widget_get_allocated_width(widget),
+                 gtk_widget_get_allocated_height(widget));
+    return FALSE;
+}
+#else
+static gboolean tooltip_graph_expose(GtkWidget *widget, GdkEventExpose *event, thermal *th)
+{
+    GtkAllocation allocation;
+    cairo_t *cr = gdk_cairo_create(gtk_widget_get_window(widget));
+
+    gtk_widget_get_allocation(widget, &allocation);
+    draw_history(th, cr, allocation.width, allocation.height);
+    check_cairo_status(cr);
+    cairo_destroy(cr);
+    return FALSE;
+}
+#endif
+
+/* The tooltip is built only when it is shown, a list of dozens of sensors
+   is not worth formatting every tick. */
+static gboolean query_tooltip(GtkWidget *widget, gint x, gint y, gboolean keyboard_mode,
+                              GtkTooltip *tooltip, thermal *th)
+{
+    gchar *separator;
+    int i;
+
+    if (th->numsensors == 0)
+        return FALSE;
+
+    g_string_truncate(th->tip, 0);
+    separator = "";
+    for (i = 0; i < th->numsensors; i++){
+        g_string_append_printf(th->tip, "%s%s:\t%2d°C", separator, th->sensors[i].name, th->sensors[i].temperature);
+        separator = "\n";
+    }
+
+    if (th->tooltip_box == NULL) {
+        th->tooltip_box = gtk_vbox_new(FALSE, 4);
+        g_object_ref_sink(th->tooltip_box);
+        th->tooltip_label = gtk_label_new(NULL);
+        gtk_misc_set_alignment(GTK_MISC(th->tooltip_label), 0, 0.5);
+        gtk_box_pack_start(GTK_BOX(th->tooltip_box), th->tooltip_label, FALSE, FALSE, 0);
+        th->tooltip_graph = gtk_drawing_area_new();
+        gtk_widget_set_size_request(th->tooltip_graph, TOOLTIP_GRAPH_WIDTH, TOOLTIP_GRAPH_HEIGHT);
+#if GTK_CHECK_VERSION(3, 0, 0)
+        g_signal_connect(th->tooltip_graph, "draw", G_CALLBACK(tooltip_graph_draw), th);
+#else
+        g_signal_connect(th->tooltip_graph, "expose-event", G_CALLBACK(tooltip_graph_expose), th);
+#endif
+        gtk_box_pack_start(GTK_BOX(th->tooltip_box), th->tooltip_graph, FALSE, FALSE, 0);
+        gtk_widget_show_all(th->tooltip_box);
+    }
+    gtk_label_set_text(GTK_LABEL(th->tooltip_label), th->tip->str);
+    gtk_widget_queue_draw(th->tooltip_graph);
+    gtk_tooltip_set_custom(tooltip, th->tooltip_box);
+
+    return TRUE;
+}
+
 static void
 update_display(thermal *th)
 {
@@ -275,7 +428,6 @@ update_display(thermal *th)
 #else
     GdkColor color;
 #endif
-    gchar *separator;
 
     temp = get_temperature(th, &i);
     if (i >= 2)
@@ -293,13 +445,9 @@ update_display(thermal *th)
         lxpanel_draw_label_text_with_color(th->panel, th->namew, buffer, TRUE, 1, &color);
     }
 
-    g_string_truncate(th->tip, 0);
-    separator = "";
-    for (i = 0; i < th->numsensors; i++){
-        g_string_append_printf(th->tip, "%s%s:\t%2d°C", separator, th->sensor_name[i], th->temperature[i]);
-        separator = "\n";
-    }
-    gtk_widget_set_tooltip_text(th->namew, th->tip->str);
+    /* refresh the tooltip while it is shown */
+    if (th->tooltip_box && gtk_widget_get_mapped(th->tooltip_box))
+        gtk_widget_trigger_tooltip_query(th->namew);
 }
 
 static gboolean update_display_timeout(gpointer user_data)
@@ -310,25 +458,31 @@ static gboolean update_display_timeout(gpointer user_data)
     return TRUE; /* repeat later */
 }
 
-static int
-add_sensor(thermal* th, char const* sensor_path, const char *sensor_name,
-           GetTempFunc get_temp, GetTempFunc get_crit)
+/* Adds a sensor, its temperature file is opened here once and re-read on
+   each update. */
+static void
+add_sensor(thermal* th, char const* sensor_path, char const* temp_file,
+           const char *sensor_name, ParseTempFunc parse_temp, GetTempFunc get_crit)
 {
-    if (th->numsensors + 1 > MAX_NUM_SENSORS){
-        g_warning("thermal: Too many sensors (max %d), ignoring '%s'",
-                MAX_NUM_SENSORS, sensor_path);
-        return -1;
-    }
+    thermal_sensor *sensor;
+    int i;
 
-    th->sensor_array[th->numsensors] = g_strdup(sensor_path);
-    th->sensor_name[th->numsensors] = g_strdup(sensor_name);
-    th->get_critical[th->numsensors] = get_crit;
-    th->get_temperature[th->numsensors] = get_temp;
+    th->sensors = g_renew(thermal_sensor, th->sensors, th->numsensors + 1);
+    sensor = &th->sensors[th->numsensors];
+    sensor->path = g_strdup(sensor_path);
+    sensor->name = g_strdup(sensor_name);
+    sensor->fd = open(temp_file, O_RDONLY | O_CLOEXEC);
+    if (sensor->fd < 0)
+        g_warning("thermal: cannot open %s", temp_file);
+    sensor->parse_temperature = parse_temp;
+    sensor->get_critical = get_crit;
+    sensor->temperature = -1;
+    sensor->critical = -1;
+    for (i = 0; i < HISTORY_SIZE; i++)
+        sensor->history[i] = -1;
     th->numsensors++;
 
     g_debug("thermal: Added sensor %s", sensor_path);
-
-    return 0;
 }
 
 /* find_sensors():
@@ -338,11 +492,11 @@ add_sensor(thermal* th, char const* sensor_path, const char *sensor_name,
  *      - 'subdir_prefix' may be NULL, in which case any subdir is considered a sensor. */
 static void
 find_sensors(thermal* th, char const* directory, char const* subdir_prefix,
-             GetTempFunc get_temp, GetTempFunc get_crit)
+             char const* temp_file, ParseTempFunc parse_temp, GetTempFunc get_crit)
 {
     GDir *sensorsDirectory;
     const char *sensor_name;
-    char sensor_path[100];
+    gchar *sensor_path, *temp_path;
 
     if (! (sensorsDirectory = g_dir_open(directory, 0, NULL)))
         return;
@@ -355,18 +509,20 @@ find_sensors(thermal* th, char const* directory, char const* subdir_prefix,
             if (strncmp(sensor_name, subdir_prefix, strlen(subdir_prefix)) != 0)
                 continue;
         }
-        snprintf(sensor_path,sizeof(sensor_path),"%s%s/", directory, sensor_name);
-        add_sensor(th, sensor_path, sensor_name, get_temp, get_crit);
+        sensor_path = g_strconcat(directory, sensor_name, "/", NULL);
+        temp_path = g_strconcat(sensor_path, temp_file, NULL);
+        add_sensor(th, sensor_path, temp_path, sensor_name, parse_temp, get_crit);
+        g_free(temp_path);
+        g_free(sensor_path);
     }
     g_dir_close(sensorsDirectory);
 }
 
-static gboolean try_hwmon_sensors(thermal* th, const char *path)
+static gboolean try_hwmon_sensors(thermal* th, const char *path, const char *hwmon_name)
 {
     GDir *sensorsDirectory;
     const char *sensor_name;
-    char sensor_path[100], buf[256];
-    FILE *fp;
+    gchar *sensor_path, *label_path, *label, *name;
     gboolean found = FALSE;
 
     if (!(sensorsDirectory = g_dir_open(path, 0, NULL)))
@@ -374,26 +530,29 @@ static gboolean try_hwmon_sensors(thermal* th, const char *path)
 
     while ((sensor_name = g_dir_read_name(sensorsDirectory)))
     {
-        if (strncmp(sensor_name, "temp", 4) == 0 &&
-            strcmp(&sensor_name[5], "_input") == 0)
+        if (g_str_has_prefix(sensor_name, "temp") &&
+            g_str_has_suffix(sensor_name, "_input"))
         {
-            snprintf(sensor_path, sizeof(sensor_path), "%s/temp%c_label", path,
-                     sensor_name[4]);
-            fp = fopen(sensor_path, "r");
-            buf[0] = '\0';
-            if (fp)
-            {
-                if (fgets(buf, 256, fp))
-                {
-                    char *pp = strchr(buf, '\n');
-                    if (pp)
-                        *pp = '\0';
-                }
-                fclose(fp);
-            }
-            snprintf(sensor_path, sizeof(sensor_path), "%s/%s", path, sensor_name);
-            add_sensor(th, sensor_path, buf[0] ? buf : sensor_name,
-                       hwmon_get_temperature, hwmon_get_critical);
+            /* tempN_input -> tempN_label */
+            label_path = g_strdup_printf("%s/%.*s_label", path,
+                                         (int)strlen(sensor_name) - 6, sensor_name);
+            label = NULL;
+            if (g_file_get_contents(label_path, &label, NULL, NULL))
+                g_strstrip(label);
+            if (label && label[0])
+                name = g_strdup(label);
+            else if (hwmon_name)
+                name = g_strdup_printf("%s %.*s", hwmon_name,
+                                       (int)strlen(sensor_name) - 6, sensor_name);
+            else
+                name = g_strdup(sensor_name);
+            sensor_path = g_build_filename(path, sensor_name, NULL);
+            add_sensor(th, sensor_path, sensor_path, name,
+                       sysfs_parse_temperature, hwmon_get_critical);
+            g_free(sensor_path);
+            g_free(name);
+            g_free(label);
+            g_free(label_path);
             found = TRUE;
         }
     }
@@ -401,22 +560,40 @@ static gboolean try_hwmon_sensors(thermal* th, const char *path)
     return found;
 }
 
+/* Adds inputs of all hwmon devices. Devices which only mirror a thermal zone
+   are skipped, the zone was added already. */
 static void find_hwmon_sensors(thermal* th)
 {
-    char dir_path[100];
-    char *c;
-    int i; /* sensor type num, we'll try up to 4 */
+    GDir *hwmonDirectory;
+    const char *entry;
+    gchar *dir_path, *device_path, *link, *name_path, *name;
 
-    for (i = 0; i < 4; i++)
+    if (!(hwmonDirectory = g_dir_open(HWMON_DIRECTORY, 0, NULL)))
+        return;
+
+    while ((entry = g_dir_read_name(hwmonDirectory)))
     {
-        snprintf(dir_path, sizeof(dir_path), "/sys/class/hwmon/hwmon%d/device", i);
-        if (try_hwmon_sensors(th, dir_path))
-            continue;
-        /* no sensors found under device/, try parent dir */
-        c = strrchr(dir_path, '/');
-        *c = '\0';
-        try_hwmon_sensors(th, dir_path);
+        dir_path = g_strconcat(HWMON_DIRECTORY, entry, NULL);
+        device_path = g_strconcat(dir_path, "/device", NULL);
+        link = g_file_read_link(device_path, NULL);
+        if (link == NULL || !g_str_has_prefix(strrchr(link, '/') ? strrchr(link, '/') + 1 : link,
+                                              SYSFS_THERMAL_SUBDIR_PREFIX))
+        {
+            name_path = g_strconcat(dir_path, "/name", NULL);
+            name = NULL;
+            if (g_file_get_contents(name_path, &name, NULL, NULL))
+                g_strstrip(name);
+            /* older drivers keep the inputs under device/ */
+            if (!try_hwmon_sensors(th, device_path, name))
+                try_hwmon_sensors(th, dir_path, name);
+            g_free(name);
+            g_free(name_path);
+        }
+        g_free(link);
+        g_free(device_path);
+        g_free(dir_path);
     }
+    g_dir_close(hwmonDirectory);
 }
 
 
@@ -429,21 +606,27 @@ remove_all_sensors(thermal *th)
 
     for (i = 0; i < th->numsensors; i++)
     {
-        g_free(th->sensor_array[i]);
-        g_free(th->sensor_name[i]);
+        if (th->sensors[i].fd >= 0)
+            close(th->sensors[i].fd);
+        g_free(th->sensors[i].path);
+        g_free(th->sensors[i].name);
     }
+    g_free(th->sensors);
+    th->sensors = NULL;
 
     th->numsensors = 0;
+    th->history_len = th->history_head = 0;
 }
 
 static void
 check_sensors( thermal *th )
 {
     // FIXME: scan in opposite order
-    find_sensors(th, PROC_THERMAL_DIRECTORY, NULL, proc_get_temperature, proc_get_critical);
-    find_sensors(th, SYSFS_THERMAL_DIRECTORY, SYSFS_THERMAL_SUBDIR_PREFIX, sysfs_get_temperature, sysfs_get_critical);
-    if (th->numsensors == 0)
-        find_hwmon_sensors(th);
+    find_sensors(th, PROC_THERMAL_DIRECTORY, NULL, PROC_THERMAL_TEMPF,
+                 proc_parse_temperature, proc_get_critical);
+    find_sensors(th, SYSFS_THERMAL_DIRECTORY, SYSFS_THERMAL_SUBDIR_PREFIX, SYSFS_THERMAL_TEMPF,
+                 sysfs_parse_temperature, sysfs_get_critical);
+    find_hwmon_sensors(th);
     g_info("thermal: Found %d sensors", th->numsensors);
 }
 
@@ -469,11 +652,22 @@ static gboolean applyConfig(gpointer p)
     if(th->sensor == NULL) th->auto_sensor = TRUE;
     if(th->auto_sensor) check_sensors(th);
     else if (strncmp(th->sensor, "/sys/", 5) != 0)
-        add_sensor(th, th->sensor, th->sensor, proc_get_temperature, proc_get_critical);
-    else if (strncmp(th->sensor, "/sys/class/hwmon/", 17) != 0)
-        add_sensor(th, th->sensor, th->sensor, sysfs_get_temperature, sysfs_get_critical);
+    {
+        gchar *temp_file = g_strconcat(th->sensor, PROC_THERMAL_TEMPF, NULL);
+        add_sensor(th, th->sensor, temp_file, th->sensor,
+                   proc_parse_temperature, proc_get_critical);
+        g_free(temp_file);
+    }
+    else if (strncmp(th->sensor, HWMON_DIRECTORY, strlen(HWMON_DIRECTORY)) != 0)
+    {
+        gchar *temp_file = g_strconcat(th->sensor, SYSFS_THERMAL_TEMPF, NULL);
+        add_sensor(th, th->sensor, temp_file, th->sensor,
+                   sysfs_parse_temperature, sysfs_get_critical);
+        g_free(temp_file);
+    }
     else
-        add_sensor(th, th->sensor, th->sensor, hwmon_get_temperature, hwmon_get_critical);
+        add_sensor(th, th->sensor, th->sensor, th->sensor,
+                   sysfs_parse_temperature, hwmon_get_critical);
 
     critical = get_critical(th);
 
@@ -492,6 +686,7 @@ static gboolean applyConfig(gpointer p)
     config_group_set_int(th->settings, "Warning2Temp", th->warning2);
     config_group_set_int(th->settings, "AutomaticSensor", th->auto_sensor);
     config_group_set_string(th->settings, "Sensor", th->sensor);
+    config_group_set_int(th->settings, "ShowAverage", th->show_average);
     RET(FALSE);
 }
 
@@ -502,6 +697,8 @@ thermal_destructor(gpointer user_data)
 
   ENTER;
   remove_all_sensors(th);
+  if (th->tooltip_box)
+    g_object_unref(th->tooltip_box);
   g_string_free(th->tip, TRUE);
   g_free(th->sensor);
   g_free(th->str_cl_normal);
@@ -530,6 +727,8 @@ thermal_constructor(LXPanel *panel, config_setting_t *settings)
 
     th->namew = gtk_label_new("ww");
     gtk_container_add(GTK_CONTAINER(p), th->namew);
+    gtk_widget_set_has_tooltip(th->namew, TRUE);
+    g_signal_connect(th->namew, "query-tooltip", G_CALLBACK(query_tooltip), th);
 
     th->tip = g_string_new(NULL);
 
@@ -552,6 +751,7 @@ thermal_constructor(LXPanel *panel, config_setting_t *settings)
         th->sensor = g_strdup(tmp);
     config_setting_lookup_int(settings, "Warning1Temp", &th->warning1);
     config_setting_lookup_int(settings, "Warning2Temp", &th->warning2);
+    config_setting_lookup_int(settings, "ShowAverage", &th->show_average);
 
     if(!th->str_cl_normal)
         th->str_cl_normal = g_strdup("#00ff00");
@@ -586,6 +786,7 @@ static GtkWidget *config(LXPanel *panel, GtkWidget *p)
             _("Automatic temperature levels"), &th->not_custom_levels, CONF_TYPE_BOOL, // FIXME: if off, disable two below
             _("Warning1 temperature"), &th->warning1, CONF_TYPE_INT,
             _("Warning2 temperature"), &th->warning2, CONF_TYPE_INT,
+            _("Show average of all sensors instead of the highest"), &th->show_average, CONF_TYPE_BOOL,
             NULL);
 
     RET(dialog);
@@ -31,6 +31,7 @@
 
 #include "misc.h"
 #include "plugin.h"
+#include "ev.h"
 
 /* Commands that can be issued. */
 typedef enum {
@@ -73,12 +74,12 @@ static void wincmd_execute(GdkScreen * screen, WinCmdPlugin * wc, WindowCommand
     /* Get the list of all windows. */
     int client_count;
     Screen * xscreen = GDK_SCREEN_XSCREEN(screen);
-    Window * client_list = get_xaproperty (RootWindowOfScreen(xscreen), a_NET_CLIENT_LIST, XA_WINDOW, &client_count);
+    Window * client_list = fb_ev_client_list(fbev, &client_count);
     Display *xdisplay = DisplayOfScreen(xscreen);
     if (client_list != NULL)
     {
         /* Loop over all windows. */
-        int current_desktop = get_net_current_desktop();
+        int current_desktop = fb_ev_current_desktop(fbev);
         int i;
         for (i = 0; i < client_count; i++)
         {
@@ -112,7 +113,6 @@ static void wincmd_execute(GdkScreen * screen, WinCmdPlugin * wc, WindowCommand
                 }
             }
         }
-        XFree(client_list);
 
 	/* Adjust toggle state. */
         wincmd_adjust_toggle_state(wc);
@@ -31,9 +31,7 @@
 #include <gtk/gtk.h>
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
-
-#if !GTK_CHECK_VERSION(3, 0, 0)
-/* we don't provide these APIs for GTK+ 3.0 */
+#include <cairo-xlib.h>
 
 #include "bg.h"
 
@@ -59,16 +57,27 @@ struct _FbBg {
     GC       gc;
     Display *dpy;
     Pixmap   pixmap;
+    GSList  *cache;         /* FbBgArea copies of the root pixmap */
+    GdkScreen *screen;
 };
 
+/* Client side copy of the root pixmap over one monitor, or over the whole
+   screen for windows which span several monitors. */
+typedef struct {
+    GdkRectangle     area;
+    cairo_surface_t *surface;
+} FbBgArea;
+
 static void fb_bg_class_init (FbBgClass *klass);
 static void fb_bg_init (FbBg *monitor);
 static void fb_bg_finalize (GObject *object);
 static Pixmap fb_bg_get_xrootpmap(FbBg *monitor);
 static void fb_bg_changed(FbBg *monitor);
+static void fb_bg_clear_cache(FbBg *bg);
 
 
 static guint signals [LAST_SIGNAL] = { 0 };
+static GObjectClass *parent_class = NULL;
 
 static FbBg *default_bg = NULL;
 
@@ -104,6 +113,7 @@ fb_bg_class_init (FbBgClass *klass)
 {
     GObjectClass *object_class = G_OBJECT_CLASS (klass);
     ENTER;
+    parent_class = g_type_class_peek_parent(klass);
     signals [CHANGED] =
         g_signal_new ("changed",
               G_OBJECT_CLASS_TYPE (object_class),
@@ -137,6 +147,12 @@ fb_bg_init (FbBg *bg)
         mask |= GCTile ;
     }
     bg->gc = XCreateGC (bg->dpy, bg->xroot, mask, &gcv) ;
+    /* cached areas follow the monitors layout */
+    bg->screen = gdk_screen_get_default();
+    g_signal_connect_swapped(bg->screen, "monitors-changed",
+                             G_CALLBACK(fb_bg_clear_cache), bg);
+    g_signal_connect_swapped(bg->screen, "size-changed",
+                             G_CALLBACK(fb_bg_clear_cache), bg);
     RET();
 }
 
@@ -147,10 +163,29 @@ fb_bg_finalize (GObject *object)
 
     ENTER;
     bg = FB_BG (object);
+    g_signal_handlers_disconnect_by_func(bg->screen, fb_bg_clear_cache, bg);
+    fb_bg_clear_cache(bg);
     XFreeGC(bg->dpy, bg->gc);
+    G_OBJECT_CLASS(parent_class)->finalize(object);
     RET();
 }
 
+static void
+fb_bg_clear_cache(FbBg *bg)
+{
+    GSList *l;
+
+    for (l = bg->cache; l; l = l->next)
+    {
+        FbBgArea *area = l->data;
+
+        cairo_surface_destroy(area->surface);
+        g_slice_free(FbBgArea, area);
+    }
+    g_slist_free(bg->cache);
+    bg->cache = NULL;
+}
+
 
 static Pixmap
 fb_bg_get_xrootpmap(FbBg *bg)
@@ -182,6 +217,166 @@ fb_bg_get_xrootpmap(FbBg *bg)
 }
 
 
+/* Copies the root pixmap over @area into an image surface, tiling it the
+   same way the X server does for the root window. */
+static cairo_surface_t *
+fb_bg_copy_root(FbBg *bg, const GdkRectangle *area)
+{
+    Window dummy;
+    int x, y, ok;
+    guint width, height, border, depth;
+    cairo_surface_t *xsurface, *surface;
+    cairo_pattern_t *pattern;
+    cairo_matrix_t matrix;
+    cairo_t *cr;
+
+    ENTER;
+    if (bg->pixmap == None)
+        RET(NULL);
+    /* the pixmap may be gone already if the setter freed it */
+    gdk_error_trap_push();
+    ok = XGetGeometry(bg->dpy, bg->pixmap, &dummy, &x, &y, &width, &height,
+                      &border, &depth);
+    if (gdk_error_trap_pop() || !ok)
+        RET(NULL);
+    if (depth != (guint)DefaultDepth(bg->dpy, DefaultScreen(bg->dpy)))
+    {
+        g_warning("root pixmap depth %u is not supported", depth);
+        RET(NULL);
+    }
+    DBG("copying root pixmap %dx%d to %dx%d%+d%+d\n", width, height,
+        area->width, area->height, area->x, area->y);
+
+    xsurface = cairo_xlib_surface_create(bg->dpy, bg->pixmap,
+                                         DefaultVisual(bg->dpy, DefaultScreen(bg->dpy)),
+                                         width, height);
+    pattern = cairo_pattern_create_for_surface(xsurface);
+    cairo_pattern_set_extend(pattern, CAIRO_EXTEND_REPEAT);
+    cairo_matrix_init_translate(&matrix, area->x, area->y);
+    cairo_pattern_set_matrix(pattern, &matrix);
+
+    surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, area->width, area->height);
+    cr = cairo_create(surface);
+    cairo_set_source(cr, pattern);
+    cairo_paint(cr);
+    check_cairo_status(cr);
+    cairo_destroy(cr);
+    cairo_pattern_destroy(pattern);
+    cairo_surface_destroy(xsurface);
+    RET(surface);
+}
+
+/* Returns the cached area containing @rect, copying it on first use. */
+static FbBgArea *
+fb_bg_get_area(FbBg *bg, const GdkRectangle *rect)
+{
+    GdkRectangle mon, cover;
+    FbBgArea *area;
+    GSList *l;
+    int i, n;
+
+    cover.x = cover.y = 0;
+    cover.width = gdk_screen_get_width(bg->screen);
+    cover.height = gdk_screen_get_height(bg->screen);
+    n = gdk_screen_get_n_monitors(bg->screen);
+    for (i = 0; i < n; i++)
+    {
+        gdk_screen_get_monitor_geometry(bg->screen, i, &mon);
+        if (rect->x >= mon.x && rect->y >= mon.y &&
+            rect->x + rect->width <= mon.x + mon.width &&
+            rect->y + rect->height <= mon.y + mon.height)
+        {
+            cover = mon;
+            break;
+        }
+    }
+
+    for (l = bg->cache; l; l = l->next)
+    {
+        area = l->data;
+        if (area->area.x == cover.x && area->area.y == cover.y &&
+            area->area.width == cover.width && area->area.height == cover.height)
+            return area;
+    }
+
+    area = g_slice_new(FbBgArea);
+    area->area = cover;
+    area->surface = fb_bg_copy_root(bg, &cover);
+    if (area->surface == NULL)
+    {
+        /* try again next time */
+        g_slice_free(FbBgArea, area);
+        return NULL;
+    }
+    bg->cache = g_slist_prepend(bg->cache, area);
+    return area;
+}
+
+/**
+ * fb_bg_hash_root
+ * @bg: the background monitor
+ * @rect: area of the root window, in root coordinates
+ *
+ * Computes a hash of the root window background within @rect, so callers
+ * can tell whether the pixels behind them changed after
+ * fb_bg_notify_changed_bg().
+ *
+ * Returns: the hash, or 0 if there is no root pixmap.
+ */
+guint32
+fb_bg_hash_root(FbBg *bg, const GdkRectangle *rect)
+{
+    FbBgArea *area;
+    GdkRectangle slice;
+    const guchar *data;
+    const guint32 *row;
+    guint32 hash = 2166136261u; /* FNV-1a */
+    int stride, x, y;
+
+    ENTER;
+    area = fb_bg_get_area(bg, rect);
+    if (area == NULL || !gdk_rectangle_intersect(&area->area, rect, &slice))
+        RET(0);
+    cairo_surface_flush(area->surface);
+    data = cairo_image_surface_get_data(area->surface);
+    stride = cairo_image_surface_get_stride(area->surface);
+    for (y = slice.y - area->area.y; y < slice.y - area->area.y + slice.height; y++)
+    {
+        row = (const guint32 *)(data + y * stride) + slice.x - area->area.x;
+        for (x = 0; x < slice.width; x++)
+            hash = (hash ^ row[x]) * 16777619u;
+    }
+    RET(hash);
+}
+
+/**
+ * fb_bg_paint_root
+ * @bg: the background monitor
+ * @cr: context to paint on
+ * @rect: area of the root window, in root coordinates
+ *
+ * Paints the root window background within @rect at the origin of @cr.
+ * The root pixmap is copied once per monitor and reused by all callers
+ * until fb_bg_notify_changed_bg() is called.
+ */
+void
+fb_bg_paint_root(FbBg *bg, cairo_t *cr, const GdkRectangle *rect)
+{
+    FbBgArea *area;
+
+    ENTER;
+    area = fb_bg_get_area(bg, rect);
+    if (area == NULL)
+        RET();
+    cairo_set_source_surface(cr, area->surface,
+                             area->area.x - rect->x, area->area.y - rect->y);
+    cairo_paint(cr);
+    RET();
+}
+
+#if !GTK_CHECK_VERSION(3, 0, 0)
+/* we don't provide these APIs for GTK+ 3.0 */
+
 GdkPixmap *
 fb_bg_get_xroot_pix_for_win(FbBg *bg, GtkWidget *widget)
 {
@@ -229,12 +424,14 @@ fb_bg_composite(GdkDrawable *base, GdkColor *tintcolor, gint alpha)
     g_object_unref(bg);
     RET();
 }
+#endif /* GTK_CHECK_VERSION */
 
 
 static void
 fb_bg_changed(FbBg *bg)
 {
     ENTER;
+    fb_bg_clear_cache(bg);
     bg->pixmap = fb_bg_get_xrootpmap(bg);
     if (bg->pixmap != None) {
         XGCValues  gcv;
@@ -267,6 +464,7 @@ FbBg *fb_bg_get_for_display(void)
     RET(default_bg);
 }
 
+#if !GTK_CHECK_VERSION(3, 0, 0)
 GdkPixmap *
 fb_bg_get_pix_from_file(GtkWidget *widget, const char *filename)
 {
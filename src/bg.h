@@ -56,9 +56,13 @@ typedef struct _FbBg      FbBg;
 
 GType fb_bg_get_type       (void);
 #define fb_bg_new() (FbBg *)g_object_new(FB_TYPE_BG, NULL)
-void fb_bg_composite(GdkDrawable *base, GdkColor *tintcolor, gint alpha);
-GdkPixmap *fb_bg_get_xroot_pix_for_win(FbBg *bg, GtkWidget *widget);
+void fb_bg_paint_root(FbBg *bg, cairo_t *cr, const GdkRectangle *rect);
+guint32 fb_bg_hash_root(FbBg *bg, const GdkRectangle *rect);
 void fb_bg_notify_changed_bg(FbBg *bg);
 FbBg *fb_bg_get_for_display(void);
+#if !GTK_CHECK_VERSION(3, 0, 0)
+void fb_bg_composite(GdkDrawable *base, GdkColor *tintcolor, gint alpha);
+GdkPixmap *fb_bg_get_xroot_pix_for_win(FbBg *bg, GtkWidget *widget);
 GdkPixmap *fb_bg_get_pix_from_file(GtkWidget *widget, const char *filename);
+#endif
 #endif /* __FB_BG_H__ */
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2026 LXPanel Developers
+ *
+ * This file is a part of LXPanel project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Micro-benchmark of the config parser: loads a config with a large group
+ * and a launcher with as many buttons, then times member lookups in the
+ * group and moves of buttons to both ends of their list. Each phase is
+ * run for growing sizes so the time per operation shows how it scales:
+ * it should stay flat, not grow with the size.
+ *
+ * Usage: conf-bench [settings]    (default is 10000) */
+
+#include "conf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+static void print_result(const char *phase, guint n, gint64 elapsed)
+{
+    printf("%-12s %6u: %8.3f ms, %8.1f ns per setting\n", phase, n,
+           elapsed / 1000.0, elapsed * 1000.0 / n);
+}
+
+/* Writes config with group Global of n integers and a launchbar plugin
+   with n buttons, returns the file name. */
+static gchar *write_config(guint n)
+{
+    GString *buf = g_string_new("# lxpanel <profile> config file\nGlobal {\n");
+    gchar *filename;
+    GError *error = NULL;
+    guint i;
+    int fd;
+
+    for (i = 0; i < n; i++)
+        g_string_append_printf(buf, "  key%u=%u\n", i, i);
+    g_string_append(buf, "}\nPlugin {\n  type=launchbar\n  Config {\n");
+    for (i = 0; i < n; i++)
+        g_string_append_printf(buf, "    Button {\n      id=app%u.desktop\n    }\n", i);
+    g_string_append(buf, "  }\n}\n");
+    fd = g_file_open_tmp("conf-bench-XXXXXX", &filename, &error);
+    if (fd < 0)
+    {
+        g_warning("conf-bench: %s", error->message);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    if (!g_file_set_contents(filename, buf->str, buf->len, &error))
+    {
+        g_warning("conf-bench: %s", error->message);
+        exit(EXIT_FAILURE);
+    }
+    g_string_free(buf, TRUE);
+    return filename;
+}
+
+static gboolean run(guint n)
+{
+    gchar *filename = write_config(n);
+    gchar **names = g_new(gchar *, n + 1);
+    PanelConf *config = config_new();
+    config_setting_t *list, *global, *plugin, *buttons, *s;
+    gint64 start;
+    guint i;
+    int val;
+    gboolean ok = TRUE;
+
+    for (i = 0; i < n; i++)
+        names[i] = g_strdup_printf("key%u", i);
+    names[n] = NULL;
+
+    start = g_get_monotonic_time();
+    if (!config_read_file(config, filename))
+    {
+        g_warning("conf-bench: cannot read %s", filename);
+        ok = FALSE;
+        goto out;
+    }
+    print_result("read", n, g_get_monotonic_time() - start);
+
+    list = config_setting_get_member(config_root_setting(config), "");
+    global = config_setting_get_elem(list, 0);
+    plugin = config_setting_get_elem(list, 1);
+    s = config_setting_get_elem(config_setting_get_member(plugin, ""), 0);
+    buttons = s ? config_setting_get_member(s, "") : NULL;
+    if (global == NULL || buttons == NULL)
+    {
+        g_warning("conf-bench: unexpected config structure");
+        ok = FALSE;
+        goto out;
+    }
+
+    /* the first lookup builds the index of the group */
+    start = g_get_monotonic_time();
+    for (i = 0; i < n; i++)
+        if (!config_setting_lookup_int(global, names[i], &val) || val != (int)i)
+        {
+            g_warning("conf-bench: lookup of %s failed", names[i]);
+            ok = FALSE;
+            goto out;
+        }
+    print_result("lookup", n, g_get_monotonic_time() - start);
+
+    /* rotate the list forth and back, ending in the original order */
+    start = g_get_monotonic_time();
+    for (i = 0; i < n; i++)
+        config_setting_move_elem(config_setting_get_elem(buttons, 0), buttons, n);
+    print_result("move to end", n, g_get_monotonic_time() - start);
+
+    start = g_get_monotonic_time();
+    for (i = 0; i < n; i++)
+        config_setting_move_elem(config_setting_get_elem(buttons, n - 1), buttons, 0);
+    print_result("move to head", n, g_get_monotonic_time() - start);
+
+    /* check the order, dropping each button once it is checked */
+    for (i = 0; i < n; i++)
+    {
+        const char *id = NULL;
+        gchar *expected = g_strdup_printf("app%u.desktop", i);
+        gboolean same;
+
+        s = config_setting_get_elem(buttons, 0);
+        same = s && config_setting_lookup_string(s, "id", &id) && strcmp(id, expected) == 0;
+        g_free(expected);
+        config_setting_destroy(s);
+        if (!same)
+        {
+            g_warning("conf-bench: buttons are out of order after moves");
+            ok = FALSE;
+            break;
+        }
+    }
+
+out:
+    config_destroy(config);
+    g_strfreev(names);
+    g_unlink(filename);
+    g_free(filename);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    guint n = 10000, size;
+
+    if (argc > 1)
+        n = strtoul(argv[1], NULL, 10);
+    if (n == 0)
+    {
+        fprintf(stderr, "Usage: %s [settings]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    /* smaller sizes first, for comparison */
+    for (size = MAX(n / 100, 1); size < n; size *= 10)
+        if (!run(size))
+            return EXIT_FAILURE;
+    return run(n) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
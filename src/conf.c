@@ -28,10 +28,15 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
 
 struct _config_setting_t
 {
     config_setting_t *next;
+    config_setting_t *prev;
     config_setting_t *parent;
     PanelConfType type;
     PanelConfSaveHook hook;
@@ -42,36 +47,86 @@ struct _config_setting_t
         gchar *str; /* for string */
         config_setting_t *first; /* for group or list */
     };
+    /* for group or list */
+    config_setting_t *last;
+    guint n_children;
+    GHashTable *members; /* name -> child index of a large group */
 };
 
+/* groups with this many members get the name index on first lookup */
+#define CONFIG_INDEX_MIN_MEMBERS 16
+
 struct _PanelConf
 {
     config_setting_t *root;
 };
 
+/* inserts setting into parent after prev, at start if prev is NULL */
+static void _config_setting_link(config_setting_t *setting, config_setting_t *parent,
+                                 config_setting_t *prev)
+{
+    setting->parent = parent;
+    setting->prev = prev;
+    setting->next = prev ? prev->next : parent->first;
+    if (prev)
+        prev->next = setting;
+    else
+        parent->first = setting;
+    if (setting->next)
+        setting->next->prev = setting;
+    else
+        parent->last = setting;
+    parent->n_children++;
+    if (parent->members && setting->name)
+    {
+        if (g_hash_table_lookup(parent->members, setting->name))
+        {
+            /* the index works only for unique names, let lookups scan */
+            g_hash_table_destroy(parent->members);
+            parent->members = NULL;
+        }
+        else
+            g_hash_table_insert(parent->members, setting->name, setting);
+    }
+}
+
+/* removes setting from its parent without freeing it */
+static void _config_setting_unlink(config_setting_t *setting)
+{
+    config_setting_t *parent = setting->parent;
+
+    if (setting->prev)
+        setting->prev->next = setting->next;
+    else
+        parent->first = setting->next;
+    if (setting->next)
+        setting->next->prev = setting->prev;
+    else
+        parent->last = setting->prev;
+    parent->n_children--;
+    if (parent->members && setting->name)
+        g_hash_table_remove(parent->members, setting->name);
+    setting->next = NULL;
+    setting->prev = NULL;
+    setting->parent = NULL;
+}
+
 static config_setting_t *_config_setting_t_new(config_setting_t *parent, int index,
                                                const char *name, PanelConfType type)
 {
-    config_setting_t *s;
+    config_setting_t *s, *prev;
     s = g_slice_new0(config_setting_t);
     s->type = type;
     s->name = g_strdup(name);
     if (parent == NULL || (parent->type != PANEL_CONF_TYPE_GROUP && parent->type != PANEL_CONF_TYPE_LIST))
         return s;
-    s->parent = parent;
-    if (parent->first == NULL || index == 0)
-    {
-        s->next = parent->first;
-        parent->first = s;
-    }
-    else
-    {
-        for (parent = parent->first; parent->next && index != 1; parent = parent->next)
-            index--;
+    if (index < 0 || (guint)index >= parent->n_children)
         /* FIXME: check if index is out of range? */
-        s->next = parent->next;
-        parent->next = s;
-    }
+        prev = parent->last;
+    else
+        for (prev = NULL; index > 0; index--)
+            prev = prev ? prev->next : parent->first;
+    _config_setting_link(s, parent, prev);
     return s;
 }
 
@@ -86,6 +141,8 @@ static void _config_setting_t_free(config_setting_t *setting)
         break;
     case PANEL_CONF_TYPE_GROUP:
     case PANEL_CONF_TYPE_LIST:
+        if (setting->members)
+            g_hash_table_destroy(setting->members);
         while (setting->first)
         {
             config_setting_t *s = setting->first;
@@ -105,23 +162,43 @@ static void _config_setting_t_remove(config_setting_t *setting)
     g_return_if_fail(setting->parent);
     g_return_if_fail(setting->parent->type == PANEL_CONF_TYPE_GROUP || setting->parent->type == PANEL_CONF_TYPE_LIST);
     /* remove from parent */
-    if (setting->parent->first == setting)
-        setting->parent->first = setting->next;
-    else
-    {
-        config_setting_t *s = setting->parent->first;
-        while (s->next != NULL && s->next != setting)
-            s = s->next;
-        g_assert(s->next != NULL);
-        s->next = setting->next;
-    }
+    _config_setting_unlink(setting);
     /* free the data */
     _config_setting_t_free(setting);
 }
 
+/* builds name index of a group, fails if some names are not unique */
+static void _config_setting_build_index(config_setting_t *setting)
+{
+    config_setting_t *s;
+
+    setting->members = g_hash_table_new(g_str_hash, g_str_equal);
+    for (s = setting->first; s; s = s->next)
+    {
+        if (s->name == NULL)
+            continue;
+        if (g_hash_table_lookup(setting->members, s->name))
+        {
+            g_hash_table_destroy(setting->members);
+            setting->members = NULL;
+            return;
+        }
+        g_hash_table_insert(setting->members, s->name, s);
+    }
+}
+
 static config_setting_t * _config_setting_get_member(const config_setting_t * setting, const char * name)
 {
     config_setting_t *s;
+
+    if (name != NULL && setting->type == PANEL_CONF_TYPE_GROUP)
+    {
+        /* plugins look up their settings a lot, don't scan large groups */
+        if (setting->members == NULL && setting->n_children >= CONFIG_INDEX_MIN_MEMBERS)
+            _config_setting_build_index((config_setting_t *)setting);
+        if (setting->members)
+            return g_hash_table_lookup(setting->members, name);
+    }
     for (s = setting->first; s; s = s->next)
         if (g_strcmp0(s->name, name) == 0)
             break;
@@ -376,20 +453,170 @@ static void _config_write_setting(const config_setting_t *setting, GString *buf,
     g_string_truncate(buf, indent);
 }
 
-gboolean config_write_file(PanelConf * config, const char * filename)
+/* Serializes the config into a buffer, exactly as it is saved into file. */
+static gchar *_config_write_to_data(PanelConf * config, gsize * length)
 {
-    FILE *f = fopen(filename, "w");
+    char *data = NULL;
+    size_t size = 0;
+    gchar *result;
     GString *str;
+    FILE *f;
+
+    /* old plugins save their settings into FILE so let them write there */
+    f = open_memstream(&data, &size);
     if (f == NULL)
-        return FALSE;
+        return NULL;
     fputs("# lxpanel <profile> config file. Manually editing is not recommended.\n"
           "# Use preference dialog in lxpanel to adjust config when you can.\n\n", f);
     str = g_string_sized_new(128);
     _config_write_setting(config_setting_get_member(config->root, ""), str, NULL, f);
-    /* FIXME: handle errors */
-    fclose(f);
     g_string_free(str, TRUE);
+    if (fclose(f) != 0)
+    {
+        free(data);
+        return NULL;
+    }
+    result = g_strndup(data, size);
+    free(data);
+    *length = size;
+    return result;
+}
+
+/* Replaces the file atomically: a crash leaves either old or new contents. */
+static gboolean _config_write_data(const char * filename, const gchar * data,
+                                   gsize length, GError ** error)
+{
+    gchar *tmp = g_strconcat(filename, ".XXXXXX", NULL);
+    gssize written;
+    int fd, saved_errno;
+
+    fd = g_mkstemp_full(tmp, O_RDWR, 0666);
+    if (fd < 0)
+        goto failed;
+    while (length > 0)
+    {
+        written = write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            goto failed_close;
+        }
+        data += written;
+        length -= written;
+    }
+    if (fsync(fd) < 0)
+        goto failed_close;
+    if (close(fd) < 0)
+    {
+        fd = -1;
+        goto failed_close;
+    }
+    if (g_rename(tmp, filename) < 0)
+    {
+        fd = -1;
+        goto failed_close;
+    }
+    g_free(tmp);
     return TRUE;
+
+failed_close:
+    saved_errno = errno;
+    if (fd >= 0)
+        close(fd);
+    g_unlink(tmp);
+    errno = saved_errno;
+failed:
+    saved_errno = errno;
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                "%s: %s", filename, g_strerror(saved_errno));
+    g_free(tmp);
+    return FALSE;
+}
+
+typedef struct
+{
+    gchar *filename;
+    gchar *data;
+    gsize length;
+} ConfigWriteJob;
+
+/* single thread, so files are written in the order they were queued */
+static GThreadPool *write_pool = NULL;
+
+static void _config_write_job(gpointer data, gpointer unused)
+{
+    ConfigWriteJob *job = data;
+    GError *error = NULL;
+
+    if (!_config_write_data(job->filename, job->data, job->length, &error))
+    {
+        g_warning("can't save config: %s", error->message);
+        g_error_free(error);
+    }
+    g_free(job->filename);
+    g_free(job->data);
+    g_slice_free(ConfigWriteJob, job);
+}
+
+void _config_write_data_async(gchar * filename, gchar * data, gsize length)
+{
+    ConfigWriteJob *job = g_slice_new(ConfigWriteJob);
+
+    job->filename = filename;
+    job->data = data;
+    job->length = length;
+    if (write_pool == NULL)
+        write_pool = g_thread_pool_new(_config_write_job, NULL, 1, FALSE, NULL);
+    if (write_pool != NULL)
+        g_thread_pool_push(write_pool, job, NULL);
+    else
+        _config_write_job(job, NULL);
+}
+
+void config_write_flush(void)
+{
+    if (write_pool == NULL)
+        return;
+    /* waits for queued writes */
+    g_thread_pool_free(write_pool, FALSE, TRUE);
+    write_pool = NULL;
+}
+
+gboolean config_write_file(PanelConf * config, const char * filename)
+{
+    GError *error = NULL;
+    gchar *data;
+    gsize length;
+    gboolean ok;
+
+    data = _config_write_to_data(config, &length);
+    if (data == NULL)
+        return FALSE;
+    /* don't let a queued write replace this one */
+    config_write_flush();
+    ok = _config_write_data(filename, data, length, &error);
+    if (!ok)
+    {
+        g_warning("can't save config: %s", error->message);
+        g_error_free(error);
+    }
+    g_free(data);
+    return ok;
+}
+
+void config_write_file_async(PanelConf * config, const char * filename)
+{
+    gchar *data;
+    gsize length;
+
+    data = _config_write_to_data(config, &length);
+    if (data == NULL)
+    {
+        g_warning("can't save config: %s", g_strerror(errno));
+        return;
+    }
+    _config_write_data_async(g_strdup(filename), data, length);
 }
 
 /* it is used for old plugins only */
@@ -421,6 +648,10 @@ config_setting_t * config_setting_get_elem(const config_setting_t * setting, uns
     config_setting_t *s;
     g_return_val_if_fail(setting, NULL);
     g_return_val_if_fail(setting->type == PANEL_CONF_TYPE_LIST || setting->type == PANEL_CONF_TYPE_GROUP, NULL);
+    if (index >= setting->n_children)
+        return NULL;
+    if (index == setting->n_children - 1)
+        return setting->last;
     for (s = setting->first; s && index > 0; s = s->next)
         index--;
     return s;
@@ -505,55 +736,6 @@ config_setting_t * config_setting_add(config_setting_t * parent, const char * na
 }
 
 
-static void remove_from_parent(config_setting_t * setting)
-{
-    config_setting_t *s;
-
-    if (setting->parent->first == setting) {
-        setting->parent->first = setting->next;
-        goto _isolate_setting;
-    }
-
-    for (s = setting->parent->first; s->next; s = s->next)
-        if (s->next == setting)
-            break;
-    g_assert(s->next);
-    s->next = setting->next;
-
-_isolate_setting:
-    setting->next = NULL;
-    setting->parent = NULL;
-}
-
-static void append_to_parent(config_setting_t * setting, config_setting_t * parent)
-{
-    config_setting_t *s;
-
-    setting->parent = parent;
-    if (parent->first == NULL) {
-        parent->first = setting;
-        return;
-    }
-
-    s = parent->first;
-    while (s->next)
-        s = s->next;
-    s->next = setting;
-}
-
-static void insert_after(config_setting_t * setting, config_setting_t * parent,
-        config_setting_t * prev)
-{
-    setting->parent = parent;
-    if (prev == NULL) {
-        setting->next = parent->first;
-        parent->first = setting;
-    } else {
-        setting->next = prev->next;
-        prev->next = setting;
-    }
-}
-
 gboolean config_setting_move_member(config_setting_t * setting, config_setting_t * parent, const char * name)
 {
     config_setting_t *s;
@@ -565,16 +747,23 @@ gboolean config_setting_move_member(config_setting_t * setting, config_setting_t
     if (s) /* we cannot rename/move to this name, it exists already */
         return (s == setting);
     if (setting->parent == parent) /* it's just renaming thing */
-        goto _rename;
-    remove_from_parent(setting); /* remove from old parent */
-    append_to_parent(setting, parent); /* add to new parent */
+    {
+        if (parent->members && setting->name)
+            g_hash_table_remove(parent->members, setting->name);
+        g_free(setting->name);
+        setting->name = g_strdup(name);
+        if (parent->members)
+            g_hash_table_insert(parent->members, setting->name, setting);
+        return TRUE;
+    }
+    _config_setting_unlink(setting); /* remove from old parent */
     /* rename if need */
     if (g_strcmp0(setting->name, name) != 0)
     {
-_rename:
         g_free(setting->name);
         setting->name = g_strdup(name);
     }
+    _config_setting_link(setting, parent, parent->last); /* add to new parent */
     return TRUE;
 }
 
@@ -591,7 +780,14 @@ gboolean config_setting_move_elem(config_setting_t * setting, config_setting_t *
     if (index != 0)
     {
         prev = parent->first;
-        if (prev)
+        if (index > 0 && parent->n_children > 0 &&
+            (guint)index >= parent->n_children)
+        {
+            /* appending, don't walk the list */
+            index -= parent->n_children - 1;
+            prev = parent->last;
+        }
+        else if (prev)
             for ( ; index != 1 && prev->next; prev = prev->next)
                 index--;
         if (index > 1) /* too few elements yet */
@@ -611,11 +807,11 @@ _out_of_range:
     }
     else if (parent->first == setting) /* it is already there */
         return TRUE;
-    remove_from_parent(setting); /* remove from old parent */
+    _config_setting_unlink(setting); /* remove from old parent */
     /* add to new parent */
     if (index == 0)
         g_assert(prev == NULL);
-    insert_after(setting, parent, prev);
+    _config_setting_link(setting, parent, prev);
     /* don't rename  */
     return TRUE;
 }
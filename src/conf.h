@@ -51,6 +51,10 @@ PanelConf *config_new(void);
 void config_destroy(PanelConf * config);
 gboolean config_read_file(PanelConf * config, const char * filename);
 gboolean config_write_file(PanelConf * config, const char * filename);
+/* serializes config now and writes it from a worker thread */
+void config_write_file_async(PanelConf * config, const char * filename);
+/* waits until all config_write_file_async() writes are done */
+void config_write_flush(void);
 char * config_setting_to_string(const config_setting_t * setting);
 
 config_setting_t * config_root_setting(const PanelConf * config);
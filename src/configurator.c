@@ -1481,18 +1481,23 @@ void panel_configure( LXPanel* panel, int sel_page )
     g_object_unref(builder);
 }
 
+#define CONFIG_SAVE_DELAY 500 /* ms to collect more changes before saving */
+
 void panel_config_save( Panel* p )
 {
     gchar *fname;
 
+    if (p->config_save_queued)
+    {
+        g_source_remove(p->config_save_queued);
+        p->config_save_queued = 0;
+    }
+
     fname = _user_config_file_name("panels", p->name);
     /* existance of 'panels' dir ensured in main() */
 
-    if (!config_write_file(p->config, fname)) {
-        g_warning("can't open for write %s:", fname);
-        g_free( fname );
-        return;
-    }
+    /* the file is written in background, errors are reported from there */
+    config_write_file_async(p->config, fname);
     g_free( fname );
 
     /* save the global config file */
@@ -1500,9 +1505,24 @@ void panel_config_save( Panel* p )
     p->config_changed = 0;
 }
 
+static gboolean _config_save_timeout(gpointer user_data)
+{
+    LXPanel *panel = user_data;
+
+    if (g_source_is_destroyed(g_main_current_source()))
+        return FALSE;
+    panel->priv->config_save_queued = 0;
+    panel_config_save(panel->priv);
+    return FALSE;
+}
+
+/* Many changes come in bursts (dragging launchers, resizing spaces), all of
+   them are saved at once after a short delay. */
 void lxpanel_config_save(LXPanel *p)
 {
-    panel_config_save(p->priv);
+    if (!p->priv->config_save_queued)
+        p->priv->config_save_queued = g_timeout_add(CONFIG_SAVE_DELAY,
+                                                    _config_save_timeout, p);
 }
 
 void logout(void)
@@ -1970,16 +1990,14 @@ void load_global_config()
 
 static void save_global_config()
 {
-    char* file = _user_config_file_name("config", NULL);
-    FILE* f = fopen( file, "w" );
-    if( f )
-    {
-        fprintf( f, "[" COMMAND_GROUP "]\n");
-        if( logout_cmd )
-            fprintf( f, "Logout=%s\n", logout_cmd );
-        fclose( f );
-    }
-    g_free(file);
+    GString *str = g_string_new("[" COMMAND_GROUP "]\n");
+    gsize len;
+
+    if( logout_cmd )
+        g_string_append_printf( str, "Logout=%s\n", logout_cmd );
+    len = str->len;
+    _config_write_data_async(_user_config_file_name("config", NULL),
+                             g_string_free(str, FALSE), len);
 }
 
 void free_global_config()
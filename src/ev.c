@@ -49,15 +49,24 @@ struct _FbEvClass {
     void (*client_list_stacking)(FbEv *ev, gpointer p);
 };
 
+/* Root window EWMH properties are cached here: each one is fetched from the
+   X server on first request after its change and then shared by everyone. */
 struct _FbEv {
     GObject    parent_instance;
 
     int current_desktop;
     int number_of_desktops;
     char **desktop_names;
+    int n_desktop_names;
     Window active_window;
     Window *client_list;
+    int n_client_list;
     Window *client_list_stacking;
+    int n_client_list_stacking;
+    guint valid_names : 1;          /* desktop_names is fetched */
+    guint valid_active : 1;         /* active_window is fetched */
+    guint valid_list : 1;           /* client_list is fetched */
+    guint valid_stacking : 1;       /* client_list_stacking is fetched */
 
     Window   xroot;
     Atom     id;
@@ -201,10 +210,15 @@ fb_ev_new()
 static void
 fb_ev_finalize (GObject *object)
 {
-    //FbEv *ev;
+    FbEv *ev;
 
-    //ev = FB_EV (object);
+    ev = FB_EV (object);
     //XFreeGC(ev->dpy, ev->gc);
+    g_strfreev(ev->desktop_names);
+    if (ev->client_list)
+        XFree(ev->client_list);
+    if (ev->client_list_stacking)
+        XFree(ev->client_list_stacking);
 }
 
 void
@@ -213,17 +227,6 @@ fb_ev_emit(FbEv *ev, int signal)
     DBG("signal=%d\n", signal);
     g_assert(signal >=0 && signal < LAST_SIGNAL);
     DBG("\n");
-    if( signal == EV_ACTIVE_WINDOW )
-    {
-        Window* win = None;
-        ev->active_window = None;
-        win = (Window*)get_xaproperty (GDK_ROOT_WINDOW(), a_NET_ACTIVE_WINDOW, XA_WINDOW, 0);
-        if (win) {
-            ev->active_window = *win;
-            /* g_debug( "WIN: %p", *win ); */
-            XFree (win);
-        }
-    }
     g_signal_emit(ev, signals [signal], 0);
 }
 
@@ -244,7 +247,7 @@ static void
 ev_active_window(FbEv *ev, gpointer p)
 {
     ENTER;
-//    ev->active_window = None;		// Wrecks fb_ev_active window
+    ev->valid_active = FALSE;
     RET();
 }
 
@@ -264,6 +267,7 @@ ev_desktop_names(FbEv *ev, gpointer p)
         g_strfreev (ev->desktop_names);
         ev->desktop_names = NULL;
     }
+    ev->valid_names = FALSE;
     RET();
 }
 static void
@@ -274,6 +278,7 @@ ev_client_list(FbEv *ev, gpointer p)
         XFree(ev->client_list);
         ev->client_list = NULL;
     }
+    ev->valid_list = FALSE;
     RET();
 }
 
@@ -285,6 +290,7 @@ ev_client_list_stacking(FbEv *ev, gpointer p)
         XFree(ev->client_list_stacking);
         ev->client_list_stacking = NULL;
     }
+    ev->valid_stacking = FALSE;
     RET();
 }
 
@@ -323,18 +329,55 @@ fb_ev_number_of_desktops(FbEv *ev)
 
 }
 
+char **fb_ev_desktop_names(FbEv *ev, int *count)
+{
+    if (!ev->valid_names) {
+        ev->desktop_names = get_utf8_property_list(GDK_ROOT_WINDOW(), a_NET_DESKTOP_NAMES,
+                                                   &ev->n_desktop_names);
+        ev->valid_names = TRUE;
+    }
+    if (count)
+        *count = ev->n_desktop_names;
+    return ev->desktop_names;
+}
+
 Window *fb_ev_active_window(FbEv *ev)
 {
+    if (!ev->valid_active) {
+        Window *win;
+
+        ev->active_window = None;
+        win = get_xaproperty (GDK_ROOT_WINDOW(), a_NET_ACTIVE_WINDOW, XA_WINDOW, 0);
+        if (win) {
+            ev->active_window = *win;
+            XFree (win);
+        }
+        ev->valid_active = TRUE;
+    }
     return &ev->active_window;
 }
 
-Window *fb_ev_client_list(FbEv *ev)
+Window *fb_ev_client_list(FbEv *ev, int *count)
 {
+    if (!ev->valid_list) {
+        ev->client_list = get_xaproperty(GDK_ROOT_WINDOW(), a_NET_CLIENT_LIST,
+                                         XA_WINDOW, &ev->n_client_list);
+        ev->valid_list = TRUE;
+    }
+    if (count)
+        *count = ev->n_client_list;
     return ev->client_list;
 }
 
-Window *fb_ev_client_list_stacking(FbEv *ev)
+Window *fb_ev_client_list_stacking(FbEv *ev, int *count)
 {
+    if (!ev->valid_stacking) {
+        ev->client_list_stacking = get_xaproperty(GDK_ROOT_WINDOW(), a_NET_CLIENT_LIST_STACKING,
+                                                  XA_WINDOW, &ev->n_client_list_stacking);
+        ev->valid_stacking = TRUE;
+    }
+    if (count)
+        *count = ev->n_client_list_stacking;
     return ev->client_list_stacking;
 }
 
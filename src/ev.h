@@ -71,11 +71,15 @@ void fb_ev_notify_changed_ev(FbEv *ev);
 void fb_ev_emit(FbEv *ev, int signal);
 void fb_ev_emit_destroy(FbEv *ev, Window win);
 
+/* Cached root window properties, each of them is fetched only once after
+ * it was changed. Returned data are owned by FbEv and valid until the next
+ * emission of the corresponding signal. */
 extern int fb_ev_current_desktop(FbEv *ev);
 extern int fb_ev_number_of_desktops(FbEv *ev);
+extern char **fb_ev_desktop_names(FbEv *ev, int *count);
 extern Window *fb_ev_active_window(FbEv *ev);
-extern Window *fb_ev_client_list(FbEv *ev);
-extern Window *fb_ev_client_list_stacking(FbEv *ev);
+extern Window *fb_ev_client_list(FbEv *ev, int *count);
+extern Window *fb_ev_client_list_stacking(FbEv *ev, int *count);
 
 /* it is created in the main.c */
 extern FbEv *fbev;
@@ -430,6 +430,71 @@ static void process_client_msg ( XClientMessageEvent* ev )
     }
 }
 
+/* Root window properties may change many times in a row (e.g. when a lot of
+ * windows are mapped at once), so changes are collected here and emitted once
+ * per main loop iteration, before anything is redrawn. */
+static guint root_events_pending = 0; /* bitmask of EV_* signals */
+static guint root_events_idle = 0;
+static guint root_events_suppressed = 0;
+
+/* order of emission: desktops first, then windows, focus last */
+static const int root_events_order[] = {
+    EV_NUMBER_OF_DESKTOPS,
+    EV_DESKTOP_NAMES,
+    EV_CURRENT_DESKTOP,
+    EV_CLIENT_LIST,
+    EV_CLIENT_LIST_STACKING,
+    EV_ACTIVE_WINDOW
+};
+
+static gboolean dispatch_root_events(gpointer user_data)
+{
+    guint pending;
+    GSList* l;
+    guint i;
+
+    if (g_source_is_destroyed(g_main_current_source()))
+        return FALSE;
+
+    pending = root_events_pending;
+    root_events_pending = 0;
+    root_events_idle = 0;
+
+    for (i = 0; i < G_N_ELEMENTS(root_events_order); i++)
+    {
+        int signal = root_events_order[i];
+
+        if (!(pending & (1U << signal)))
+            continue;
+        /* the emission invalidates the cached value, refetch it once */
+        fb_ev_emit(fbev, signal);
+        if (signal == EV_CURRENT_DESKTOP)
+            for( l = all_panels; l; l = l->next )
+                ((LXPanel*)l->data)->priv->curdesk = fb_ev_current_desktop(fbev);
+        else if (signal == EV_NUMBER_OF_DESKTOPS)
+            for( l = all_panels; l; l = l->next )
+                ((LXPanel*)l->data)->priv->desknum = fb_ev_number_of_desktops(fbev);
+    }
+    return FALSE;
+}
+
+static void queue_root_event(int signal)
+{
+    if (root_events_pending & (1U << signal))
+    {
+        root_events_suppressed++;
+        g_debug("root property change %d coalesced (%u suppressed so far)",
+                signal, root_events_suppressed);
+        return;
+    }
+    root_events_pending |= (1U << signal);
+    if (root_events_idle == 0)
+        /* run after X events are processed but before the redraw */
+        root_events_idle = g_idle_add_full(G_PRIORITY_HIGH_IDLE,
+                                           dispatch_root_events,
+                                           NULL, NULL);
+}
+
 static GdkFilterReturn
 panel_event_filter(GdkXEvent *xevent, GdkEvent *event, gpointer not_used)
 {
@@ -459,37 +524,36 @@ panel_event_filter(GdkXEvent *xevent, GdkEvent *event, gpointer not_used)
     {
         if (at == a_NET_CLIENT_LIST)
         {
-            fb_ev_emit(fbev, EV_CLIENT_LIST);
+            queue_root_event(EV_CLIENT_LIST);
         }
         else if (at == a_NET_CURRENT_DESKTOP)
         {
-            GSList* l;
-            for( l = all_panels; l; l = l->next )
-                ((LXPanel*)l->data)->priv->curdesk = get_net_current_desktop();
-            fb_ev_emit(fbev, EV_CURRENT_DESKTOP);
+            queue_root_event(EV_CURRENT_DESKTOP);
         }
         else if (at == a_NET_NUMBER_OF_DESKTOPS)
         {
-            GSList* l;
-            for( l = all_panels; l; l = l->next )
-                ((LXPanel*)l->data)->priv->desknum = get_net_number_of_desktops();
-            fb_ev_emit(fbev, EV_NUMBER_OF_DESKTOPS);
+            queue_root_event(EV_NUMBER_OF_DESKTOPS);
         }
         else if (at == a_NET_DESKTOP_NAMES)
         {
-            fb_ev_emit(fbev, EV_DESKTOP_NAMES);
+            queue_root_event(EV_DESKTOP_NAMES);
         }
         else if (at == a_NET_ACTIVE_WINDOW)
         {
-            fb_ev_emit(fbev, EV_ACTIVE_WINDOW );
+            queue_root_event(EV_ACTIVE_WINDOW);
         }
         else if (at == a_NET_CLIENT_LIST_STACKING)
         {
-            fb_ev_emit(fbev, EV_CLIENT_LIST_STACKING);
+            queue_root_event(EV_CLIENT_LIST_STACKING);
         }
         else if (at == a_XROOTPMAP_ID)
         {
             GSList* l;
+            FbBg *bg = fb_bg_get_for_display();
+
+            /* drop the cached copy before panels repaint */
+            fb_bg_notify_changed_bg(bg);
+            g_object_unref(bg);
             for( l = all_panels; l; l = l->next )
                 _panel_queue_update_background((LXPanel*)l->data);
         }
@@ -814,12 +878,18 @@ int main(int argc, char *argv[], char *env[])
 
     XSelectInput (GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), GDK_ROOT_WINDOW(), NoEventMask);
     gdk_window_remove_filter(gdk_get_default_root_window (), (GdkFilterFunc)panel_event_filter, NULL);
+    if (root_events_idle)
+        g_source_remove(root_events_idle);
+    root_events_idle = 0;
+    root_events_pending = 0;
 
     /* destroy all panels */
     g_slist_foreach( all_panels, (GFunc) gtk_widget_destroy, NULL );
     g_slist_free( all_panels );
     all_panels = NULL;
     g_free( cfgfile );
+    /* panels save their config while destroyed, wait for it */
+    config_write_flush();
 
     free_global_config();
 
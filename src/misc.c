@@ -29,6 +29,8 @@
 
 #include <X11/Xatom.h>
 #include <X11/cursorfont.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
 
 #include <gtk/gtk.h>
 #include <gdk/gdk.h>
@@ -482,22 +484,146 @@ Xclimsgwm(Window win, Atom type, Atom arg)
 }
 
 
+/* Prefetched properties: requests are sent through XCB all at once, replies
+   are picked up on first use. Key is window ID and property atom combined. */
+typedef struct {
+    gint64 key;
+    Atom type;                          /* requested type */
+    xcb_get_property_cookie_t cookie;
+    xcb_get_property_reply_t *reply;    /* NULL if not received or failed */
+    gboolean replied;
+} PrefetchedProperty;
+
+static GHashTable *prefetched = NULL;
+
+#define PREFETCH_KEY(win, prop) (((gint64)(win) << 32) | (guint32)(prop))
+
+static void prefetched_property_free(gpointer data)
+{
+    PrefetchedProperty *pp = data;
+
+    if (!pp->replied)
+        xcb_discard_reply(XGetXCBConnection(GDK_DISPLAY_XDISPLAY(gdk_display_get_default())),
+                          pp->cookie.sequence);
+    free(pp->reply);
+    g_slice_free(PrefetchedProperty, pp);
+}
+
+void xproperty_prefetch(const Window *windows, guint n_windows,
+                        const Atom *props, guint n_props)
+{
+    xcb_connection_t *c;
+    PrefetchedProperty *pp;
+    guint i, j;
+
+    if (n_windows == 0 || n_props == 0)
+        return;
+    c = XGetXCBConnection(GDK_DISPLAY_XDISPLAY(gdk_display_get_default()));
+    if (prefetched == NULL)
+        prefetched = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+                                           prefetched_property_free);
+    /* Xlib may have own requests queued, send them first to keep order */
+    XFlush(GDK_DISPLAY_XDISPLAY(gdk_display_get_default()));
+    for (i = 0; i < n_windows; i++)
+        for (j = 0; j < n_props; j++)
+        {
+            pp = g_slice_new0(PrefetchedProperty);
+            pp->key = PREFETCH_KEY(windows[i], props[2*j]);
+            pp->type = props[2*j+1];
+            pp->cookie = xcb_get_property(c, 0, windows[i], props[2*j],
+                                          pp->type, 0, G_MAXUINT32 / 4);
+            g_hash_table_replace(prefetched, &pp->key, pp);
+        }
+    xcb_flush(c);
+}
+
+void xproperty_prefetch_done(void)
+{
+    if (prefetched != NULL)
+    {
+        g_hash_table_destroy(prefetched);
+        prefetched = NULL;
+    }
+}
+
+/* XGetWindowProperty() replacement which uses prefetched reply if there is
+   one. Returned data should be freed with XFree() in either case. */
+static int _get_window_property(Window win, Atom prop, Atom type,
+                                Atom *type_ret, int *format_ret,
+                                gulong *items_ret, guchar **data)
+{
+    PrefetchedProperty *pp = NULL;
+    xcb_get_property_reply_t *r;
+    gint64 key;
+    guint8 *src;
+    gulong i, *l;
+    size_t len;
+
+    if (prefetched != NULL)
+    {
+        key = PREFETCH_KEY(win, prop);
+        pp = g_hash_table_lookup(prefetched, &key);
+    }
+    if (pp == NULL || pp->type != type)
+    {
+        gulong bytes_after;
+
+        return XGetWindowProperty(GDK_DISPLAY_XDISPLAY(gdk_display_get_default()),
+                                  win, prop, 0, G_MAXLONG, False, type,
+                                  type_ret, format_ret, items_ret,
+                                  &bytes_after, data);
+    }
+    if (!pp->replied)
+    {
+        /* errors such as BadWindow are dropped by XCB with the reply */
+        pp->reply = xcb_get_property_reply(XGetXCBConnection(GDK_DISPLAY_XDISPLAY(gdk_display_get_default())),
+                                           pp->cookie, NULL);
+        pp->replied = TRUE;
+    }
+    r = pp->reply;
+    *data = NULL;
+    if (r == NULL)
+        return BadWindow;
+    *type_ret = r->type;
+    *format_ret = r->format;
+    *items_ret = r->value_len;
+    if (r->type == None)
+        return Success;
+    /* convert data the same way as Xlib does: 32-bit items become longs,
+       and there is always a trailing zero byte for convenience */
+    src = xcb_get_property_value(r);
+    if (r->format == 32)
+    {
+        l = malloc((r->value_len + 1) * sizeof(gulong));
+        for (i = 0; i < r->value_len; i++)
+            l[i] = ((guint32 *)src)[i];
+        l[i] = 0;
+        *data = (guchar *)l;
+    }
+    else
+    {
+        len = (size_t)r->value_len * (r->format / 8);
+        *data = malloc(len + 1);
+        memcpy(*data, src, len);
+        (*data)[len] = '\0';
+    }
+    return Success;
+}
+
 void *
 get_utf8_property(Window win, Atom atom)
 {
     Atom type;
     int format;
     gulong nitems;
-    gulong bytes_after;
     gchar *val, *retval;
     int result;
     guchar *tmp = NULL;
 
     type = None;
     retval = NULL;
-    result = XGetWindowProperty (GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), win, atom, 0, G_MAXLONG, False,
-          a_UTF8_STRING, &type, &format, &nitems,
-          &bytes_after, &tmp);
+    result = _get_window_property(win, atom, a_UTF8_STRING, &type, &format,
+                                  &nitems, &tmp);
     if (result != Success || type == None)
         return NULL;
     val = (gchar *) tmp;
@@ -516,15 +642,13 @@ get_utf8_property_list(Window win, Atom atom, int *count)
     Atom type;
     int format;
     gulong nitems, i;
-    gulong bytes_after;
     gchar *s, **retval = NULL;
     int result;
     guchar *tmp = NULL;
 
     *count = 0;
-    result = XGetWindowProperty(GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), win, atom, 0, G_MAXLONG, False,
-          a_UTF8_STRING, &type, &format, &nitems,
-          &bytes_after, &tmp);
+    result = _get_window_property(win, atom, a_UTF8_STRING, &type, &format,
+                                  &nitems, &tmp);
     if (result != Success || type != a_UTF8_STRING || tmp == NULL)
         return NULL;
 
@@ -561,14 +685,12 @@ get_xaproperty (Window win, Atom prop, Atom type, int *nitems)
     Atom type_ret;
     int format_ret;
     unsigned long items_ret;
-    unsigned long after_ret;
     unsigned char *prop_data;
 
     ENTER;
     prop_data = NULL;
-    if (XGetWindowProperty (GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), win, prop, 0, G_MAXLONG, False,
-              type, &type_ret, &format_ret, &items_ret,
-              &after_ret, &prop_data) != Success || items_ret == 0)
+    if (_get_window_property(win, prop, type, &type_ret, &format_ret,
+                             &items_ret, &prop_data) != Success || items_ret == 0)
     {
         if( G_UNLIKELY(prop_data) )
             XFree( prop_data );
@@ -614,16 +736,21 @@ get_textproperty(Window win, Atom atom)
 {
     XTextProperty text_prop;
     char *retval;
+    int format;
 
     ENTER;
-    if (XGetTextProperty(GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), win, &text_prop, atom)) {
+    text_prop.value = NULL;
+    if (_get_window_property(win, atom, AnyPropertyType, &text_prop.encoding,
+                             &format, &text_prop.nitems, &text_prop.value) == Success
+        && text_prop.encoding != None) {
+        text_prop.format = format;
         DBG("format=%d enc=%d nitems=%d value=%s   \n",
               text_prop.format,
               text_prop.encoding,
               text_prop.nitems,
               text_prop.value);
         retval = text_property_to_utf8 (&text_prop);
-        if (text_prop.nitems > 0)
+        if (text_prop.value)
             XFree (text_prop.value);
         RET(retval);
 
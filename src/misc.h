@@ -124,6 +124,22 @@ char *get_textproperty(Window win, Atom prop);
 void *get_utf8_property(Window win, Atom atom);
 char **get_utf8_property_list(Window win, Atom atom, int *count);
 
+/**
+ * xproperty_prefetch
+ * @windows: list of windows
+ * @n_windows: number of windows in @windows
+ * @props: pairs of property atom and requested type atom
+ * @n_props: number of pairs in @props
+ *
+ * Sends requests for all @props of all @windows to the X server at once.
+ * Until xproperty_prefetch_done() is called, get_xaproperty() and other
+ * property getters above take replies from those requests instead of doing
+ * a round trip to the X server per each property.
+ */
+void xproperty_prefetch(const Window *windows, guint n_windows,
+                        const Atom *props, guint n_props);
+void xproperty_prefetch_done(void);
+
 void resolve_atoms();
 //Window Select_Window(Display *dpy);
 int get_net_number_of_desktops();
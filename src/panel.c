@@ -50,7 +50,6 @@
 #include <string.h>
 #include <gdk/gdkx.h>
 #include <libfm/fm-gtk.h>
-#include <cairo-xlib.h>
 
 #define __LXPANEL_INTERNALS__
 
@@ -75,6 +74,7 @@ static gulong monitors_handler = 0;
 static void panel_start_gui(LXPanel *p, config_setting_t *list);
 static void ah_start(LXPanel *p);
 static void ah_stop(LXPanel *p);
+static void ah_crossing(LXPanel *panel, GdkEventCrossing *event, gboolean far);
 static void _panel_update_background(LXPanel * p, gboolean enforce);
 
 enum
@@ -217,8 +217,8 @@ static void lxpanel_finalize(GObject *object)
     LXPanel *self = LXPANEL(object);
     Panel *p = self->priv;
 
-    if( p->config_changed )
-        lxpanel_config_save( self );
+    if (p->config_changed || p->config_save_queued)
+        panel_config_save(p);
     config_destroy(p->config);
 
     //XFree(p->workarea);
@@ -267,6 +267,11 @@ static void panel_stop_gui(LXPanel *self)
         cairo_surface_destroy(p->surface);
         p->surface = NULL;
     }
+    if (p->bg != NULL)
+    {
+        g_object_unref(p->bg);
+        p->bg = NULL;
+    }
 
     if (p->background_update_queued)
     {
@@ -319,9 +324,10 @@ static gboolean idle_update_background(gpointer p)
     if (gtk_widget_get_realized(p))
     {
         gdk_display_sync( gtk_widget_get_display(p) );
-        _panel_update_background(panel, FALSE);
+        _panel_update_background(panel, panel->priv->background_forced);
     }
     panel->priv->background_update_queued = 0;
+    panel->priv->background_forced = 0;
 
     return FALSE;
 }
@@ -352,6 +358,7 @@ static void lxpanel_realize(GtkWidget *widget)
 {
     GTK_WIDGET_CLASS(lxpanel_parent_class)->realize(widget);
 
+    LXPANEL(widget)->priv->background_forced = 1;
     _panel_queue_update_background(LXPANEL(widget));
 }
 
@@ -360,6 +367,7 @@ static void lxpanel_style_set(GtkWidget *widget, GtkStyle* prev)
     GTK_WIDGET_CLASS(lxpanel_parent_class)->style_set(widget, prev);
 
     /* FIXME: This dirty hack is used to fix the background of systray... */
+    LXPANEL(widget)->priv->background_forced = 1;
     _panel_queue_update_background(LXPANEL(widget));
 }
 
@@ -499,6 +507,22 @@ static gboolean lxpanel_map_event(GtkWidget *widget, GdkEventAny *event)
     return GTK_WIDGET_CLASS(lxpanel_parent_class)->map_event(widget, event);
 }
 
+static gboolean lxpanel_enter_notify(GtkWidget *widget, GdkEventCrossing *event)
+{
+    GtkWidgetClass *parent = GTK_WIDGET_CLASS(lxpanel_parent_class);
+
+    ah_crossing(LXPANEL(widget), event, FALSE);
+    return parent->enter_notify_event ? parent->enter_notify_event(widget, event) : FALSE;
+}
+
+static gboolean lxpanel_leave_notify(GtkWidget *widget, GdkEventCrossing *event)
+{
+    GtkWidgetClass *parent = GTK_WIDGET_CLASS(lxpanel_parent_class);
+
+    ah_crossing(LXPANEL(widget), event, TRUE);
+    return parent->leave_notify_event ? parent->leave_notify_event(widget, event) : FALSE;
+}
+
 /* Handler for "button_press_event" signal with Panel as parameter. */
 static gboolean lxpanel_button_press(GtkWidget *widget, GdkEventButton *event)
 {
@@ -563,6 +587,8 @@ static void lxpanel_class_init(PanelToplevelClass *klass)
     widget_class->button_press_event = lxpanel_button_press;
     widget_class->button_release_event = _lxpanel_button_release;
     widget_class->motion_notify_event = _lxpanel_motion_notify;
+    widget_class->enter_notify_event = lxpanel_enter_notify;
+    widget_class->leave_notify_event = lxpanel_leave_notify;
 
     signals[ICON_SIZE_CHANGED] =
         g_signal_new("icon-size-changed",
@@ -886,66 +912,17 @@ void _panel_set_wm_strut(LXPanel *panel)
 
 static void paint_root_pixmap(LXPanel *panel, cairo_t *cr)
 {
-    /*
-     * this code was extracted from code for FbBg object
-     *
-     * Copyright (C) 2001, 2002 Ian McKellar <yakk@yakk.net>
-     *                     2002 Sun Microsystems, Inc.
-     */
-    XGCValues gcv;
-    uint mask;
-    Window xroot;
-    GC gc;
-    Display *dpy;
-    Pixmap *prop;
-#if GTK_CHECK_VERSION(3, 0, 0)
-    cairo_surface_t *surface;
-#else
-    GdkPixmap *pixmap;
-#endif
-    Pixmap xpixmap;
     Panel *p = panel->priv;
+    GdkRectangle rect;
 
-    dpy = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
-    xroot = DefaultRootWindow(dpy);
-    gcv.ts_x_origin = 0;
-    gcv.ts_y_origin = 0;
-    gcv.fill_style = FillTiled;
-    mask = GCTileStipXOrigin | GCTileStipYOrigin | GCFillStyle;
-    prop = get_xaproperty(xroot, a_XROOTPMAP_ID, XA_PIXMAP, NULL);
-    if (prop)
-    {
-        gcv.tile = *prop;
-        mask |= GCTile;
-        XFree(prop);
-    }
-    gc = XCreateGC(dpy, xroot, mask, &gcv);
-#if GTK_CHECK_VERSION(3, 0, 0)
-    xpixmap = XCreatePixmap(dpy, xroot, p->aw, p->ah,
-                            DefaultDepth(dpy, DefaultScreen(dpy)));
-    surface = cairo_xlib_surface_create(dpy, xpixmap,
-                                        DefaultVisual(dpy, DefaultScreen(dpy)),
-                                        p->aw, p->ah);
-#else
-    pixmap = gdk_pixmap_new(gtk_widget_get_window(GTK_WIDGET(panel)),
-                            p->aw, p->ah, -1);
-    xpixmap = gdk_x11_drawable_get_xid(pixmap);
-#endif
-    XSetTSOrigin(dpy, gc, -p->ax, -p->ay);
-    XFillRectangle(dpy, xpixmap, gc, 0, 0, p->aw, p->ah);
-    XFreeGC(dpy, gc);
-#if GTK_CHECK_VERSION(3, 0, 0)
-    cairo_set_source_surface(cr, surface, 0, 0);
-#else
-    gdk_cairo_set_source_pixmap(cr, pixmap, 0, 0);
-#endif
-    cairo_paint(cr);
-#if GTK_CHECK_VERSION(3, 0, 0)
-    cairo_surface_destroy(surface);
-    XFreePixmap(dpy, xpixmap);
-#else
-    g_object_unref(pixmap);
-#endif
+    /* the root pixmap is copied once per monitor and shared by all panels */
+    if (p->bg == NULL)
+        p->bg = fb_bg_get_for_display();
+    rect.x = p->ax;
+    rect.y = p->ay;
+    rect.width = p->aw;
+    rect.height = p->ah;
+    fb_bg_paint_root(p->bg, cr, &rect);
 }
 
 static void _panel_determine_background_pixmap(LXPanel * panel)
@@ -1054,10 +1031,42 @@ void panel_update_background(Panel * p)
     _panel_update_background(p->topgwin, TRUE);
 }
 
+/* Hash of everything p->surface depends on besides the configuration. */
+static guint32 _panel_background_hash(LXPanel * panel)
+{
+    Panel * p = panel->priv;
+    GdkRectangle rect;
+    guint32 hash = p->aw * 31 + p->ah;
+
+    /* the background image may have alpha as well, so include the root */
+    if ((p->transparent && p->alpha != 255) || p->background)
+    {
+        if (p->bg == NULL)
+            p->bg = fb_bg_get_for_display();
+        rect.x = p->ax;
+        rect.y = p->ay;
+        rect.width = p->aw;
+        rect.height = p->ah;
+        hash = hash * 31 + fb_bg_hash_root(p->bg, &rect);
+    }
+    return hash;
+}
+
+/* If not @enforce then only the root background or the panel geometry may
+   have changed, the background is regenerated only if its pixels changed. */
 static void _panel_update_background(LXPanel * p, gboolean enforce)
 {
     GtkWidget *w = GTK_WIDGET(p);
     GList *plugins = NULL, *l;
+    guint32 hash;
+
+    /* plain panels are drawn by GTK+ */
+    if (!enforce && !p->priv->background && !p->priv->transparent)
+        return;
+    hash = _panel_background_hash(p);
+    if (!enforce && p->priv->surface != NULL && hash == p->priv->background_hash)
+        return;
+    p->priv->background_hash = hash;
 
     /* reset background image */
     if (p->priv->surface != NULL) /* FIXME: honor enforce on composited screen */
@@ -1071,13 +1080,22 @@ static void _panel_update_background(LXPanel * p, gboolean enforce)
 #if !GTK_CHECK_VERSION(3, 0, 0)
     gdk_window_clear(gtk_widget_get_window(w));
 #endif
-    gtk_widget_queue_draw(w);
+    if (!enforce)
+        /* plugins already paint over the panel background, one redraw of
+           the whole window is enough, but tray icons are separate windows
+           of other clients which have to be asked to redraw */
+        gdk_window_invalidate_rect(gtk_widget_get_window(w), NULL, TRUE);
+    else
+        gtk_widget_queue_draw(w);
 
     /* Loop over all plugins redrawing each plugin. */
     if (p->priv->box != NULL)
         plugins = gtk_container_get_children(GTK_CONTAINER(p->priv->box));
     for (l = plugins; l != NULL; l = l->next)
-        plugin_widget_set_background(l->data, p);
+        if (enforce)
+            plugin_widget_set_background(l->data, p);
+        else
+            _plugin_widget_refresh_sockets(l->data);
     g_list_free(plugins);
 }
 
@@ -1096,7 +1114,13 @@ static void _panel_update_background(LXPanel * p, gboolean enforce)
  * 3. HIDDEN - hides panel. When mouse comes "close enough" switches to VISIBLE
  *
  * Note 1
- * Mouse coordinates are queried every PERIOD milisec
+ * The panel learns that mouse comes close or goes far from crossing events on
+ * its window. While it is fully hidden an input only strip of STRIP pixels at
+ * the screen edge takes its place, raised each time the window manager
+ * restacks windows or an override redirect window is mapped or moved.
+ * Mouse coordinates are queried every PERIOD milisec only as fallback,
+ * without X or while a grab keeps crossing events away from us, so idle
+ * hidden panel doesn't wake up at all
  *
  * Note 2
  * If mouse is less then GAP pixels to panel it's considered to be close,
@@ -1105,6 +1129,7 @@ static void _panel_update_background(LXPanel * p, gboolean enforce)
 
 #define GAP 2
 #define PERIOD 300
+#define STRIP 1 /* the less it is the less clicks of apps it takes */
 
 typedef enum
 {
@@ -1115,15 +1140,34 @@ typedef enum
 
 static void ah_state_set(LXPanel *p, PanelAHState ah_state);
 
-static gboolean
-mouse_watch(LXPanel *panel)
+/* Crossing events tell where the mouse is unless we run without X. */
+static inline gboolean ah_has_crossing_events(void)
+{
+#if GTK_CHECK_VERSION(3, 0, 0)
+    return GDK_IS_X11_DISPLAY(gdk_display_get_default());
+#else
+    return TRUE;
+#endif
+}
+
+static inline gboolean ah_pointer_grabbed(void)
+{
+    GdkDisplay *display = gdk_display_get_default();
+
+#if GTK_CHECK_VERSION(3, 0, 0)
+    return gdk_display_device_is_grabbed(display,
+                gdk_seat_get_pointer(gdk_display_get_default_seat(display)));
+#else
+    return gdk_display_pointer_is_grabbed(display);
+#endif
+}
+
+static void
+ah_check_pointer(LXPanel *panel)
 {
     Panel *p = panel->priv;
     gint x, y;
 
-    if (g_source_is_destroyed(g_main_current_source()))
-        return FALSE;
-
     ENTER;
 #if GTK_CHECK_VERSION(3, 0, 0)
     gdk_device_get_position (gdk_seat_get_pointer (gdk_display_get_default_seat (gdk_display_get_default ())), NULL, &x, &y);
@@ -1145,7 +1189,7 @@ mouse_watch(LXPanel *panel)
 
     if (p->move_state != PANEL_MOVE_STOP)
         /* prevent autohide when dragging is on */
-        return TRUE;
+        RET();
 
     if (cw == 1) cw = 0;
     if (ch == 1) ch = 0;
@@ -1172,7 +1216,178 @@ mouse_watch(LXPanel *panel)
     p->ah_far = ((x < cx) || (x > cx + cw) || (y < cy) || (y > cy + ch));
 
     ah_state_set(panel, p->ah_state);
-    RET(TRUE);
+    RET();
+}
+
+static gboolean
+mouse_watch(LXPanel *panel)
+{
+    if (g_source_is_destroyed(g_main_current_source()))
+        return FALSE;
+
+    ah_check_pointer(panel);
+    /* crossing events will tell us the rest once the grab is over */
+    if (ah_has_crossing_events() && !ah_pointer_grabbed())
+    {
+        panel->priv->mouse_timeout = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void ah_poll_start(LXPanel *p)
+{
+    if (!p->priv->mouse_timeout)
+        p->priv->mouse_timeout = g_timeout_add(PERIOD, (GSourceFunc) mouse_watch, p);
+}
+
+static void ah_strip_restack(FbEv *ev, LXPanel *panel)
+{
+    Panel *p = panel->priv;
+
+    /* window manager might put some window above the strip */
+    if (p->ah_strip != NULL && gdk_window_is_visible(p->ah_strip))
+        gdk_window_raise(p->ah_strip);
+}
+
+/* Window manager doesn't restack override redirect windows, so watch them
+   on the root window, which has substructure events selected by main(). */
+static GdkFilterReturn ah_strip_filter(GdkXEvent *xevent, GdkEvent *event,
+                                       LXPanel *panel)
+{
+    XEvent *ev = (XEvent *)xevent;
+    Panel *p = panel->priv;
+    Window win;
+
+    switch (ev->type) {
+    case MapNotify:
+        if (!ev->xmap.override_redirect)
+            return GDK_FILTER_CONTINUE;
+        win = ev->xmap.window;
+        break;
+    case ConfigureNotify:
+        if (!ev->xconfigure.override_redirect ||
+            ev->xconfigure.event == ev->xconfigure.window)
+            return GDK_FILTER_CONTINUE;
+        win = ev->xconfigure.window;
+        break;
+    default:
+        return GDK_FILTER_CONTINUE;
+    }
+    /* skip own windows: raising a strip reports it, and strips of two
+       panels would raise each other endlessly */
+#if GTK_CHECK_VERSION(2, 24, 0)
+    if (gdk_x11_window_lookup_for_display(gdk_display_get_default(), win))
+#else
+    if (gdk_window_lookup(win))
+#endif
+        return GDK_FILTER_CONTINUE;
+    if (p->ah_strip != NULL && gdk_window_is_visible(p->ah_strip))
+        gdk_window_raise(p->ah_strip);
+    return GDK_FILTER_CONTINUE;
+}
+
+/* Shows the input only strip at the screen edge while the panel window is
+   fully hidden, its enter event reveals the panel. */
+static void ah_strip_update(LXPanel *panel)
+{
+    Panel *p = panel->priv;
+    GtkWidget *widget = GTK_WIDGET(panel);
+    GdkWindowAttr attr;
+    gint x, y, w, h;
+
+    if (!p->autohide || p->ah_state != AH_STATE_HIDDEN ||
+        p->height_when_hidden > 0 || !ah_has_crossing_events())
+    {
+        if (p->ah_strip != NULL && gdk_window_is_visible(p->ah_strip))
+            gdk_window_hide(p->ah_strip);
+        return;
+    }
+
+    x = p->ax;
+    y = p->ay;
+    w = p->aw;
+    h = p->ah;
+    switch (p->edge) {
+    case EDGE_LEFT:
+        w = STRIP;
+        break;
+    case EDGE_RIGHT:
+        x = x + w - STRIP;
+        w = STRIP;
+        break;
+    case EDGE_TOP:
+        h = STRIP;
+        break;
+    case EDGE_BOTTOM:
+        y = y + h - STRIP;
+        h = STRIP;
+        break;
+    }
+
+    if (p->ah_strip == NULL)
+    {
+        attr.x = x;
+        attr.y = y;
+        attr.width = w;
+        attr.height = h;
+        attr.wclass = GDK_INPUT_ONLY;
+        attr.window_type = GDK_WINDOW_TEMP;
+        attr.event_mask = GDK_ENTER_NOTIFY_MASK;
+        p->ah_strip = gdk_window_new(gdk_screen_get_root_window(gtk_widget_get_screen(widget)),
+                                     &attr, GDK_WA_X | GDK_WA_Y);
+#if GTK_CHECK_VERSION(3, 8, 0)
+        gtk_widget_register_window(widget, p->ah_strip);
+#endif
+        /* deliver its events to the panel */
+        gdk_window_set_user_data(p->ah_strip, widget);
+        g_signal_connect(G_OBJECT(fbev), "client-list-stacking",
+                         G_CALLBACK(ah_strip_restack), panel);
+        gdk_window_add_filter(gdk_screen_get_root_window(gtk_widget_get_screen(widget)),
+                              (GdkFilterFunc)ah_strip_filter, panel);
+    }
+    else
+        gdk_window_move_resize(p->ah_strip, x, y, w, h);
+    gdk_window_show(p->ah_strip);
+}
+
+static void ah_strip_destroy(LXPanel *panel)
+{
+    Panel *p = panel->priv;
+
+    if (p->ah_strip == NULL)
+        return;
+    g_signal_handlers_disconnect_by_func(fbev, ah_strip_restack, panel);
+    gdk_window_remove_filter(gdk_screen_get_root_window(gtk_widget_get_screen(GTK_WIDGET(panel))),
+                             (GdkFilterFunc)ah_strip_filter, panel);
+    gdk_window_set_user_data(p->ah_strip, NULL);
+#if GTK_CHECK_VERSION(3, 8, 0)
+    gtk_widget_unregister_window(GTK_WIDGET(panel), p->ah_strip);
+#endif
+    gdk_window_destroy(p->ah_strip);
+    p->ah_strip = NULL;
+}
+
+/* Handles enter and leave events of the panel and of the strip. */
+static void ah_crossing(LXPanel *panel, GdkEventCrossing *event, gboolean far)
+{
+    Panel *p = panel->priv;
+
+    if (!p->autohide)
+        return;
+    if (event->mode != GDK_CROSSING_NORMAL)
+    {
+        /* while something grabs the pointer we get no crossing events */
+        ah_poll_start(panel);
+        return;
+    }
+    if (p->mouse_timeout || event->detail == GDK_NOTIFY_INFERIOR)
+        return;
+    if (far && (event->window != gtk_widget_get_window(GTK_WIDGET(panel)) ||
+                p->move_state != PANEL_MOVE_STOP))
+        return;
+    p->ah_far = far;
+    ah_state_set(panel, p->ah_state);
 }
 
 static gboolean ah_state_hide_timeout(gpointer p)
@@ -1252,6 +1467,7 @@ static void ah_state_set(LXPanel *panel, PanelAHState ah_state)
             ah_state_set(panel, AH_STATE_VISIBLE);
         }
     }
+    ah_strip_update(panel);
     RET();
 }
 
@@ -1259,8 +1475,11 @@ static void ah_state_set(LXPanel *panel, PanelAHState ah_state)
 static void ah_start(LXPanel *p)
 {
     ENTER;
-    if (!p->priv->mouse_timeout)
-        p->priv->mouse_timeout = g_timeout_add(PERIOD, (GSourceFunc) mouse_watch, p);
+    if (ah_has_crossing_events())
+        /* find where the mouse is now, crossing events report the rest */
+        ah_check_pointer(p);
+    else
+        ah_poll_start(p);
     RET();
 }
 
@@ -1276,6 +1495,7 @@ static void ah_stop(LXPanel *p)
         g_source_remove(p->priv->hide_timeout);
         p->priv->hide_timeout = 0;
     }
+    ah_strip_destroy(p);
     RET();
 }
 /* end of the autohide code
@@ -1527,6 +1747,12 @@ static void panel_popupmenu_delete_panel( GtkMenuItem* item, LXPanel* panel )
         all_panels = g_slist_remove( all_panels, panel );
 
         /* delete the config file of this panel */
+        if (panel->priv->config_save_queued)
+        {
+            g_source_remove(panel->priv->config_save_queued);
+            panel->priv->config_save_queued = 0;
+        }
+        config_write_flush(); /* a pending write could recreate it */
         fname = _user_config_file_name("panels", panel->priv->name);
         g_unlink( fname );
         g_free(fname);
@@ -1866,8 +2092,8 @@ panel_start_gui(LXPanel *panel, config_setting_t *list)
     ENTER;
 
     g_debug("panel_start_gui on '%s'", p->name);
-    p->curdesk = get_net_current_desktop();
-    p->desknum = get_net_number_of_desktops();
+    p->curdesk = fb_ev_current_desktop(fbev);
+    p->desknum = fb_ev_number_of_desktops(fbev);
     //p->workarea = get_xaproperty (GDK_ROOT_WINDOW(), a_NET_WORKAREA, XA_CARDINAL, &p->wa_len);
     p->ax = p->ay = p->aw = p->ah = 0;
 
@@ -1886,7 +2112,8 @@ panel_start_gui(LXPanel *panel, config_setting_t *list)
     else
         gtk_window_group_add_window(win_grp, (GtkWindow*)panel);
 
-    gtk_widget_add_events( w, GDK_BUTTON_PRESS_MASK );
+    gtk_widget_add_events( w, GDK_BUTTON_PRESS_MASK |
+                              GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK );
 
     gtk_widget_realize(w);
     //gdk_window_set_decorations(gtk_widget_get_window(p->topgwin), 0);
@@ -1972,7 +2199,68 @@ void panel_adjust_geometry_terminology(Panel * p)
     }
 }
 
-/* Draw text into a label, with the user preference color and optionally bold. */
+/* Attributes last applied to a label by panel_draw_label_text_with_color(),
+ * so the label is not touched if nothing was changed. */
+typedef struct {
+    PangoAttrList *attrs;       /* attributes set on label, NULL if none */
+    gint font_size;
+    guint32 rgb24;              /* G_MAXUINT32 if no custom color */
+    gboolean bold;
+    gint style_size;            /* font size from label style, -1 if unknown */
+} LabelCache;
+
+static GQuark label_cache_quark = 0;
+
+static void label_cache_free(gpointer data)
+{
+    LabelCache *cache = data;
+
+    if (cache->attrs)
+        pango_attr_list_unref(cache->attrs);
+    g_slice_free(LabelCache, cache);
+}
+
+static void label_cache_style_changed(LabelCache *cache)
+{
+    cache->style_size = -1;
+}
+
+static LabelCache *label_cache_get(GtkWidget *label)
+{
+    LabelCache *cache;
+
+    if (label_cache_quark == 0)
+        label_cache_quark = g_quark_from_static_string("lxpanel-label-cache");
+    cache = g_object_get_qdata(G_OBJECT(label), label_cache_quark);
+    if (cache == NULL)
+    {
+        cache = g_slice_new0(LabelCache);
+        cache->rgb24 = G_MAXUINT32;
+        cache->style_size = -1;
+        g_object_set_qdata_full(G_OBJECT(label), label_cache_quark, cache,
+                                label_cache_free);
+#if GTK_CHECK_VERSION(3, 0, 0)
+        g_signal_connect_swapped(label, "style-updated",
+                                 G_CALLBACK(label_cache_style_changed), cache);
+#else
+        g_signal_connect_swapped(label, "style-set",
+                                 G_CALLBACK(label_cache_style_changed), cache);
+#endif
+    }
+    return cache;
+}
+
+/* TRUE if label already shows the text as plain text */
+static inline gboolean label_has_text(GtkWidget *label, const char *text)
+{
+    return !gtk_label_get_use_markup(GTK_LABEL(label)) &&
+           strcmp(gtk_label_get_text(GTK_LABEL(label)), text ? text : "") == 0;
+}
+
+/* Draw text into a label, with the user preference color and optionally bold.
+ * Font size, weight and color are applied as attributes instead of markup,
+ * so nothing needs to be escaped and parsed, and unchanged labels are left
+ * as is. */
 static
 #if GTK_CHECK_VERSION(3, 0, 0)
 void panel_draw_label_text_with_color(Panel * p, GtkWidget * label, const char * text,
@@ -1984,6 +2272,9 @@ void panel_draw_label_text_with_color(Panel * p, GtkWidget * label, const char *
                            gboolean custom_color, GdkColor *gdkcolor)
 #endif
 {
+    LabelCache *cache;
+    guint32 rgb24 = G_MAXUINT32;
+
     if (text == NULL)
     {
         /* Null string. */
@@ -1991,65 +2282,63 @@ void panel_draw_label_text_with_color(Panel * p, GtkWidget * label, const char *
         return;
     }
 
+    cache = label_cache_get(label);
+
     /* Compute an appropriate size so the font will scale with the panel's icon size. */
     int font_desc;
     if (p->usefontsize)
         font_desc = p->fontsize;
     else
     {
+        if (cache->style_size < 0)
+        {
 #if GTK_CHECK_VERSION(3, 0, 0)
-        PangoFontDescription *desc;
-        GtkStyleContext *sc = gtk_widget_get_style_context (label);
-        gtk_style_context_get (sc, GTK_STATE_FLAG_NORMAL, "font", &desc, NULL);
-        font_desc = pango_font_description_get_size (desc) / PANGO_SCALE;
-        pango_font_description_free (desc);
+            PangoFontDescription *desc;
+            GtkStyleContext *sc = gtk_widget_get_style_context (label);
+            gtk_style_context_get (sc, GTK_STATE_FLAG_NORMAL, "font", &desc, NULL);
+            cache->style_size = pango_font_description_get_size (desc) / PANGO_SCALE;
+            pango_font_description_free (desc);
 #else
-        GtkStyle *style = gtk_widget_get_style(label);
-        font_desc = pango_font_description_get_size(style->font_desc) / PANGO_SCALE;
+            GtkStyle *style = gtk_widget_get_style(label);
+            cache->style_size = pango_font_description_get_size(style->font_desc) / PANGO_SCALE;
 #endif
-    }
-    font_desc *= custom_size_factor;
-
-    /* Check the string for characters that need to be escaped.
-     * If any are found, create the properly escaped string and use it instead. */
-    const char * valid_markup = text;
-    char * escaped_text = NULL;
-    const char * q;
-    for (q = text; *q != '\0'; q += 1)
-    {
-        if ((*q == '<') || (*q == '>') || (*q == '&'))
-        {
-            escaped_text = g_markup_escape_text(text, -1);
-            valid_markup = escaped_text;
-            break;
         }
+        font_desc = cache->style_size;
     }
+    font_desc *= custom_size_factor;
 
-    gchar * formatted_text;
     if (gdkcolor || ((custom_color) && (p->usefontcolor)))
-    {
-        /* Color, optionally bold. */
-        guint32 rgb24 = gdkcolor ? gcolor2rgb24(gdkcolor) : gcolor2rgb24(&p->gfontcolor);
-        formatted_text = g_strdup_printf("<span font_desc=\"%d\" color=\"#%06x\">%s%s%s</span>",
-                font_desc,
-                rgb24,
-                ((bold) ? "<b>" : ""),
-                valid_markup,
-                ((bold) ? "</b>" : ""));
-    }
-    else
-    {
-        /* No color, optionally bold. */
-        formatted_text = g_strdup_printf("<span font_desc=\"%d\">%s%s%s</span>",
-                font_desc,
-                ((bold) ? "<b>" : ""),
-                valid_markup,
-                ((bold) ? "</b>" : ""));
-    }
-
-    gtk_label_set_markup(GTK_LABEL(label), formatted_text);
-    g_free(formatted_text);
-    g_free(escaped_text);
+        rgb24 = gdkcolor ? gcolor2rgb24(gdkcolor) : gcolor2rgb24(&p->gfontcolor);
+
+    /* Rebuild attributes only if they were changed. */
+    if (cache->attrs == NULL
+        || gtk_label_get_attributes(GTK_LABEL(label)) != cache->attrs
+        || cache->font_size != font_desc || cache->bold != bold
+        || cache->rgb24 != rgb24)
+    {
+        PangoAttrList *attrs = pango_attr_list_new();
+
+        if (font_desc > 0)
+            pango_attr_list_insert(attrs, pango_attr_size_new(font_desc * PANGO_SCALE));
+        if (bold)
+            pango_attr_list_insert(attrs, pango_attr_weight_new(PANGO_WEIGHT_BOLD));
+        if (rgb24 != G_MAXUINT32)
+            pango_attr_list_insert(attrs,
+                                   pango_attr_foreground_new(((rgb24 >> 16) & 0xff) * 0x101,
+                                                             ((rgb24 >> 8) & 0xff) * 0x101,
+                                                             (rgb24 & 0xff) * 0x101));
+        if (!label_has_text(label, text))
+            gtk_label_set_text(GTK_LABEL(label), text);
+        gtk_label_set_attributes(GTK_LABEL(label), attrs);
+        if (cache->attrs)
+            pango_attr_list_unref(cache->attrs);
+        cache->attrs = attrs; /* label holds its own reference */
+        cache->font_size = font_desc;
+        cache->bold = bold;
+        cache->rgb24 = rgb24;
+    }
+    else if (!label_has_text(label, text))
+        gtk_label_set_text(GTK_LABEL(label), text);
 }
 
 void panel_draw_label_text(Panel * p, GtkWidget * label, const char * text,
@@ -2063,7 +2352,9 @@ void lxpanel_draw_label_text(LXPanel * p, GtkWidget * label, const char * text,
                            gboolean bold, float custom_size_factor,
                            gboolean custom_color)
 {
-    gtk_label_set_text (GTK_LABEL (label), text);
+    /* setting the same text would relayout the label anyway */
+    if (!label_has_text(label, text))
+        gtk_label_set_text (GTK_LABEL (label), text);
 }
 
 #if GTK_CHECK_VERSION(3, 0, 0)
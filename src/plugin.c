@@ -183,6 +183,30 @@ static void plugin_get_available_classes(void)
 #endif
 }
 
+/* Special handling to get tray icons redrawn. */
+static void plugin_socket_refresh(GtkWidget * w)
+{
+    gtk_widget_hide(w);
+#if !GTK_CHECK_VERSION(3, 0, 0)
+    gdk_window_process_all_updates();
+#endif
+    gtk_widget_show(w);
+#if !GTK_CHECK_VERSION(3, 0, 0)
+    gdk_window_process_all_updates();
+#endif
+}
+
+/* Recursively refresh tray icons only, when the panel background pixels
+   changed but its configuration did not. */
+void _plugin_widget_refresh_sockets(GtkWidget * w)
+{
+    if (GTK_IS_SOCKET(w))
+        plugin_socket_refresh(w);
+    else if (GTK_IS_CONTAINER(w))
+        gtk_container_foreach(GTK_CONTAINER(w),
+                              (GtkCallback) _plugin_widget_refresh_sockets, NULL);
+}
+
 /* Recursively set the background of all widgets on a panel background configuration change. */
 void plugin_widget_set_background(GtkWidget * w, LXPanel * panel)
 {
@@ -211,18 +235,8 @@ void plugin_widget_set_background(GtkWidget * w, LXPanel * panel)
             }
         }
 
-        /* Special handling to get tray icons redrawn. */
         if (GTK_IS_SOCKET(w))
-        {
-            gtk_widget_hide(w);
-#if !GTK_CHECK_VERSION(3, 0, 0)
-            gdk_window_process_all_updates();
-#endif
-            gtk_widget_show(w);
-#if !GTK_CHECK_VERSION(3, 0, 0)
-            gdk_window_process_all_updates();
-#endif
-        }
+            plugin_socket_refresh(w);
 
         /* Recursively process all children of a container. */
         if (GTK_IS_CONTAINER(w))
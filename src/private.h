@@ -35,6 +35,7 @@
 #include <gdk/gdk.h>
 
 #include "ev.h"
+#include "bg.h"
 
 #if !GLIB_CHECK_VERSION(2, 40, 0)
 # define g_info(...) g_log(G_LOG_DOMAIN, G_LOG_LEVEL_INFO, __VA_ARGS__)
@@ -166,13 +167,18 @@ struct _Panel {
     guint initialized : 1;              /* Should be grouped better later, */
     guint ah_far : 1;                   /* placed here for binary compatibility */
     guint ah_state : 3;
+    guint background_forced : 1;        /* queued update must redo plugins */
     guint background_update_queued;
     guint strut_update_queued;
-    guint mouse_timeout;
+    guint mouse_timeout;                /* Autohide polling, see panel.c */
+    GdkWindow *ah_strip;                /* Autohide reveal area when hidden */
     guint reconfigure_queued;
+    guint config_save_queued;
     //gint dyn_space;                     /* Space for expandable plugins */
     //guint calculate_size_idle;          /* The idle handler for dyn_space calc */
     cairo_surface_t *surface;           /* Panel background */
+    FbBg *bg;                           /* Root background, for transparency */
+    guint32 background_hash;            /* Size and root pixels of surface */
 
     PanelPluginMoveState move_state;    /* Plugin movement (drag&drop) support */
     int move_x, move_y;
@@ -248,6 +254,7 @@ void lxpanel_unload_modules(void);
 
 GHashTable *lxpanel_get_all_types(void); /* transfer none */
 void _lxpanel_remove_plugin(LXPanel *p, GtkWidget *plugin); /* no destroy dialog */
+void _plugin_widget_refresh_sockets(GtkWidget *w);
 
 extern GQuark lxpanel_plugin_qinit; /* access to LXPanelPluginInit data */
 #define PLUGIN_CLASS(_i) ((LXPanelPluginInit*)g_object_get_qdata(G_OBJECT(_i),lxpanel_plugin_qinit))
@@ -273,6 +280,8 @@ void _panel_emit_icon_size_changed(LXPanel *p);
 void _panel_emit_font_changed(LXPanel *p);
 
 void panel_configure(LXPanel* p, int sel_page);
+void panel_config_save(Panel *p); /* not delayed as lxpanel_config_save() */
+void _config_write_data_async(gchar * filename, gchar * data, gsize length);
 gboolean panel_edge_available(Panel* p, int edge, gint monitor);
 gboolean _panel_edge_can_strut(LXPanel *panel, int edge, gint monitor, gulong *size);
 void restart(void);
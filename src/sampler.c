@@ -0,0 +1,829 @@
+/*
+ * Shared /proc sampler for monitor plugins.
+ *
+ * This file is a part of LXPanel project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#endif
+
+#include "sampler.h"
+
+#define SAMPLER_SLACK        50000      /* us, calls due this soon are made early */
+#define SAMPLER_FRESH_TIME   50000      /* us, data younger than this is reused */
+#define SAMPLER_NETLINK_BUF  32768      /* large enough for any rtnetlink message */
+
+/* One file in /proc kept open between reads. */
+typedef struct {
+    const char *path;
+    int fd;
+    gboolean failed;                    /* open() failed, don't retry */
+    char *buf;
+    gsize size;                         /* allocated size of buf */
+    gint64 stamp;                       /* monotonic time of last read */
+} SamplerFile;
+
+typedef struct {
+    guint id;
+    guint sources;
+    guint interval;                     /* ms */
+    gint64 due;                         /* monotonic time of next call */
+    LXPanelSampleFunc func;
+    gpointer user_data;
+    guint pending : 1;                  /* to be called in this tick */
+    guint removed : 1;                  /* removed while dispatching */
+} SamplerSubscriber;
+
+typedef struct {
+    guint id;
+    LXPanelNetWatchFunc func;
+    gpointer user_data;
+    guint removed : 1;                  /* removed while dispatching */
+} SamplerNetWatch;
+
+static SamplerFile proc_stat = { .path = "/proc/stat", .fd = -1 };
+static SamplerFile proc_meminfo = { .path = "/proc/meminfo", .fd = -1 };
+static SamplerFile proc_net_dev = { .path = "/proc/net/dev", .fd = -1 };
+
+static LXPanelSample snapshot;
+static LXPanelCpuTimes *cpus = NULL;
+static guint cpus_allocated = 0;
+static LXPanelNetDevice *net_devices = NULL;
+static guint net_devices_allocated = 0;
+
+static gint64 net_stamp = 0;           /* monotonic time of last net read */
+
+static GList *subscribers = NULL;
+static GList *net_watches = NULL;       /* of SamplerNetWatch */
+static guint last_id = 0;
+static guint timer = 0;
+static gint64 timer_due = 0;            /* monotonic time the timer fires at */
+static gint dispatching = 0;
+static gint net_dispatching = 0;
+
+/* Reads the whole file into f->buf and terminates it with NUL.
+ * pread() at offset 0 makes procfs regenerate the contents so the fd can
+ * stay open for the whole session instead of being opened on each tick.
+ * A single read of a seq_file returns at most about a page however large
+ * the buffer is, so keep reading at growing offsets until end of file. */
+static gssize sampler_file_read(SamplerFile *f)
+{
+    gssize len = 0, n;
+
+    if (f->fd < 0)
+    {
+        if (f->failed)
+            return -1;
+        f->fd = open(f->path, O_RDONLY | O_CLOEXEC);
+        if (f->fd < 0)
+        {
+            g_warning("sampler: cannot open %s: %s", f->path, g_strerror(errno));
+            f->failed = TRUE;
+            return -1;
+        }
+    }
+    if (f->buf == NULL)
+    {
+        f->size = 4096;
+        f->buf = g_malloc(f->size);
+    }
+    for (;;)
+    {
+        if ((gsize)len == f->size - 1)
+        {
+            f->size <<= 1;
+            f->buf = g_realloc(f->buf, f->size);
+        }
+        n = pread(f->fd, f->buf + len, f->size - 1 - len, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            g_warning("sampler: cannot read %s: %s", f->path, g_strerror(errno));
+            return -1;
+        }
+        if (n == 0)
+            break;
+        len += n;
+    }
+    f->buf[len] = '\0';
+    return len;
+}
+
+/* Hand-rolled scanner: sscanf() is too slow for hundreds of numbers. */
+static inline guint64 scan_u64(const char **pp)
+{
+    const char *p = *pp;
+    guint64 value = 0;
+
+    while (*p == ' ' || *p == '\t')
+        p++;
+    while (*p >= '0' && *p <= '9')
+        value = value * 10 + (guint64)(*p++ - '0');
+    *pp = p;
+    return value;
+}
+
+static inline const char *next_line(const char *p)
+{
+    p = strchr(p, '\n');
+    return p ? p + 1 : NULL;
+}
+
+static void scan_cpu_times(const char *p, LXPanelCpuTimes *t)
+{
+    t->user = scan_u64(&p);
+    t->nice = scan_u64(&p);
+    t->system = scan_u64(&p);
+    t->idle = scan_u64(&p);
+    /* fields below are absent on old kernels and read as 0 then */
+    t->iowait = scan_u64(&p);
+    t->irq = scan_u64(&p);
+    t->softirq = scan_u64(&p);
+    t->steal = scan_u64(&p);
+}
+
+static gboolean parse_stat(const char *p)
+{
+    guint n = 0;
+    guint i;
+
+    if (strncmp(p, "cpu ", 4) != 0)
+        return FALSE;
+    scan_cpu_times(p + 4, &snapshot.cpu);
+    /* lines of offline CPUs are absent so index by the CPU number */
+    if (cpus)
+        memset(cpus, 0, cpus_allocated * sizeof(LXPanelCpuTimes));
+    while ((p = next_line(p)) != NULL && strncmp(p, "cpu", 3) == 0)
+    {
+        p += 3;
+        i = scan_u64(&p);
+        if (i >= cpus_allocated)
+        {
+            guint old = cpus_allocated;
+
+            cpus_allocated = MAX(i + 1, cpus_allocated * 2);
+            cpus = g_renew(LXPanelCpuTimes, cpus, cpus_allocated);
+            memset(&cpus[old], 0, (cpus_allocated - old) * sizeof(LXPanelCpuTimes));
+        }
+        scan_cpu_times(p, &cpus[i]);
+        if (i >= n)
+            n = i + 1;
+    }
+    snapshot.n_cpus = n;
+    snapshot.cpus = cpus;
+    return TRUE;
+}
+
+static gboolean parse_meminfo(const char *p)
+{
+    static const struct {
+        const char *key;
+        gsize offset;
+    } keys[] = {
+        { "MemTotal:", G_STRUCT_OFFSET(LXPanelSample, mem_total) },
+        { "MemFree:", G_STRUCT_OFFSET(LXPanelSample, mem_free) },
+        { "MemAvailable:", G_STRUCT_OFFSET(LXPanelSample, mem_available) },
+        { "Buffers:", G_STRUCT_OFFSET(LXPanelSample, mem_buffers) },
+        { "Cached:", G_STRUCT_OFFSET(LXPanelSample, mem_cached) },
+        { "SReclaimable:", G_STRUCT_OFFSET(LXPanelSample, mem_sreclaimable) },
+        { "SwapTotal:", G_STRUCT_OFFSET(LXPanelSample, swap_total) },
+        { "SwapFree:", G_STRUCT_OFFSET(LXPanelSample, swap_free) }
+    };
+    guint found = 0;
+    guint i;
+
+    snapshot.mem_available = 0; /* absent before Linux 3.14 */
+    for (; p != NULL && found < G_N_ELEMENTS(keys); p = next_line(p))
+    {
+        for (i = 0; i < G_N_ELEMENTS(keys); i++)
+        {
+            gsize len = strlen(keys[i].key);
+
+            if (strncmp(p, keys[i].key, len) == 0)
+            {
+                const char *value = p + len;
+
+                G_STRUCT_MEMBER(guint64, &snapshot, keys[i].offset) = scan_u64(&value);
+                found++;
+                break;
+            }
+        }
+    }
+    return snapshot.mem_total != 0;
+}
+
+static gboolean parse_net_dev(const char *p)
+{
+    guint n = 0;
+
+    /* skip two lines of the header */
+    p = next_line(p);
+    if (p)
+        p = next_line(p);
+    for (; p != NULL && *p != '\0'; p = next_line(p))
+    {
+        LXPanelNetDevice *dev;
+        const char *name, *colon;
+        gsize len;
+
+        name = p;
+        while (*name == ' ')
+            name++;
+        colon = strchr(name, ':');
+        if (colon == NULL)
+            continue;
+        if (n == net_devices_allocated)
+        {
+            net_devices_allocated = MAX(8, net_devices_allocated * 2);
+            net_devices = g_renew(LXPanelNetDevice, net_devices, net_devices_allocated);
+        }
+        dev = &net_devices[n++];
+        memset(dev, 0, sizeof(LXPanelNetDevice));
+        len = MIN((gsize)(colon - name), sizeof(dev->name) - 1);
+        memcpy(dev->name, name, len);
+        dev->name[len] = '\0';
+        /* bytes packets errs drop fifo frame compressed multicast, twice */
+        p = colon + 1;
+        dev->rx_bytes = scan_u64(&p);
+        dev->rx_packets = scan_u64(&p);
+        dev->rx_errors = scan_u64(&p);
+        scan_u64(&p);
+        scan_u64(&p);
+        scan_u64(&p);
+        scan_u64(&p);
+        scan_u64(&p);
+        dev->tx_bytes = scan_u64(&p);
+        dev->tx_packets = scan_u64(&p);
+        dev->tx_errors = scan_u64(&p);
+    }
+    snapshot.n_net_devices = n;
+    snapshot.net_devices = net_devices;
+    return TRUE;
+}
+
+static void sampler_refresh_source(SamplerFile *f, guint source,
+                                   gboolean (*parse)(const char *), gint64 now)
+{
+    /* several pollers in the same tick get the data read by the first one */
+    if (f->stamp != 0 && now - f->stamp < SAMPLER_FRESH_TIME)
+        return;
+    if (sampler_file_read(f) >= 0 && parse(f->buf))
+    {
+        f->stamp = now;
+        snapshot.sources |= source;
+    }
+    else
+        snapshot.sources &= ~source;
+}
+
+#ifdef __linux__
+static int rtnl_fd = -1;                /* for link dumps */
+static gboolean rtnl_failed = FALSE;   /* not supported, don't retry */
+static guint32 rtnl_seq = 0;
+static char *rtnl_buf = NULL;
+
+static LXPanelNetDevice *net_device_append(guint n)
+{
+    if (n == net_devices_allocated)
+    {
+        net_devices_allocated = MAX(8, net_devices_allocated * 2);
+        net_devices = g_renew(LXPanelNetDevice, net_devices, net_devices_allocated);
+    }
+    memset(&net_devices[n], 0, sizeof(LXPanelNetDevice));
+    return &net_devices[n];
+}
+
+/* Fills net_devices[n] from a RTM_NEWLINK message, returns FALSE if the
+   message carries no interface name. */
+static gboolean parse_link(struct nlmsghdr *nlh, guint n)
+{
+    struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+    int len = IFLA_PAYLOAD(nlh);
+    LXPanelNetDevice *dev = net_device_append(n);
+    struct rtattr *rta;
+
+    dev->index = ifi->ifi_index;
+    dev->flags = ifi->ifi_flags;
+    dev->type = ifi->ifi_type;
+    for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+    {
+        gsize size = RTA_PAYLOAD(rta);
+
+        switch (rta->rta_type)
+        {
+        case IFLA_IFNAME:
+            g_strlcpy(dev->name, RTA_DATA(rta), MIN(size + 1, sizeof(dev->name)));
+            break;
+        case IFLA_ADDRESS:
+            dev->address_len = MIN(size, sizeof(dev->address));
+            memcpy(dev->address, RTA_DATA(rta), dev->address_len);
+            break;
+        case IFLA_STATS64:
+        {
+            /* attribute data is only 4-byte aligned */
+            struct rtnl_link_stats64 st;
+
+            memset(&st, 0, sizeof(st));
+            memcpy(&st, RTA_DATA(rta), MIN(size, sizeof(st)));
+            dev->rx_bytes = st.rx_bytes;
+            dev->rx_packets = st.rx_packets;
+            dev->rx_errors = st.rx_errors;
+            dev->tx_bytes = st.tx_bytes;
+            dev->tx_packets = st.tx_packets;
+            dev->tx_errors = st.tx_errors;
+            break;
+        }
+        }
+    }
+    return dev->name[0] != '\0';
+}
+
+/* Reads names, state and counters of all interfaces with one RTM_GETLINK
+   dump instead of parsing /proc/net/dev and asking each one with ioctl(). */
+static gboolean sampler_read_links(void)
+{
+    struct {
+        struct nlmsghdr nlh;
+        struct ifinfomsg ifi;
+    } req;
+    struct sockaddr_nl sa;
+    guint n = 0;
+
+    if (rtnl_fd < 0)
+    {
+        if (rtnl_failed)
+            return FALSE;
+        rtnl_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (rtnl_fd < 0)
+        {
+            rtnl_failed = TRUE;
+            goto failed;
+        }
+        if (rtnl_buf == NULL)
+            rtnl_buf = g_malloc(SAMPLER_NETLINK_BUF);
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req.nlh.nlmsg_type = RTM_GETLINK;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq = ++rtnl_seq;
+    req.ifi.ifi_family = AF_UNSPEC;
+    if (sendto(rtnl_fd, &req, req.nlh.nlmsg_len, 0,
+               (struct sockaddr *)&sa, sizeof(sa)) < 0)
+        goto failed;
+
+    for (;;)
+    {
+        struct nlmsghdr *nlh;
+        gssize len = recv(rtnl_fd, rtnl_buf, SAMPLER_NETLINK_BUF, 0);
+
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            goto failed;
+        }
+        for (nlh = (struct nlmsghdr *)rtnl_buf; NLMSG_OK(nlh, (gsize)len);
+             nlh = NLMSG_NEXT(nlh, len))
+        {
+            /* replies to an earlier, interrupted dump */
+            if (nlh->nlmsg_seq != rtnl_seq)
+                continue;
+            if (nlh->nlmsg_type == NLMSG_DONE)
+            {
+                snapshot.n_net_devices = n;
+                snapshot.net_devices = net_devices;
+                return TRUE;
+            }
+            if (nlh->nlmsg_type == NLMSG_ERROR)
+            {
+                errno = -((struct nlmsgerr *)NLMSG_DATA(nlh))->error;
+                goto failed;
+            }
+            if (nlh->nlmsg_type == RTM_NEWLINK && parse_link(nlh, n))
+                n++;
+        }
+    }
+
+failed:
+    /* other errors may be transient, such as ENOBUFS, so only drop the
+       socket then and try again with a new one on next tick */
+    if (errno == EPROTONOSUPPORT || errno == EACCES)
+        rtnl_failed = TRUE;
+    if (rtnl_failed)
+        g_warning("sampler: rtnetlink is unavailable, using %s: %s",
+                  proc_net_dev.path, g_strerror(errno));
+    else
+        g_warning("sampler: rtnetlink dump failed, using %s this time: %s",
+                  proc_net_dev.path, g_strerror(errno));
+    if (rtnl_fd >= 0)
+        close(rtnl_fd);
+    rtnl_fd = -1;
+    return FALSE;
+}
+#endif
+
+static void sampler_refresh_net(gint64 now)
+{
+    if (net_stamp != 0 && now - net_stamp < SAMPLER_FRESH_TIME)
+        return;
+#ifdef __linux__
+    if (sampler_read_links())
+    {
+        net_stamp = now;
+        snapshot.sources |= LXPANEL_SAMPLE_NET_DEV | LXPANEL_SAMPLE_NET_LINK;
+        return;
+    }
+#endif
+    snapshot.sources &= ~LXPANEL_SAMPLE_NET_LINK;
+    sampler_refresh_source(&proc_net_dev, LXPANEL_SAMPLE_NET_DEV, parse_net_dev, now);
+    net_stamp = proc_net_dev.stamp;
+}
+
+static void sampler_refresh(guint sources, gint64 now)
+{
+    if (sources & LXPANEL_SAMPLE_STAT)
+        sampler_refresh_source(&proc_stat, LXPANEL_SAMPLE_STAT, parse_stat, now);
+    if (sources & LXPANEL_SAMPLE_MEMINFO)
+        sampler_refresh_source(&proc_meminfo, LXPANEL_SAMPLE_MEMINFO, parse_meminfo, now);
+    if (sources & (LXPANEL_SAMPLE_NET_DEV | LXPANEL_SAMPLE_NET_LINK))
+        sampler_refresh_net(now);
+    if (sources)
+        snapshot.time = now;
+}
+
+static void sampler_reschedule(void);
+
+static gboolean sampler_tick(gpointer unused)
+{
+    GList *l, *next;
+    SamplerSubscriber *sub;
+    gint64 now;
+    guint sources = 0;
+
+    if (g_source_is_destroyed(g_main_current_source()))
+        return FALSE;
+    timer = 0;
+
+    /* serve also calls due very soon so they share this wakeup and read */
+    now = g_get_monotonic_time();
+    for (l = subscribers; l; l = l->next)
+    {
+        sub = l->data;
+        if (sub->due - SAMPLER_SLACK <= now)
+        {
+            sub->pending = TRUE;
+            sources |= sub->sources;
+        }
+    }
+    sampler_refresh(sources, now);
+
+    dispatching++;
+    for (l = subscribers; l; l = l->next)
+    {
+        sub = l->data;
+        if (!sub->pending || sub->removed)
+            continue;
+        sub->pending = FALSE;
+        sub->due = now + (gint64)sub->interval * 1000;
+        sub->func(&snapshot, sub->user_data);
+    }
+    dispatching--;
+
+    for (l = subscribers; l; l = next)
+    {
+        next = l->next;
+        sub = l->data;
+        if (sub->removed)
+        {
+            subscribers = g_list_delete_link(subscribers, l);
+            g_slice_free(SamplerSubscriber, sub);
+        }
+    }
+    /* the timer is one-shot, set it for the next call due */
+    sampler_reschedule();
+    return FALSE;
+}
+
+/* Sets the single timer for the earliest call due, so there is no wakeup
+   between calls however the intervals of subscribers relate. */
+static void sampler_reschedule(void)
+{
+    GList *l;
+    gint64 due = G_MAXINT64;
+    gint64 delay;
+
+    /* sampler_tick() sets the timer after calls are made */
+    if (dispatching)
+        return;
+    for (l = subscribers; l; l = l->next)
+    {
+        SamplerSubscriber *sub = l->data;
+
+        if (!sub->removed && sub->due < due)
+            due = sub->due;
+    }
+    if (timer != 0 && due == timer_due)
+        return;
+    if (timer)
+        g_source_remove(timer);
+    timer = 0;
+    if (due == G_MAXINT64)
+        return;
+    timer_due = due;
+    /* round up, the timer firing early would only set it again */
+    delay = (due - g_get_monotonic_time() + 999) / 1000;
+    timer = g_timeout_add(MAX(delay, 0), sampler_tick, NULL);
+}
+
+guint lxpanel_sampler_add(guint sources, guint interval,
+                          LXPanelSampleFunc func, gpointer user_data)
+{
+    SamplerSubscriber *sub;
+
+    g_return_val_if_fail(func != NULL, 0);
+    g_return_val_if_fail(interval > 0, 0);
+
+    sub = g_slice_new0(SamplerSubscriber);
+    sub->id = ++last_id;
+    sub->sources = sources;
+    sub->interval = interval;
+    sub->due = g_get_monotonic_time() + (gint64)interval * 1000;
+    sub->func = func;
+    sub->user_data = user_data;
+    subscribers = g_list_append(subscribers, sub);
+    sampler_reschedule();
+    return sub->id;
+}
+
+void lxpanel_sampler_remove(guint id)
+{
+    GList *l;
+
+    for (l = subscribers; l; l = l->next)
+    {
+        SamplerSubscriber *sub = l->data;
+
+        if (sub->id != id || sub->removed)
+            continue;
+        if (dispatching)
+            sub->removed = TRUE;
+        else
+        {
+            subscribers = g_list_delete_link(subscribers, l);
+            g_slice_free(SamplerSubscriber, sub);
+        }
+        sampler_reschedule();
+        return;
+    }
+}
+
+void lxpanel_sampler_set_interval(guint id, guint interval)
+{
+    GList *l;
+
+    g_return_if_fail(interval > 0);
+
+    for (l = subscribers; l; l = l->next)
+    {
+        SamplerSubscriber *sub = l->data;
+
+        if (sub->id != id || sub->removed)
+            continue;
+        if (sub->interval != interval)
+        {
+            /* due is always set from the last call, so shift it by the difference */
+            sub->due += ((gint64)interval - (gint64)sub->interval) * 1000;
+            sub->interval = interval;
+            sampler_reschedule();
+        }
+        return;
+    }
+}
+
+#ifdef __linux__
+static guint rtnl_events_watch = 0;    /* GIOChannel watch of event socket */
+
+static void sampler_net_dispatch(void)
+{
+    GList *l, *next;
+    SamplerNetWatch *watch;
+
+    net_dispatching++;
+    for (l = net_watches; l; l = l->next)
+    {
+        watch = l->data;
+        if (!watch->removed)
+            watch->func(watch->user_data);
+    }
+    net_dispatching--;
+
+    for (l = net_watches; l; l = next)
+    {
+        next = l->next;
+        watch = l->data;
+        if (watch->removed)
+        {
+            net_watches = g_list_delete_link(net_watches, l);
+            g_slice_free(SamplerNetWatch, watch);
+        }
+    }
+}
+
+static gboolean sampler_net_event(GIOChannel *source, GIOCondition cond, gpointer unused)
+{
+    int fd = g_io_channel_unix_get_fd(source);
+    gboolean changed = FALSE;
+    gssize len;
+
+    /* drain the socket so a burst of events is reported once */
+    while ((len = recv(fd, rtnl_buf, SAMPLER_NETLINK_BUF, MSG_DONTWAIT)) != 0)
+    {
+        struct nlmsghdr *nlh;
+
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            /* ENOBUFS means events were lost, assume something changed */
+            if (errno == ENOBUFS)
+                changed = TRUE;
+            break;
+        }
+        for (nlh = (struct nlmsghdr *)rtnl_buf; NLMSG_OK(nlh, (gsize)len);
+             nlh = NLMSG_NEXT(nlh, len))
+        {
+            switch (nlh->nlmsg_type)
+            {
+            case RTM_NEWLINK:
+            case RTM_DELLINK:
+            case RTM_NEWADDR:
+            case RTM_DELADDR:
+                changed = TRUE;
+            }
+        }
+    }
+    if (changed)
+    {
+        net_stamp = 0;
+        proc_net_dev.stamp = 0;
+        sampler_net_dispatch();
+    }
+    if (cond & (G_IO_ERR | G_IO_HUP))
+    {
+        g_warning("sampler: rtnetlink event socket failed");
+        rtnl_events_watch = 0;
+        return FALSE;
+    }
+    if (net_watches == NULL)
+    {
+        /* the last watch was removed from its callback */
+        rtnl_events_watch = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean sampler_net_events_open(void)
+{
+    struct sockaddr_nl sa;
+    GIOChannel *channel;
+    int fd;
+
+    if (rtnl_events_watch)
+        return TRUE;
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0)
+        return FALSE;
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+    {
+        g_warning("sampler: cannot listen to rtnetlink: %s", g_strerror(errno));
+        close(fd);
+        return FALSE;
+    }
+    if (rtnl_buf == NULL)
+        rtnl_buf = g_malloc(SAMPLER_NETLINK_BUF);
+    channel = g_io_channel_unix_new(fd);
+    g_io_channel_set_close_on_unref(channel, TRUE);
+    rtnl_events_watch = g_io_add_watch(channel, G_IO_IN | G_IO_ERR | G_IO_HUP,
+                                       sampler_net_event, NULL);
+    g_io_channel_unref(channel);
+    return TRUE;
+}
+#endif
+
+guint lxpanel_sampler_add_net_watch(LXPanelNetWatchFunc func, gpointer user_data)
+{
+#ifdef __linux__
+    SamplerNetWatch *watch;
+
+    g_return_val_if_fail(func != NULL, 0);
+
+    if (!sampler_net_events_open())
+        return 0;
+    watch = g_slice_new0(SamplerNetWatch);
+    watch->id = ++last_id;
+    watch->func = func;
+    watch->user_data = user_data;
+    net_watches = g_list_append(net_watches, watch);
+    return watch->id;
+#else
+    return 0;
+#endif
+}
+
+void lxpanel_sampler_remove_net_watch(guint id)
+{
+    GList *l;
+
+    for (l = net_watches; l; l = l->next)
+    {
+        SamplerNetWatch *watch = l->data;
+
+        if (watch->id != id || watch->removed)
+            continue;
+        if (net_dispatching)
+        {
+            watch->removed = TRUE;
+            return;
+        }
+        net_watches = g_list_delete_link(net_watches, l);
+        g_slice_free(SamplerNetWatch, watch);
+        break;
+    }
+#ifdef __linux__
+    /* nobody listens anymore, close the event socket */
+    if (net_watches == NULL && rtnl_events_watch)
+    {
+        g_source_remove(rtnl_events_watch);
+        rtnl_events_watch = 0;
+    }
+#endif
+}
+
+#define SAMPLE_RATE_FAST_CHANGE 0.05    /* changes above this sample fastest */
+#define SAMPLE_RATE_FLAT_CHANGE 0.01    /* changes below this back off */
+
+gboolean lxpanel_sample_rate_adapt(LXPanelSampleRate *rate, gdouble change)
+{
+    guint interval = rate->interval;
+
+    if (change >= SAMPLE_RATE_FAST_CHANGE)
+        interval = rate->min_interval;
+    else if (change < SAMPLE_RATE_FLAT_CHANGE)
+        /* doubling keeps intervals multiples of each other, so calls of
+           different subscribers keep coinciding and share wakeups */
+        interval = MIN(interval * 2, rate->max_interval);
+    if (interval == rate->interval)
+        return FALSE;
+    rate->interval = interval;
+    return TRUE;
+}
+
+const LXPanelSample *lxpanel_sampler_get(guint sources)
+{
+    sampler_refresh(sources, g_get_monotonic_time());
+    return &snapshot;
+}
+
+const LXPanelNetDevice *lxpanel_sample_find_net_device(const LXPanelSample *sample,
+                                                       const char *name)
+{
+    guint i;
+
+    g_return_val_if_fail(sample != NULL && name != NULL, NULL);
+
+    for (i = 0; i < sample->n_net_devices; i++)
+        if (strcmp(sample->net_devices[i].name, name) == 0)
+            return &sample->net_devices[i];
+    return NULL;
+}
@@ -0,0 +1,198 @@
+/*
+ * Shared /proc sampler for monitor plugins.
+ *
+ * This file is a part of LXPanel project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __LXPANEL_SAMPLER_H__
+#define __LXPANEL_SAMPLER_H__ 1
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Sources the sampler is able to read. */
+typedef enum {
+    LXPANEL_SAMPLE_STAT    = 1 << 0,    /* /proc/stat */
+    LXPANEL_SAMPLE_MEMINFO = 1 << 1,    /* /proc/meminfo */
+    LXPANEL_SAMPLE_NET_DEV = 1 << 2,    /* rtnetlink link dump or /proc/net/dev */
+    LXPANEL_SAMPLE_NET_LINK = 1 << 3    /* link state came from rtnetlink */
+} LXPanelSampleSource;
+
+/* Times from one "cpu" line of /proc/stat, in USER_HZ ticks. */
+typedef struct {
+    guint64 user, nice, system, idle;
+    guint64 iowait, irq, softirq, steal;
+} LXPanelCpuTimes;
+
+/* Counters of one network interface. The link state fields are set only if
+ * the sample has LXPANEL_SAMPLE_NET_LINK, they are 0 otherwise. */
+typedef struct {
+    gchar name[32];
+    guint64 rx_bytes, rx_packets, rx_errors;
+    guint64 tx_bytes, tx_packets, tx_errors;
+    /* link state */
+    gint index;                         /* interface index */
+    guint flags;                        /* IFF_* flags */
+    guint type;                         /* ARPHRD_* hardware type */
+    guint address_len;
+    guint8 address[16];                 /* hardware address */
+} LXPanelNetDevice;
+
+/**
+ * LXPanelSample
+ * @sources: mask of #LXPanelSampleSource which were read successfully
+ * @time: monotonic time of the last read, in microseconds
+ * @cpu: aggregate times of all CPUs
+ * @n_cpus: number of elements in @cpus
+ * @cpus: times of each CPU, indexed by CPU number
+ * @mem_total: values from /proc/meminfo, in kB
+ * @n_net_devices: number of elements in @net_devices
+ * @net_devices: counters of each network interface
+ *
+ * Snapshot of the sampled sources. The snapshot is shared by all users and
+ * is owned by the sampler, it is valid only until the next return to the
+ * main loop.
+ */
+typedef struct {
+    guint sources;
+    gint64 time;
+    /* /proc/stat */
+    LXPanelCpuTimes cpu;
+    guint n_cpus;
+    const LXPanelCpuTimes *cpus;
+    /* /proc/meminfo */
+    guint64 mem_total, mem_free, mem_available;
+    guint64 mem_buffers, mem_cached, mem_sreclaimable;
+    guint64 swap_total, swap_free;
+    /* /proc/net/dev */
+    guint n_net_devices;
+    const LXPanelNetDevice *net_devices;
+} LXPanelSample;
+
+typedef void (*LXPanelSampleFunc)(const LXPanelSample *sample, gpointer user_data);
+typedef void (*LXPanelNetWatchFunc)(gpointer user_data);
+
+/**
+ * LXPanelSampleRate
+ * @min_interval: interval while values change quickly, in milliseconds
+ * @max_interval: longest interval while values are flat, in milliseconds
+ * @interval: current interval, in milliseconds
+ *
+ * Adaptive sampling interval, see lxpanel_sample_rate_adapt().
+ */
+typedef struct {
+    guint min_interval;
+    guint max_interval;
+    guint interval;
+} LXPanelSampleRate;
+
+/**
+ * lxpanel_sampler_add
+ * @sources: mask of #LXPanelSampleSource to read before calling @func
+ * @interval: interval between calls in milliseconds
+ * @func: function to call
+ * @user_data: data to pass to @func
+ *
+ * Subscribes @func to periodic samples. All subscribers share a single
+ * timer and each source is read at most once per tick however many
+ * subscribers want it. @sources may be 0 to only share the timer.
+ *
+ * Returns: subscription id to pass to lxpanel_sampler_remove().
+ */
+extern guint lxpanel_sampler_add(guint sources, guint interval,
+                                 LXPanelSampleFunc func, gpointer user_data);
+
+/**
+ * lxpanel_sampler_remove
+ * @id: subscription id
+ *
+ * Cancels a subscription made by lxpanel_sampler_add(). It is safe to call
+ * this function from the subscription callback.
+ */
+extern void lxpanel_sampler_remove(guint id);
+
+/**
+ * lxpanel_sampler_set_interval
+ * @id: subscription id
+ * @interval: new interval between calls in milliseconds
+ *
+ * Changes the interval of a subscription made by lxpanel_sampler_add(). The
+ * next call happens @interval milliseconds after the last one.
+ */
+extern void lxpanel_sampler_set_interval(guint id, guint interval);
+
+/**
+ * lxpanel_sample_rate_adapt
+ * @rate: the sampling rate
+ * @change: largest change of the sampled values, as fraction of their range
+ *
+ * Updates @rate->interval: it drops to @rate->min_interval as soon as values
+ * change quickly and doubles up to @rate->max_interval while they are flat.
+ *
+ * Returns: %TRUE if @rate->interval was changed.
+ */
+extern gboolean lxpanel_sample_rate_adapt(LXPanelSampleRate *rate, gdouble change);
+
+/**
+ * lxpanel_sampler_get
+ * @sources: mask of #LXPanelSampleSource to read
+ *
+ * Retrieves the latest snapshot, reading @sources unless they were already
+ * read during this tick.
+ *
+ * Returns: (transfer none): the snapshot.
+ */
+extern const LXPanelSample *lxpanel_sampler_get(guint sources);
+
+/**
+ * lxpanel_sampler_add_net_watch
+ * @func: function to call
+ * @user_data: data to pass to @func
+ *
+ * Calls @func as soon as a network interface appears, disappears, changes
+ * its link state or its addresses. Network data of the snapshot is read
+ * again on the next lxpanel_sampler_get() after that. All watches share a
+ * single rtnetlink socket.
+ *
+ * Returns: watch id to pass to lxpanel_sampler_remove_net_watch(), or 0 if
+ * link events are not available on this system.
+ */
+extern guint lxpanel_sampler_add_net_watch(LXPanelNetWatchFunc func, gpointer user_data);
+
+/**
+ * lxpanel_sampler_remove_net_watch
+ * @id: watch id
+ *
+ * Cancels a watch made by lxpanel_sampler_add_net_watch(). It is safe to
+ * call this function from the watch callback.
+ */
+extern void lxpanel_sampler_remove_net_watch(guint id);
+
+/**
+ * lxpanel_sample_find_net_device
+ * @sample: the snapshot
+ * @name: interface name
+ *
+ * Returns: (transfer none): counters of interface @name or %NULL.
+ */
+extern const LXPanelNetDevice *lxpanel_sample_find_net_device(const LXPanelSample *sample,
+                                                              const char *name);
+
+G_END_DECLS
+
+#endif